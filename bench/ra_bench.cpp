@@ -0,0 +1,267 @@
+// Register allocation microbenchmark.
+//
+// Builds synthetic nv50_ir programs shaped like translated TGSI (a pool of
+// temporaries that are redefined all over the CFG) and times
+// Program::registerAllocation() on them. Three corpora are generated, each at
+// several sizes:
+//   diamonds  a sequence of if/else regions
+//   loops     loops nested three deep, with conditional breaks and ifs inside
+//   straight  a single block, like a fully unrolled loop body
+// The corpus only depends on the seed, so numbers from different trees can be
+// compared directly.
+
+#include "codegen/nv50_ir.h"
+#include "codegen/nv50_ir_build_util.h"
+#include "codegen/nv50_ir_target.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace nv50_ir;
+
+enum CorpusShape
+{
+	Shape_Diamonds,
+	Shape_Loops,
+	Shape_Straight,
+};
+
+static const char* const s_shapeNames[] = { "diamonds", "loops", "straight" };
+
+static const unsigned s_defaultSizes[] = { 16, 64, 256 };
+
+static const unsigned s_numTemps = 32;
+static const unsigned s_opsPerBlock = 6;
+static const unsigned s_chipset = 0x12b; // GM20B
+
+class CorpusBuilder : public BuildUtil
+{
+	std::vector<LValue*> temps;
+	uint32_t seed;
+	unsigned loopDepth;
+
+	unsigned random(unsigned n)
+	{
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) % n;
+	}
+
+	LValue* temp()
+	{
+		return temps[random(temps.size())];
+	}
+
+	void emitOps(unsigned count);
+	void emitIf(bool withElse, unsigned inner);
+	void emitLoop(unsigned depth);
+
+public:
+	CorpusBuilder(Program* prog, uint32_t seed) : BuildUtil(prog), seed(seed), loopDepth(0) { }
+
+	void build(CorpusShape shape, unsigned size);
+};
+
+void CorpusBuilder::emitOps(unsigned count)
+{
+	static const operation ops[] = { OP_ADD, OP_MUL, OP_XOR, OP_AND, OP_SHL };
+	for (unsigned i = 0; i < count; i ++)
+	{
+		operation op = ops[random(sizeof(ops)/sizeof(ops[0]))];
+		mkOp2(op, TYPE_U32, temp(), temp(), temp());
+	}
+}
+
+// Same CFG as the TGSI IF/ELSE/ENDIF translation.
+void CorpusBuilder::emitIf(bool withElse, unsigned inner)
+{
+	BasicBlock* forkBB = getBB();
+	BasicBlock* ifBB = new BasicBlock(func);
+	BasicBlock* convBB = new BasicBlock(func);
+	LValue* pred = new_LValue(func, FILE_PREDICATE);
+
+	mkCmp(OP_SET, CC_LT, TYPE_U32, pred, TYPE_U32, temp(), mkImm(random(256)));
+	forkBB->cfg.attach(&ifBB->cfg, Graph::Edge::TREE);
+	FlowInstruction* fork = mkFlow(OP_BRA, NULL, CC_NOT_P, pred);
+
+	setPosition(ifBB, true);
+	emitOps(inner);
+
+	BasicBlock* prevBB = forkBB;
+	if (withElse)
+	{
+		BasicBlock* elseBB = new BasicBlock(func);
+		forkBB->cfg.attach(&elseBB->cfg, Graph::Edge::TREE);
+		fork->target.bb = elseBB;
+		prevBB = getBB();
+		mkFlow(OP_BRA, NULL, CC_ALWAYS, NULL);
+
+		setPosition(elseBB, true);
+		emitOps(inner);
+	}
+
+	mkFlow(OP_BRA, convBB, CC_ALWAYS, NULL);
+	getBB()->cfg.attach(&convBB->cfg, Graph::Edge::FORWARD);
+	prevBB->cfg.attach(&convBB->cfg, Graph::Edge::FORWARD);
+	prevBB->getExit()->asFlow()->target.bb = convBB;
+
+	setPosition(convBB, true);
+}
+
+void CorpusBuilder::emitLoop(unsigned depth)
+{
+	BasicBlock* lbgnBB = new BasicBlock(func);
+	BasicBlock* lbrkBB = new BasicBlock(func);
+
+	if (++loopDepth > func->loopNestingBound)
+		func->loopNestingBound++;
+
+	mkFlow(OP_PREBREAK, lbrkBB, CC_ALWAYS, NULL);
+	getBB()->cfg.attach(&lbgnBB->cfg, Graph::Edge::TREE);
+	setPosition(lbgnBB, true);
+	mkFlow(OP_PRECONT, lbgnBB, CC_ALWAYS, NULL);
+
+	emitOps(s_opsPerBlock);
+	if (depth > 1)
+		emitLoop(depth - 1);
+	emitIf(random(2), s_opsPerBlock);
+
+	// IF cond BRK ENDIF, like the TGSI translation
+	BasicBlock* forkBB = getBB();
+	BasicBlock* ifBB = new BasicBlock(func);
+	BasicBlock* convBB = new BasicBlock(func);
+	LValue* pred = new_LValue(func, FILE_PREDICATE);
+
+	mkCmp(OP_SET, CC_EQ, TYPE_U32, pred, TYPE_U32, temp(), mkImm(random(256)));
+	forkBB->cfg.attach(&ifBB->cfg, Graph::Edge::TREE);
+	mkFlow(OP_BRA, convBB, CC_NOT_P, pred);
+	forkBB->cfg.attach(&convBB->cfg, Graph::Edge::FORWARD);
+	setPosition(ifBB, true);
+	mkFlow(OP_BREAK, lbrkBB, CC_ALWAYS, NULL);
+	ifBB->cfg.attach(&lbrkBB->cfg, Graph::Edge::CROSS);
+
+	setPosition(convBB, true);
+	emitOps(s_opsPerBlock);
+	mkFlow(OP_CONT, lbgnBB, CC_ALWAYS, NULL);
+	convBB->cfg.attach(&lbgnBB->cfg, Graph::Edge::BACK);
+
+	setPosition(lbrkBB, true);
+	loopDepth--;
+}
+
+void CorpusBuilder::build(CorpusShape shape, unsigned size)
+{
+	Function* fn = prog->main;
+	BasicBlock* entry = new BasicBlock(fn);
+	BasicBlock* leave = new BasicBlock(fn);
+	fn->setEntry(entry);
+	fn->setExit(leave);
+	setPosition(entry, true);
+
+	// Like TGSI temporaries: not SSA, initialized from constants
+	temps.resize(s_numTemps);
+	for (unsigned i = 0; i < s_numTemps; i ++)
+	{
+		temps[i] = getScratch();
+		mkLoad(TYPE_U32, temps[i], mkSymbol(FILE_MEMORY_CONST, 0, TYPE_U32, i*4), NULL);
+	}
+
+	for (unsigned i = 0; i < size; i ++)
+	{
+		switch (shape)
+		{
+			case Shape_Diamonds:
+				emitOps(s_opsPerBlock);
+				emitIf(random(2), s_opsPerBlock);
+				break;
+			case Shape_Loops:
+				emitOps(s_opsPerBlock);
+				emitLoop(3);
+				break;
+			case Shape_Straight:
+				emitOps(s_opsPerBlock*4);
+				break;
+		}
+	}
+
+	getBB()->cfg.attach(&leave->cfg, Graph::Edge::TREE);
+	setPosition(leave, true);
+	for (unsigned i = 0; i < s_numTemps; i ++)
+		mkStore(OP_EXPORT, TYPE_U32, mkSymbol(FILE_SHADER_OUTPUT, 0, TYPE_U32, i*4), NULL, temps[i]);
+	mkOp(OP_EXIT, TYPE_NONE, NULL)->terminator = 1;
+}
+
+// Returns the time spent in registerAllocation, in microseconds.
+static double run_once(CorpusShape shape, unsigned size, int& maxGPR)
+{
+	struct nv50_ir_prog_info info;
+	memset(&info, 0, sizeof(info));
+	info.target = s_chipset;
+	info.type = PIPE_SHADER_VERTEX;
+
+	Target* targ = Target::create(s_chipset);
+	targ->parseDriverInfo(&info);
+	Program* prog = new Program(Program::TYPE_VERTEX, targ);
+	prog->driver = &info;
+
+	CorpusBuilder(prog, 1 + size*3 + shape).build(shape, size);
+	prog->convertToSSA();
+
+	auto start = std::chrono::steady_clock::now();
+	bool ok = prog->registerAllocation();
+	auto end = std::chrono::steady_clock::now();
+
+	maxGPR = ok ? prog->maxGPR : -1;
+	delete prog;
+	Target::destroy(targ);
+	return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<unsigned> sizes;
+	unsigned repeat = 5;
+	const char* corpus = nullptr;
+
+	for (int i = 1; i < argc; i ++)
+	{
+		if (strncmp(argv[i], "--repeat=", 9) == 0)
+			repeat = std::max(atoi(argv[i]+9), 1);
+		else if (strncmp(argv[i], "--corpus=", 9) == 0)
+			corpus = argv[i]+9;
+		else if (atoi(argv[i]) > 0)
+			sizes.push_back(atoi(argv[i]));
+		else
+		{
+			fprintf(stderr, "Usage: %s [--repeat=<num>] [--corpus=<name>] [size...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (sizes.empty())
+		sizes.assign(s_defaultSizes, s_defaultSizes + sizeof(s_defaultSizes)/sizeof(s_defaultSizes[0]));
+
+	printf("%-10s %6s %8s %12s %12s\n", "corpus", "size", "maxGPR", "min (us)", "median (us)");
+	for (unsigned s = 0; s < sizeof(s_shapeNames)/sizeof(s_shapeNames[0]); s ++)
+	{
+		if (corpus && strcmp(corpus, s_shapeNames[s]) != 0)
+			continue;
+		for (unsigned size : sizes)
+		{
+			std::vector<double> times;
+			int maxGPR = -1;
+			for (unsigned r = 0; r < repeat; r ++)
+				times.push_back(run_once((CorpusShape)s, size, maxGPR));
+			if (maxGPR < 0)
+			{
+				fprintf(stderr, "Register allocation failed: %s %u\n", s_shapeNames[s], size);
+				return EXIT_FAILURE;
+			}
+			std::sort(times.begin(), times.end());
+			printf("%-10s %6u %8d %12.0f %12.0f\n", s_shapeNames[s], size, maxGPR, times[0], times[times.size()/2]);
+			fflush(stdout);
+		}
+	}
+	return EXIT_SUCCESS;
+}
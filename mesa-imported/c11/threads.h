@@ -1,12 +1,38 @@
 #pragma once
 
-// This header is fake.
+// The subset of C11 <threads.h> used by the imported code, on top of pthreads.
+// The locks guard tables shared by concurrent compilations (glsl_type hash
+// tables, built-in functions and variables, the #include cache), so they must
+// be real mutexes.
 
-typedef int mtx_t;
+#include <pthread.h>
 
-#define mtx_init(_m,...) ((void)(_m))
-#define mtx_destroy(_m,...) ((void)(_m))
-#define mtx_lock(_m,...) ((void)(_m))
-#define mtx_unlock(_m,...) ((void)(_m))
+enum
+{
+	mtx_plain = 0,
+};
 
-#define _MTX_INITIALIZER_NP 0
+typedef pthread_mutex_t mtx_t;
+
+#define _MTX_INITIALIZER_NP PTHREAD_MUTEX_INITIALIZER
+
+static inline int mtx_init(mtx_t *mtx, int type)
+{
+	(void)type;
+	return pthread_mutex_init(mtx, NULL);
+}
+
+static inline void mtx_destroy(mtx_t *mtx)
+{
+	pthread_mutex_destroy(mtx);
+}
+
+static inline int mtx_lock(mtx_t *mtx)
+{
+	return pthread_mutex_lock(mtx);
+}
+
+static inline int mtx_unlock(mtx_t *mtx)
+{
+	return pthread_mutex_unlock(mtx);
+}
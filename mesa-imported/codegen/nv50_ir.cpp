@@ -216,14 +216,17 @@ ValueDef::replace(const ValueRef &repVal, bool doSet)
       set(repVal.get());
 }
 
-Value::Value()
+Value::Value(Program *prog)
+   : uses(0, std::hash<ValueRef *>(), std::equal_to<ValueRef *>(),
+          ArenaAllocator<ValueRef *>(prog ? &prog->arena : NULL)),
+     defs(ArenaAllocator<ValueDef *>(prog ? &prog->arena : NULL))
 {
   join = this;
   memset(&reg, 0, sizeof(reg));
   reg.size = 4;
 }
 
-LValue::LValue(Function *fn, DataFile file)
+LValue::LValue(Function *fn, DataFile file) : Value(fn->getProgram())
 {
    reg.file = file;
    reg.size = (file != FILE_PREDICATE) ? 4 : 1;
@@ -238,7 +241,7 @@ LValue::LValue(Function *fn, DataFile file)
    fn->add(this, this->id);
 }
 
-LValue::LValue(Function *fn, LValue *lval)
+LValue::LValue(Function *fn, LValue *lval) : Value(fn->getProgram())
 {
    assert(lval);
 
@@ -281,7 +284,7 @@ LValue::isUniform() const
    return !insn->srcExists(1) && insn->getSrc(0)->isUniform();
 }
 
-Symbol::Symbol(Program *prog, DataFile f, ubyte fidx)
+Symbol::Symbol(Program *prog, DataFile f, ubyte fidx) : Value(prog)
 {
    baseSym = NULL;
 
@@ -319,7 +322,7 @@ Symbol::isUniform() const
       reg.file != FILE_SHADER_INPUT;
 }
 
-ImmediateValue::ImmediateValue(Program *prog, uint32_t uval)
+ImmediateValue::ImmediateValue(Program *prog, uint32_t uval) : Value(prog)
 {
    memset(&reg, 0, sizeof(reg));
 
@@ -332,7 +335,7 @@ ImmediateValue::ImmediateValue(Program *prog, uint32_t uval)
    prog->add(this, this->id);
 }
 
-ImmediateValue::ImmediateValue(Program *prog, float fval)
+ImmediateValue::ImmediateValue(Program *prog, float fval) : Value(prog)
 {
    memset(&reg, 0, sizeof(reg));
 
@@ -345,7 +348,7 @@ ImmediateValue::ImmediateValue(Program *prog, float fval)
    prog->add(this, this->id);
 }
 
-ImmediateValue::ImmediateValue(Program *prog, double dval)
+ImmediateValue::ImmediateValue(Program *prog, double dval) : Value(prog)
 {
    memset(&reg, 0, sizeof(reg));
 
@@ -604,6 +607,8 @@ Instruction::Instruction()
 }
 
 Instruction::Instruction(Function *fn, operation opr, DataType ty)
+   : defs(ArenaAllocator<ValueDef>(&fn->getProgram()->arena)),
+     srcs(ArenaAllocator<ValueRef>(&fn->getProgram()->arena))
 {
    init();
 
@@ -1110,17 +1115,24 @@ FlowInstruction::clone(ClonePolicy<Function>& pol, Instruction *i) const
 Program::Program(Type type, Target *arch)
    : progType(type),
      target(arch),
-     mem_Instruction(sizeof(Instruction), 6),
-     mem_CmpInstruction(sizeof(CmpInstruction), 4),
-     mem_TexInstruction(sizeof(TexInstruction), 4),
-     mem_FlowInstruction(sizeof(FlowInstruction), 4),
-     mem_LValue(sizeof(LValue), 8),
-     mem_Symbol(sizeof(Symbol), 7),
-     mem_ImmediateValue(sizeof(ImmediateValue), 7)
+     mem_Instruction(sizeof(Instruction), 6, &arena),
+     mem_CmpInstruction(sizeof(CmpInstruction), 4, &arena),
+     mem_TexInstruction(sizeof(TexInstruction), 4, &arena),
+     mem_FlowInstruction(sizeof(FlowInstruction), 4, &arena),
+     mem_LValue(sizeof(LValue), 8, &arena),
+     mem_Symbol(sizeof(Symbol), 7, &arena),
+     mem_ImmediateValue(sizeof(ImmediateValue), 7, &arena)
 {
    code = NULL;
    binSize = 0;
 
+   spillStores = 0;
+   spillLoads = 0;
+   spillValues = 0;
+   rematValues = 0;
+
+   bulkRelease = false;
+
    maxGPR = -1;
    fp64 = false;
    fp64_rcprsq = false; // fincs-addition
@@ -1137,11 +1149,13 @@ Program::Program(Type type, Target *arch)
 
 Program::~Program()
 {
+   // All instructions and values (including their operand and use lists)
+   // live in the arena, which is freed as a whole after this. The only other
+   // memory they can own are live intervals, which RA clears when done.
+   bulkRelease = true;
+
    for (ArrayList::Iterator it = allFuncs.iterator(); !it.end(); it.next())
       delete reinterpret_cast<Function *>(it.get());
-
-   for (ArrayList::Iterator it = allRValues.iterator(); !it.end(); it.next())
-      releaseValue(reinterpret_cast<Value *>(it.get()));
 }
 
 void Program::releaseInstruction(Instruction *insn)
@@ -1245,9 +1259,13 @@ nv50_ir_generate_code(struct nv50_ir_prog_info *info)
    prog->dbgFlags = info->dbgFlags;
    prog->optLevel = info->optLevel;
 
+   util_time_report_begin("nv50_ir_generate_code");
+
    switch (info->bin.sourceRep) {
    case PIPE_SHADER_IR_TGSI:
+      util_time_report_begin("makeFromTGSI");
       ret = prog->makeFromTGSI(info) ? 0 : -2;
+      util_time_report_end();
       break;
    default:
       ret = -1;
@@ -1261,37 +1279,49 @@ nv50_ir_generate_code(struct nv50_ir_prog_info *info)
    targ->parseDriverInfo(info);
    prog->getTarget()->runLegalizePass(prog, nv50_ir::CG_STAGE_PRE_SSA);
 
+   util_time_report_begin("convertToSSA");
    prog->convertToSSA();
+   util_time_report_end();
 
    if (prog->dbgFlags & NV50_IR_DEBUG_VERBOSE)
       prog->print();
 
+   util_time_report_begin("optimizeSSA");
    prog->optimizeSSA(info->optLevel);
+   util_time_report_end();
    prog->getTarget()->runLegalizePass(prog, nv50_ir::CG_STAGE_SSA);
 
    if (prog->dbgFlags & NV50_IR_DEBUG_BASIC)
       prog->print();
 
-   if (!prog->registerAllocation()) {
-      ret = -4;
+   util_time_report_begin("registerAllocation");
+   ret = prog->registerAllocation() ? 0 : -4;
+   util_time_report_end();
+   if (ret < 0)
       goto out;
-   }
    prog->getTarget()->runLegalizePass(prog, nv50_ir::CG_STAGE_POST_RA);
 
+   util_time_report_begin("optimizePostRA");
    prog->optimizePostRA(info->optLevel);
+   util_time_report_end();
 
-   if (!prog->emitBinary(info)) {
-      ret = -5;
-      goto out;
-   }
+   util_time_report_begin("emitBinary");
+   ret = prog->emitBinary(info) ? 0 : -5;
+   util_time_report_end();
 
 out:
+   util_time_report_end();
    INFO_DBG(prog->dbgFlags, VERBOSE, "nv50_ir_generate_code: ret = %i\n", ret);
 
    info->bin.maxGPR = prog->maxGPR;
    info->bin.code = prog->code;
    info->bin.codeSize = prog->binSize;
    info->bin.tlsSpace = prog->tlsSize;
+   info->bin.spillStores = prog->spillStores;
+   info->bin.spillLoads = prog->spillLoads;
+   info->bin.spillValues = prog->spillValues;
+   info->bin.rematValues = prog->rematValues;
+   info->bin.irMemSize = prog->arena.getReservedSize();
 
    delete prog;
    nv50_ir::Target::destroy(targ);
@@ -667,10 +667,14 @@ private:
    Instruction *insn;
 };
 
+// operand arrays of instructions and functions
+typedef std::deque<ValueDef, ArenaAllocator<ValueDef> > DefArray;
+typedef std::deque<ValueRef, ArenaAllocator<ValueRef> > RefArray;
+
 class Value
 {
 public:
-   Value();
+   Value(Program * = NULL); // containers use the program's arena, if given
    virtual ~Value() { }
 
    virtual Value *clone(ClonePolicy<Function>&) const = 0;
@@ -698,12 +702,17 @@ public:
 
    static inline Value *get(Iterator&);
 
-   unordered_set<ValueRef *> uses;
-   std::list<ValueDef *> defs;
-   typedef unordered_set<ValueRef *>::iterator UseIterator;
-   typedef unordered_set<ValueRef *>::const_iterator UseCIterator;
-   typedef std::list<ValueDef *>::iterator DefIterator;
-   typedef std::list<ValueDef *>::const_iterator DefCIterator;
+   typedef unordered_set<ValueRef *, std::hash<ValueRef *>,
+                         std::equal_to<ValueRef *>,
+                         ArenaAllocator<ValueRef *> > UseSet;
+   typedef std::list<ValueDef *, ArenaAllocator<ValueDef *> > DefList;
+
+   UseSet uses;
+   DefList defs;
+   typedef UseSet::iterator UseIterator;
+   typedef UseSet::const_iterator UseCIterator;
+   typedef DefList::iterator DefIterator;
+   typedef DefList::const_iterator DefCIterator;
 
    int id;
    Storage reg;
@@ -926,8 +935,8 @@ public:
    BasicBlock *bb;
 
 protected:
-   std::deque<ValueDef> defs; // no gaps !
-   std::deque<ValueRef> srcs; // no gaps !
+   DefArray defs; // no gaps !
+   RefArray srcs; // no gaps !
 
    // instruction specific methods:
    // (don't want to subclass, would need more constructors and memory pools)
@@ -1158,6 +1167,7 @@ public:
 
    BitSet liveSet;
    BitSet defSet;
+   std::vector<int> liveIn; // sorted value ids, see buildLiveSetsSSA
 
    uint32_t binPos;
    uint32_t binSize;
@@ -1213,11 +1223,12 @@ public:
 
    void buildLiveSets();
    void buildDefSets();
+   void buildLiveSetsSSA(); // sparse BasicBlock::liveIn, phi sources excluded
    bool convertToSSA();
 
 public:
-   std::deque<ValueDef> ins;
-   std::deque<ValueRef> outs;
+   DefArray ins;
+   RefArray outs;
    std::deque<Value *> clobbers;
 
    Graph cfg;
@@ -1310,12 +1321,18 @@ public:
    uint32_t *code;
    uint32_t binSize;
    uint32_t tlsSize; // size required for FILE_MEMORY_LOCAL
+   uint32_t spillStores; // number of spill/unspill instructions accessing
+   uint32_t spillLoads;  // FILE_MEMORY_LOCAL inserted by RA
+   uint32_t spillValues; // values spilled by RA
+   uint32_t rematValues; // values recomputed at their uses by RA instead
 
    int maxGPR;
    bool fp64;
    bool fp64_rcprsq; // fincs-addition
    bool int_divmod; // fincs-addition
 
+   Arena arena; // backs the memory pools and IR containers below
+
    MemoryPool mem_Instruction;
    MemoryPool mem_CmpInstruction;
    MemoryPool mem_TexInstruction;
@@ -1333,6 +1350,10 @@ public:
 
    void releaseInstruction(Instruction *);
    void releaseValue(Value *);
+
+   // Set while the program is being destroyed: instructions and values are
+   // then not destroyed one by one, as all their memory is in the arena.
+   bool bulkRelease;
 };
 
 // TODO: add const version
@@ -25,7 +25,9 @@
 namespace nv50_ir {
 
 Function::Function(Program *p, const char *fnName, uint32_t label)
-   : call(this),
+   : ins(ArenaAllocator<ValueDef>(&p->arena)),
+     outs(ArenaAllocator<ValueRef>(&p->arena)),
+     call(this),
      label(label),
      name(fnName),
      prog(p)
@@ -61,11 +63,13 @@ Function::~Function()
    ins.clear();
    outs.clear();
 
-   for (ArrayList::Iterator it = allInsns.iterator(); !it.end(); it.next())
-      delete_Instruction(prog, reinterpret_cast<Instruction *>(it.get()));
+   if (!prog->bulkRelease) {
+      for (ArrayList::Iterator it = allInsns.iterator(); !it.end(); it.next())
+         delete_Instruction(prog, reinterpret_cast<Instruction *>(it.get()));
 
-   for (ArrayList::Iterator it = allLValues.iterator(); !it.end(); it.next())
-      delete_Value(prog, reinterpret_cast<LValue *>(it.get()));
+      for (ArrayList::Iterator it = allLValues.iterator(); !it.end(); it.next())
+         delete_Value(prog, reinterpret_cast<LValue *>(it.get()));
+   }
 
    for (ArrayList::Iterator BBs = allBBlocks.iterator(); !BBs.end(); BBs.next())
       delete reinterpret_cast<BasicBlock *>(BBs.get());
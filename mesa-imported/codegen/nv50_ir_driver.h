@@ -75,6 +75,72 @@ struct nv50_ir_prog_symbol
 #define NVISA_GM107_CHIPSET    0x110
 #define NVISA_GM200_CHIPSET    0x120
 
+/* Static performance statistics of a basic block, derived from the scheduling
+ * information computed by the code emitter (GM107+ only).
+ */
+struct nv50_ir_perf_block
+{
+   uint32_t id;           /* basic block id */
+   uint32_t instructions;
+   uint32_t stallCycles;  /* sum of the stall counts */
+   uint32_t dualIssued;   /* instruction pairs issued together */
+   uint32_t barrierWaits; /* instructions waiting on scoreboard barriers */
+   uint32_t texOps;       /* texture and surface instructions */
+   uint32_t memOps;       /* load, store and atomic instructions */
+};
+
+struct nv50_ir_perf_info
+{
+   struct nv50_ir_perf_block *blocks; /* allocated with MALLOC, to be FREE'd by the caller */
+   uint32_t numBlocks;
+};
+
+/* Instruction classes of the GM107+ timing model. Their names (as returned by
+ * nv50_ir_get_timing_class_name) are used by timing files.
+ */
+enum nv50_ir_timing_class
+{
+   NV50_IR_TIMING_ALU,       /* fixed latency FP32 and integer operations */
+   NV50_IR_TIMING_ALU_HALF,  /* shifts and bitfield insertion/extraction */
+   NV50_IR_TIMING_IMUL,      /* integer multiplications */
+   NV50_IR_TIMING_RRO,       /* range reductions before MUFU */
+   NV50_IR_TIMING_MUFU,      /* transcendental functions (SFU) */
+   NV50_IR_TIMING_BITSCAN,   /* FLO and POPC */
+   NV50_IR_TIMING_CONVERT,   /* F2F, F2I, I2F and I2I */
+   NV50_IR_TIMING_F64,       /* FP64 arithmetic; the result latency and
+                              * throughput apply to any FP64 operation */
+   NV50_IR_TIMING_CS2R,      /* clock reads */
+   NV50_IR_TIMING_S2R,       /* other system value reads */
+   NV50_IR_TIMING_SHFL,
+   NV50_IR_TIMING_QUAD,      /* SAM and RAM */
+   NV50_IR_TIMING_INTERP,    /* IPA */
+   NV50_IR_TIMING_ATTR,      /* ALD */
+   NV50_IR_TIMING_AL2P,      /* AL2P and ISBERD */
+   NV50_IR_TIMING_PIXLD,
+   NV50_IR_TIMING_LD_CONST,
+   NV50_IR_TIMING_LD_SHARED,
+   NV50_IR_TIMING_LD_LOCAL,
+   NV50_IR_TIMING_LD_GLOBAL, /* also buffers */
+   NV50_IR_TIMING_STORE,     /* shared memory and attribute stores */
+   NV50_IR_TIMING_ST_GLOBAL, /* global, local and buffer stores, and SUST */
+   NV50_IR_TIMING_OUT,
+   NV50_IR_TIMING_ATOM,      /* atomics and surface reductions */
+   NV50_IR_TIMING_TEX,
+   NV50_IR_TIMING_TXQ,
+   NV50_IR_TIMING_SURFACE,   /* SULD */
+   NV50_IR_TIMING_OTHER,
+   NV50_IR_TIMING_COUNT
+};
+
+struct nv50_ir_timing
+{
+   uint8_t latency;         /* stall counts before dependent instructions may
+                             * issue (1 to 15), for fixed latency classes */
+   uint16_t resultLatency;  /* average cycles until the results are available,
+                             * for classes waited for with barriers */
+   uint8_t throughput;      /* cycles between two instructions of the class */
+};
+
 struct nv50_ir_prog_info
 {
    uint16_t target; /* chipset (0x50, 0x84, 0xc0, ...) */
@@ -82,6 +148,10 @@ struct nv50_ir_prog_info
    uint8_t type; /* PIPE_SHADER */
 
    uint8_t optLevel; /* optimization level (0 to 3) */
+   uint16_t gprBudget; /* max number of GPRs to allocate, 0 = target limit */
+   const struct nv50_ir_timing *timings; /* NV50_IR_TIMING_COUNT entries
+                                          * replacing the target's timing
+                                          * model, or NULL (GM107+ only) */
    uint8_t dbgFlags;
    bool omitLineNum; /* only used for printing the prog when dbgFlags is set */
 
@@ -89,6 +159,11 @@ struct nv50_ir_prog_info
       int16_t maxGPR;     /* may be -1 if none used */
       int16_t maxOutput;
       uint32_t tlsSpace;  /* required local memory per thread */
+      uint32_t spillStores; /* local memory stores inserted by RA */
+      uint32_t spillLoads;  /* local memory loads inserted by RA */
+      uint32_t spillValues; /* values spilled by RA */
+      uint32_t rematValues; /* values recomputed instead of spilled by RA */
+      uint32_t irMemSize;   /* high-water mark of the IR arena, in bytes */
       uint32_t smemSize;  /* required shared memory per block */
       uint32_t *code;
       uint32_t codeSize;
@@ -99,6 +174,7 @@ struct nv50_ir_prog_info
       void *fixupData;
       struct nv50_ir_prog_symbol *syms;
       uint16_t numSyms;
+      struct nv50_ir_perf_info *perf; /* optional, filled in by the emitter */
    } bin;
 
    struct nv50_ir_varying sv[PIPE_MAX_SHADER_INPUTS];
@@ -188,6 +264,7 @@ struct nv50_ir_prog_info
       uint16_t suInfoBase;       /* base address for surface info (nve4) */
       uint16_t bindlessBase;     /* base address for bindless image info (nve4) */
       uint16_t bufInfoBase;      /* base address for buffer info */
+      uint16_t bufAlignment;     /* guaranteed alignment of buffer addresses */
       uint16_t sampleInfoBase;   /* base address for sample positions */
       uint8_t msInfoCBSlot;      /* cX[] used for multisample info */
       uint16_t msInfoBase;       /* base address for multisample info */
@@ -220,6 +297,12 @@ nv50_ir_apply_fixups(void *fixupData, uint32_t *code,
 extern void nv50_ir_get_target_library(uint32_t chipset,
                                        const uint32_t **code, uint32_t *size);
 
+/* obtain the default timing model of a target, returns false if it has none */
+extern bool nv50_ir_get_timings(uint32_t chipset,
+                                struct nv50_ir_timing *timings);
+
+extern const char *nv50_ir_get_timing_class_name(unsigned int timingClass);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4563,6 +4563,45 @@ static inline uint32_t sizeToBundlesGM107(uint32_t size)
    return (size + 23) / 24;
 }
 
+// Summarize the scheduling information of each basic block, which would
+// otherwise only survive in encoded form.
+static void
+collectPerfInfoGM107(const Target *targ, Function *func,
+                     struct nv50_ir_perf_info *perf)
+{
+   perf->blocks = (struct nv50_ir_perf_block *)
+      REALLOC(perf->blocks, perf->numBlocks * sizeof(*perf->blocks),
+              (perf->numBlocks + func->bbCount) * sizeof(*perf->blocks));
+   if (!perf->blocks) {
+      perf->numBlocks = 0;
+      return;
+   }
+
+   for (int i = 0; i < func->bbCount; ++i) {
+      BasicBlock *bb = func->bbArray[i];
+      struct nv50_ir_perf_block *pb = &perf->blocks[perf->numBlocks++];
+      memset(pb, 0, sizeof(*pb));
+      pb->id = bb->getId();
+
+      for (Instruction *insn = bb->getEntry(); insn; insn = insn->next) {
+         const OpClass cl = targ->getOpClass(insn->op);
+         const int stall = insn->sched & 0xf;
+
+         pb->instructions++;
+         pb->stallCycles += stall;
+         if (stall == 0)
+            pb->dualIssued++;
+         if (insn->sched & 0x01f800)
+            pb->barrierWaits++;
+         if (cl == OPCLASS_TEXTURE || cl == OPCLASS_SURFACE)
+            pb->texOps++;
+         else
+         if (cl == OPCLASS_LOAD || cl == OPCLASS_STORE || cl == OPCLASS_ATOMIC)
+            pb->memOps++;
+      }
+   }
+}
+
 void
 CodeEmitterGM107::prepareEmission(Program *prog)
 {
@@ -4572,6 +4611,9 @@ CodeEmitterGM107::prepareEmission(Program *prog)
       func->binPos = prog->binSize;
       prepareEmission(func);
 
+      if (prog->driver->bin.perf)
+         collectPerfInfoGM107(targ, func, prog->driver->bin.perf);
+
       // adjust sizes & positions for schedulding info:
       if (prog->getTarget()->hasSWSched) {
          uint32_t adjPos = func->binPos;
@@ -1093,6 +1093,7 @@ private:
    int inferSysValDirection(unsigned sn) const;
    bool scanDeclaration(const struct tgsi_full_declaration *);
    bool scanInstruction(const struct tgsi_full_instruction *);
+   void scanToken(const union tgsi_full_token *);
    void scanInstructionSrc(const Instruction& insn,
                            const Instruction::SrcRegister& src,
                            unsigned mask);
@@ -1102,7 +1103,7 @@ private:
    inline bool isEdgeFlagPassthrough(const Instruction&) const;
 };
 
-Source::Source(struct nv50_ir_prog_info *prog) : info(prog)
+Source::Source(struct nv50_ir_prog_info *prog) : insns(NULL), info(prog)
 {
    tokens = (const struct tgsi_token *)info->bin.source;
 
@@ -1123,15 +1124,52 @@ Source::~Source()
 
 bool Source::scanSource()
 {
-   unsigned insnCount = 0;
+   unsigned insnCount = 0, insnSpace = 64, scanDepth = 0;
    struct tgsi_parse_context parse;
 
-   tgsi_scan_shader(tokens, &scan);
+   // Tokens other than instructions, with the number of instructions that
+   // precede them. They can only be handled once the whole shader has been
+   // scanned, but this way the tokens are only decoded once.
+   struct PendingToken {
+      unsigned insnPos;
+      union tgsi_full_token token;
+   };
+   std::vector<PendingToken> pending;
+
+   if (tgsi_parse_init(&parse, tokens) != TGSI_PARSE_OK)
+      return false;
+   tgsi_scan_shader_begin(&scan, parse.FullHeader.Processor.Processor);
+   scan.num_tokens = tgsi_num_tokens(tokens);
 
-   insns = (struct tgsi_full_instruction *)MALLOC(scan.num_instructions *
-                                                  sizeof(insns[0]));
-   if (!insns)
+   insns = (struct tgsi_full_instruction *)MALLOC(insnSpace * sizeof(insns[0]));
+   if (!insns) {
+      tgsi_parse_free(&parse);
       return false;
+   }
+
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token(&parse);
+      tgsi_scan_token(&scan, &parse.FullToken, &scanDepth);
+
+      if (parse.FullToken.Token.Type != TGSI_TOKEN_TYPE_INSTRUCTION) {
+         PendingToken p = { insnCount, parse.FullToken };
+         pending.push_back(p);
+         continue;
+      }
+
+      if (insnCount == insnSpace) {
+         insns = (struct tgsi_full_instruction *)REALLOC(insns,
+            insnSpace * sizeof(insns[0]), 2 * insnSpace * sizeof(insns[0]));
+         if (!insns) {
+            tgsi_parse_free(&parse);
+            return false;
+         }
+         insnSpace *= 2;
+      }
+      insns[insnCount++] = parse.FullToken.FullInstruction;
+   }
+   tgsi_parse_free(&parse);
+   tgsi_scan_shader_end(&scan);
 
    clipVertexOutput = -1;
 
@@ -1160,30 +1198,13 @@ bool Source::scanSource()
    info->immd.data = (uint32_t *)MALLOC(scan.immediate_count * 16);
    info->immd.type = (ubyte *)MALLOC(scan.immediate_count * sizeof(ubyte));
 
-   tgsi_parse_init(&parse, tokens);
-   while (!tgsi_parse_end_of_tokens(&parse)) {
-      tgsi_parse_token(&parse);
-
-      switch (parse.FullToken.Token.Type) {
-      case TGSI_TOKEN_TYPE_IMMEDIATE:
-         scanImmediate(&parse.FullToken.FullImmediate);
-         break;
-      case TGSI_TOKEN_TYPE_DECLARATION:
-         scanDeclaration(&parse.FullToken.FullDeclaration);
-         break;
-      case TGSI_TOKEN_TYPE_INSTRUCTION:
-         insns[insnCount++] = parse.FullToken.FullInstruction;
-         scanInstruction(&parse.FullToken.FullInstruction);
-         break;
-      case TGSI_TOKEN_TYPE_PROPERTY:
-         scanProperty(&parse.FullToken.FullProperty);
-         break;
-      default:
-         INFO("unknown TGSI token type: %d\n", parse.FullToken.Token.Type);
-         break;
-      }
+   std::vector<PendingToken>::const_iterator next = pending.begin();
+   for (unsigned ip = 0; ip <= insnCount; ++ip) {
+      for (; next != pending.end() && next->insnPos == ip; ++next)
+         scanToken(&next->token);
+      if (ip < insnCount)
+         scanInstruction(&insns[ip]);
    }
-   tgsi_parse_free(&parse);
 
    if (indirectTempArrays.size()) {
       int tempBase = 0;
@@ -1340,6 +1361,24 @@ int Source::inferSysValDirection(unsigned sn) const
    }
 }
 
+void Source::scanToken(const union tgsi_full_token *token)
+{
+   switch (token->Token.Type) {
+   case TGSI_TOKEN_TYPE_IMMEDIATE:
+      scanImmediate(&token->FullImmediate);
+      break;
+   case TGSI_TOKEN_TYPE_DECLARATION:
+      scanDeclaration(&token->FullDeclaration);
+      break;
+   case TGSI_TOKEN_TYPE_PROPERTY:
+      scanProperty(&token->FullProperty);
+      break;
+   default:
+      INFO("unknown TGSI token type: %d\n", token->Token.Type);
+      break;
+   }
+}
+
 bool Source::scanDeclaration(const struct tgsi_full_declaration *decl)
 {
    unsigned i, c;
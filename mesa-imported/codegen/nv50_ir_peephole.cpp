@@ -23,6 +23,9 @@
 #include "codegen/nv50_ir.h"
 #include "codegen/nv50_ir_target.h"
 #include "codegen/nv50_ir_build_util.h"
+#include "codegen/nv50_ir_sched_gm107.h"
+
+#include <algorithm>
 
 extern "C" {
 #include "util/u_math.h"
@@ -2638,6 +2641,18 @@ updateLdStOffset(Instruction *ldst, int32_t offset, Function *fn)
 }
 
 // Combine loads and stores, forward stores to loads where possible.
+//
+// Blocks are handled together with the blocks control flow always reaches
+// next (the end of an if/else, for instance), so accesses on both sides of
+// a branch can be combined. The blocks in between are only scanned for the
+// accesses that prevent it.
+//
+// Combining loads defines their results earlier, and combining stores keeps
+// the stored values live longer. In functions already short of registers,
+// where that means spilling, blocks are only optimized on their own and
+// accesses are only combined when that doesn't take the alignment proof.
+#define MEMORY_OPT_REGION_BLOCKS 16
+
 class MemoryOpt : public Pass
 {
 private:
@@ -2670,8 +2685,28 @@ public:
    MemoryPool recordPool;
 
 private:
+   // base + index sums that global accesses of the region were rebased to
+   struct Address
+   {
+      Instruction *add;
+      int s; // source of the index
+      Value *index;
+      int shift; // of the index, -1 if unshifted
+   };
+
+   virtual bool visit(Function *);
    virtual bool visit(BasicBlock *);
-   bool runOpt(BasicBlock *);
+   bool runOpt(BasicBlock *, bool scanOnly);
+
+   int getMaxGPRPressure(Function *) const;
+
+   BasicBlock *findJoin(BasicBlock *, std::vector<BasicBlock *>& inner) const;
+   bool isJoin(BasicBlock *, BasicBlock *join,
+               std::vector<BasicBlock *>& inner) const;
+
+   unsigned int getAlignment(const Value *, int depth) const;
+   bool isAligned(const Record *, DataFile, int size) const;
+   void splitAddressOffset(Instruction *ldst);
 
    Record **getList(const Instruction *);
 
@@ -2692,9 +2727,18 @@ private:
 
 private:
    Record *prevRecord;
+
+   BuildUtil bld;
+
+   bool registerBound;
+   BitSet visited;
+   std::vector<BasicBlock *> region;
+   std::vector<bool> regionInner;
+   std::vector<Address> addresses;
 };
 
-MemoryOpt::MemoryOpt() : recordPool(sizeof(MemoryOpt::Record), 6)
+MemoryOpt::MemoryOpt() : recordPool(sizeof(MemoryOpt::Record), 6),
+   registerBound(false)
 {
    for (int i = 0; i < DATA_FILE_COUNT; ++i) {
       loads[i] = NULL;
@@ -2719,6 +2763,188 @@ MemoryOpt::reset()
       }
       stores[i] = NULL;
    }
+   addresses.clear();
+}
+
+// Largest power of two (up to 256) known to divide @val.
+unsigned int
+MemoryOpt::getAlignment(const Value *val, int depth) const
+{
+   const unsigned int maxAlign = 256;
+   const Instruction *insn;
+   ImmediateValue imm;
+   unsigned int a, b;
+
+   if (val->reg.file == FILE_IMMEDIATE) {
+      uint32_t u = val->reg.data.u32;
+      return u ? MIN2(u & -u, maxAlign) : maxAlign;
+   }
+   if (val->reg.file == FILE_MEMORY_CONST) {
+      // buffer addresses from the driver's buffer info
+      const int32_t offset = val->reg.data.offset;
+      const uint16_t base = prog->driver->io.bufInfoBase;
+      if (val->reg.fileIndex == prog->driver->io.auxCBSlot &&
+          val->reg.size == 8 && offset >= base && !((offset - base) & 0xf))
+         return MAX2(prog->driver->io.bufAlignment, 1);
+      return 1;
+   }
+   insn = val->getUniqueInsn();
+   if (!insn || insn->getPredicate() || depth > 6)
+      return 1;
+   if (insn->op != OP_LOAD && insn->op != OP_MERGE &&
+       (isFloatType(insn->dType) || typeSizeof(insn->dType) > 8))
+      return 1;
+
+   switch (insn->op) {
+   case OP_MOV:
+      return getAlignment(insn->getSrc(0), depth + 1);
+   case OP_ADD:
+   case OP_SUB:
+   case OP_OR:
+   case OP_XOR:
+      a = getAlignment(insn->getSrc(0), depth + 1);
+      b = getAlignment(insn->getSrc(1), depth + 1);
+      return MIN2(a, b);
+   case OP_AND:
+      a = getAlignment(insn->getSrc(0), depth + 1);
+      b = getAlignment(insn->getSrc(1), depth + 1);
+      return MAX2(a, b);
+   case OP_SHL:
+      if (!insn->src(1).getImmediate(imm))
+         return 1;
+      a = getAlignment(insn->getSrc(0), depth + 1);
+      return MIN2(a << MIN2(imm.reg.data.u32, 8), maxAlign);
+   case OP_MUL:
+   case OP_MAD:
+      if (insn->subOp)
+         return 1;
+      a = getAlignment(insn->getSrc(0), depth + 1);
+      a = MIN2(a * getAlignment(insn->getSrc(1), depth + 1), maxAlign);
+      if (insn->op == OP_MAD)
+         a = MIN2(a, getAlignment(insn->getSrc(2), depth + 1));
+      return a;
+   case OP_SHLADD:
+      if (!insn->src(1).getImmediate(imm))
+         return 1;
+      a = getAlignment(insn->getSrc(0), depth + 1);
+      a = MIN2(a << MIN2(imm.reg.data.u32, 8), maxAlign);
+      return MIN2(a, getAlignment(insn->getSrc(2), depth + 1));
+   case OP_MERGE:
+      // the low half decides
+      if (insn->getSrc(0)->reg.size != 4)
+         return 1;
+      return getAlignment(insn->getSrc(0), depth + 1);
+   case OP_LOAD:
+      if (insn->src(0).getFile() != FILE_MEMORY_CONST)
+         return 1;
+      return getAlignment(insn->getSrc(0), depth + 1);
+   default:
+      return 1;
+   }
+}
+
+// Whether the address of a combined access of @size bytes at @rec is aligned
+// enough. Indirect accesses are only known to be when they come from a single
+// vector access of the shader: this doesn't hold in compute shaders, nor for
+// global accesses once splitAddressOffset() has rebased them, so the address
+// has to be shown to be aligned there.
+bool
+MemoryOpt::isAligned(const Record *rec, DataFile file, int size) const
+{
+   if (!rec->rel[0])
+      return true;
+   if (prog->getType() != Program::TYPE_COMPUTE && file != FILE_MEMORY_GLOBAL)
+      return true;
+   if (registerBound)
+      return false;
+   return getAlignment(rec->rel[0], 0) >= util_next_power_of_two(size);
+}
+
+// Global addresses are 64 bit sums of a buffer address and an offset, so the
+// constant parts of offsets aren't folded into the access like they are for
+// other files. Do it here, so that accesses to the same structure or vector
+// share their address.
+void
+MemoryOpt::splitAddressOffset(Instruction *ldst)
+{
+   Instruction *add, *off;
+   ImmediateValue imm, sh;
+   Value *index;
+   int32_t offset;
+   unsigned int i;
+   int s, shift = -1;
+
+   if (ldst->src(0).getFile() != FILE_MEMORY_GLOBAL ||
+       !ldst->src(0).isIndirect(0) || ldst->src(0).isIndirect(1))
+      return;
+   add = ldst->getIndirect(0, 0)->getInsn();
+   if (!add || add->op != OP_ADD || add->dType != TYPE_U64 ||
+       add->getPredicate() || add->src(0).mod || add->src(1).mod)
+      return;
+   for (s = 0; s < 2; ++s)
+      if (add->src(s).getFile() == FILE_GPR && add->getSrc(s)->reg.size == 4)
+         break;
+   if (s == 2)
+      return;
+
+   // index + imm, (index << shift) + imm, or without the immediate
+   index = add->getSrc(s);
+   imm.reg.data.s32 = 0;
+   off = index->getInsn();
+   if (off && off->dType == TYPE_U32 && !off->getPredicate() &&
+       off->src(0).getFile() == FILE_GPR &&
+       !off->src(0).mod && !off->src(1).mod) {
+      if (off->op == OP_ADD && off->src(1).getImmediate(imm)) {
+         index = off->getSrc(0);
+      } else
+      if ((off->op == OP_SHL || off->op == OP_SHLADD) &&
+          off->src(1).getImmediate(sh) && sh.reg.data.u32 < 32) {
+         if (off->op == OP_SHLADD &&
+             (off->src(2).mod || !off->src(2).getImmediate(imm)))
+            imm.reg.data.s32 = 0;
+         else {
+            index = off->getSrc(0);
+            shift = sh.reg.data.u32;
+         }
+      }
+   }
+   offset = ldst->getSrc(0)->reg.data.offset + imm.reg.data.s32;
+   if (imm.reg.data.s32 < 0 || offset >= (1 << 23))
+      return;
+
+   const ValueRef &base = add->src(s ^ 1);
+   for (i = 0; i < addresses.size(); ++i) {
+      const ValueRef &other = addresses[i].add->src(addresses[i].s ^ 1);
+      if (addresses[i].index != index || addresses[i].shift != shift ||
+          base.getIndirect(0) != other.getIndirect(0))
+         continue;
+      if (base.get() == other.get() ||
+          (base.get()->asSym() && base.get()->equals(other.get(), false)))
+         break;
+   }
+   if (i == addresses.size()) {
+      Address addr;
+      if (imm.reg.data.s32 == 0) {
+         // already the sum we want
+         addr.add = add;
+      } else {
+         bld.setPosition(ldst, false);
+         addr.add = cloneShallow(func, add);
+         addr.add->setDef(0, bld.getSSA(8));
+         if (shift < 0)
+            addr.add->setSrc(s, index);
+         else
+            addr.add->setSrc(s, bld.mkOp2v(OP_SHL, TYPE_U32, bld.getSSA(),
+                                           index, bld.mkImm(shift)));
+         bld.insert(addr.add);
+      }
+      addr.s = s;
+      addr.index = index;
+      addr.shift = shift;
+      addresses.push_back(addr);
+   }
+   ldst->setIndirect(0, 0, addresses[i].add->getDef(0));
+   updateLdStOffset(ldst, offset, func);
 }
 
 bool
@@ -2738,8 +2964,7 @@ MemoryOpt::combineLd(Record *rec, Instruction *ld)
    if (((size == 0x8) && (MIN2(offLd, offRc) & 0x7)) ||
        ((size == 0xc) && (MIN2(offLd, offRc) & 0xf)))
       return false;
-   // for compute indirect loads are not guaranteed to be aligned
-   if (prog->getType() == Program::TYPE_COMPUTE && rec->rel[0])
+   if (!isAligned(rec, ld->src(0).getFile(), size))
       return false;
 
    assert(sizeRc + sizeLd <= 16 && offRc != offLd);
@@ -2800,8 +3025,7 @@ MemoryOpt::combineSt(Record *rec, Instruction *st)
    // no unaligned stores
    if (size == 8 && MIN2(offRc, offSt) & 0x7)
       return false;
-   // for compute indirect stores are not guaranteed to be aligned
-   if (prog->getType() == Program::TYPE_COMPUTE && rec->rel[0])
+   if (!isAligned(rec, st->src(0).getFile(), size))
       return false;
 
    // There's really no great place to put this in a generic manner. Seemingly
@@ -3100,19 +3324,185 @@ MemoryOpt::purgeRecords(Instruction *const st, DataFile f)
          r->unlink(&stores[f]);
 }
 
+// Add @v to or remove it from @live, counting the 32-bit GPRs it takes up
+// in @pressure.
+static void
+setLiveGPR(BitSet &live, int &pressure, Value *v, bool set)
+{
+   if (!v->asLValue() || v->reg.file != FILE_GPR || live.test(v->id) == set)
+      return;
+   const int units = (v->reg.size + 3) / 4;
+   if (set) {
+      live.set(v->id);
+      pressure += units;
+   } else {
+      live.clr(v->id);
+      pressure -= units;
+   }
+}
+
+// Highest number of 32-bit GPRs live at once in @fn.
+int
+MemoryOpt::getMaxGPRPressure(Function *fn) const
+{
+   BitSet live(fn->allLValues.getSize(), true);
+   std::vector<Value *> liveOut;
+   int peak = 0;
+
+   fn->buildLiveSetsSSA();
+   for (IteratorRef it = fn->cfg.iteratorDFS(false); !it->end(); it->next()) {
+      BasicBlock *bb = BasicBlock::get(reinterpret_cast<Graph::Node *>(it->get()));
+      int pressure = 0;
+
+      liveOut.clear();
+      for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
+         const std::vector<int> &in = BasicBlock::get(ei.getNode())->liveIn;
+         for (size_t k = 0; k < in.size(); ++k)
+            liveOut.push_back(fn->getLValue(in[k]));
+      }
+      if (bb == BasicBlock::get(fn->cfgExit))
+         for (RefArray::iterator it = fn->outs.begin(); it != fn->outs.end(); ++it)
+            liveOut.push_back(it->get());
+      for (size_t k = 0; k < liveOut.size(); ++k)
+         setLiveGPR(live, pressure, liveOut[k], true);
+
+      for (Instruction *i = bb->getExit(); i && i->op != OP_PHI; i = i->prev) {
+         // results take up registers even if they're never read
+         for (int d = 0; i->defExists(d); ++d)
+            setLiveGPR(live, pressure, i->getDef(d), true);
+         peak = MAX2(peak, pressure);
+         for (int d = 0; i->defExists(d); ++d)
+            setLiveGPR(live, pressure, i->getDef(d), false);
+         for (int s = 0; i->srcExists(s); ++s)
+            setLiveGPR(live, pressure, i->getSrc(s), true);
+         peak = MAX2(peak, pressure);
+      }
+
+      // what's left is the live-in set, clear it for the next block
+      for (Instruction *i = bb->getPhi(); i && i->op == OP_PHI; i = i->next)
+         setLiveGPR(live, pressure, i->getDef(0), false);
+      for (size_t k = 0; k < bb->liveIn.size(); ++k)
+         setLiveGPR(live, pressure, fn->getLValue(bb->liveIn[k]), false);
+      if (pressure)
+         live.fill(0);
+   }
+   return peak;
+}
+
+bool
+MemoryOpt::visit(Function *fn)
+{
+   visited.allocate(fn->allBBlocks.getSize(), true);
+   registerBound = getMaxGPRPressure(fn) >
+      (int)prog->getTarget()->getFileSize(FILE_GPR) * 3 / 4;
+   return true;
+}
+
 bool
 MemoryOpt::visit(BasicBlock *bb)
 {
-   bool ret = runOpt(bb);
+   std::vector<BasicBlock *> inner;
+   unsigned int i;
+
+   if (visited.test(bb->getId()))
+      return true;
+
+   region.clear();
+   regionInner.clear();
+   for (; bb; bb = registerBound ? NULL : findJoin(bb, inner)) {
+      for (i = 0; i < inner.size(); ++i) {
+         region.push_back(inner[i]);
+         regionInner.push_back(true);
+      }
+      region.push_back(bb);
+      regionInner.push_back(false);
+      visited.set(bb->getId());
+   }
+
    // Run again, one pass won't combine 4 32 bit ld/st to a single 128 bit ld/st
    // where 96 bit memory operations are forbidden.
-   if (ret)
-      ret = runOpt(bb);
-   return ret;
+   for (int pass = 0; pass < 2; ++pass) {
+      for (i = 0; i < region.size(); ++i)
+         runOpt(region[i], regionInner[i]);
+      reset();
+   }
+   return true;
+}
+
+// Find the block control flow from @bb always goes through next, if @bb is
+// the only way to it. The blocks in between are returned in @inner.
+BasicBlock *
+MemoryOpt::findJoin(BasicBlock *bb, std::vector<BasicBlock *>& inner) const
+{
+   std::vector<BasicBlock *> order;
+
+   // try the closest blocks first
+   for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next())
+      order.push_back(BasicBlock::get(ei.getNode()));
+   for (unsigned int n = 0;
+        n < order.size() && n <= MEMORY_OPT_REGION_BLOCKS; ++n) {
+      BasicBlock *join = order[n];
+
+      if (join != bb && !visited.test(join->getId()) &&
+          isJoin(bb, join, inner))
+         return join;
+
+      for (Graph::EdgeIterator ei = join->cfg.outgoing(); !ei.end(); ei.next()) {
+         BasicBlock *out = BasicBlock::get(ei.getNode());
+         if (out != bb &&
+             std::find(order.begin(), order.end(), out) == order.end())
+            order.push_back(out);
+      }
+   }
+   return NULL;
+}
+
+bool
+MemoryOpt::isJoin(BasicBlock *bb, BasicBlock *join,
+                  std::vector<BasicBlock *>& inner) const
+{
+   std::vector<BasicBlock *> work;
+
+   inner.clear();
+   for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next())
+      work.push_back(BasicBlock::get(ei.getNode()));
+
+   while (!work.empty()) {
+      BasicBlock *it = work.back();
+      work.pop_back();
+
+      if (it == join ||
+          std::find(inner.begin(), inner.end(), it) != inner.end())
+         continue;
+      // loops back or leaves without going through @join
+      if (it == bb || !it->cfg.outgoingCount() ||
+          inner.size() == MEMORY_OPT_REGION_BLOCKS)
+         return false;
+      inner.push_back(it);
+      for (Graph::EdgeIterator ei = it->cfg.outgoing(); !ei.end(); ei.next())
+         work.push_back(BasicBlock::get(ei.getNode()));
+   }
+
+   // @bb must dominate @join, so neither @join nor the blocks in between may
+   // be entered from anywhere else. Checking @join alone is not enough: in
+   // if (c) { T } X: if (d) { Z } J, X is also reached when !c, and J may
+   // not use values from T.
+   for (unsigned int i = 0; i <= inner.size(); ++i) {
+      BasicBlock *it = i < inner.size() ? inner[i] : join;
+      for (Graph::EdgeIterator ei = it->cfg.incident(); !ei.end(); ei.next()) {
+         BasicBlock *in = BasicBlock::get(ei.getNode());
+         if (in != bb &&
+             std::find(inner.begin(), inner.end(), in) == inner.end())
+            return false;
+      }
+   }
+   return true;
 }
 
+// With @scanOnly, only account for the accesses of @bb, which lies between
+// blocks being optimized together.
 bool
-MemoryOpt::runOpt(BasicBlock *bb)
+MemoryOpt::runOpt(BasicBlock *bb, bool scanOnly)
 {
    Instruction *ldst, *next;
    Record *rec;
@@ -3124,14 +3514,14 @@ MemoryOpt::runOpt(BasicBlock *bb)
       next = ldst->next;
 
       if (ldst->op == OP_LOAD || ldst->op == OP_VFETCH) {
-         if (ldst->isDead()) {
+         if (ldst->isDead() && !scanOnly) {
             // might have been produced by earlier optimization
             delete_Instruction(prog, ldst);
             continue;
          }
       } else
       if (ldst->op == OP_STORE || ldst->op == OP_EXPORT) {
-         if (typeSizeof(ldst->dType) == 4 &&
+         if (typeSizeof(ldst->dType) == 4 && !scanOnly &&
              ldst->src(1).getFile() == FILE_GPR &&
              ldst->getSrc(1)->getInsn()->op == OP_NOP) {
             delete_Instruction(prog, ldst);
@@ -3142,7 +3532,10 @@ MemoryOpt::runOpt(BasicBlock *bb)
          // TODO: maybe have all fixed ops act as barrier ?
          if (ldst->op == OP_CALL ||
              ldst->op == OP_BAR ||
-             ldst->op == OP_MEMBAR) {
+             ldst->op == OP_MEMBAR ||
+             (scanOnly && (ldst->op == OP_DISCARD ||
+                           ldst->op == OP_EXIT ||
+                           ldst->op == OP_RET))) {
             purgeRecords(NULL, FILE_MEMORY_LOCAL);
             purgeRecords(NULL, FILE_MEMORY_GLOBAL);
             purgeRecords(NULL, FILE_MEMORY_SHARED);
@@ -3162,11 +3555,19 @@ MemoryOpt::runOpt(BasicBlock *bb)
          }
          continue;
       }
-      if (ldst->getPredicate()) // TODO: handle predicated ld/st
+      // TODO: handle predicated ld/st
+      if (scanOnly || ldst->getPredicate()) {
+         if (isLoad)
+            lockStores(ldst);
+         else
+            purgeRecords(ldst, DATA_FILE_COUNT);
          continue;
+      }
       if (ldst->perPatch) // TODO: create separate per-patch lists
          continue;
 
+      splitAddressOffset(ldst);
+
       if (isLoad) {
          DataFile file = ldst->src(0).getFile();
 
@@ -3203,7 +3604,6 @@ MemoryOpt::runOpt(BasicBlock *bb)
       if (keep)
          addRecord(ldst);
    }
-   reset();
 
    return true;
 }
@@ -3996,53 +4396,306 @@ DeadCodeElim::checkSplitLoad(Instruction *ld1)
 
 // =============================================================================
 
-// Tries to improve dual issueing trivially
+// Pairs up instructions for dual issue.
 //
-// the PASS checks for every instruction A,B with A->next == B and
-// !canDualIssue(A,B), if there is a Instruction C in the same BB which can be
-// moved between A and B and canDualIssue(A,C) is true
+// Each basic block is walked in order, keeping track of when the results of
+// the instructions become available (according to getLatency(), like the code
+// emitter does). An instruction which can't be issued together with its
+// successor looks for a partner in the next few instructions, that can either
+// be issued right after it, or right before it if it can only come second.
+// The partner is moved next to the instruction if everything in between
+// allows it, and only if its sources are ready by then: the code emitter
+// doesn't dual issue instructions which have to wait.
+#define DUAL_ISSUE_WINDOW 256
+
 class PostRADualIssue : public Pass
 {
 private:
+   virtual bool visit(Function *);
    virtual bool visit(BasicBlock *);
+
+   int getReadyCycle(const Instruction *) const;
+   void commit(const Instruction *, int cycle);
+   bool canPair(const Instruction *, const Instruction *, int cycle) const;
+   Instruction *findPartner(Instruction *, int cycle, bool &before) const;
+
+   const Target *targ;
+
+   int gprReady[256];
+   int predReady[8];
+   int flagsReady;
 };
 
+// Instructions that must stay where they are relative to all others.
 static bool
-isChainedCommutationLegal(Instruction *a, Instruction *b)
+isOrderFixed(const Instruction *insn)
 {
-   Instruction *it = b->prev;
-   do {
-      if (!it->isCommutationLegal(b))
-         return false;
-      it = it->prev;
-   } while (it != a);
+   if (insn->fixed || insn->join || insn->asFlow())
+      return true;
+
+   switch (insn->op) {
+   case OP_BAR:
+   case OP_CCTL:
+   case OP_DISCARD:
+   case OP_EMIT:
+   case OP_EXIT:
+   case OP_MEMBAR:
+   case OP_QUADON:
+   case OP_QUADPOP:
+   case OP_RESTART:
+   case OP_TEXBAR:
+   case OP_WRSV:
+      return true;
+   default:
+      return false;
+   }
+}
+
+// 0 if the instruction doesn't access memory, 1 if it reads it, 2 if it
+// writes to it. Texture fetches only read memory which can't be written
+// without a barrier.
+static int
+getMemoryAccess(const Instruction *insn)
+{
+   switch (insn->op) {
+   case OP_LOAD:
+   case OP_VFETCH:
+   case OP_SULDB:
+   case OP_SULDP:
+      return 1;
+   case OP_ATOM:
+   case OP_EXPORT:
+   case OP_STORE:
+   case OP_SUREDB:
+   case OP_SUREDP:
+   case OP_SUSTB:
+   case OP_SUSTP:
+      return 2;
+   default:
+      return 0;
+   }
+}
+
+// Whether two memory accesses may touch the same location. Only accesses to
+// the same space at fixed offsets from the same address register can be
+// told apart, like spill slots.
+static bool
+mayAlias(const Instruction *a, const Instruction *b)
+{
+   switch (a->op) {
+   case OP_ATOM:
+   case OP_EXPORT:
+   case OP_LOAD:
+   case OP_STORE:
+   case OP_VFETCH:
+      break;
+   default:
+      return true;
+   }
+   switch (b->op) {
+   case OP_ATOM:
+   case OP_EXPORT:
+   case OP_LOAD:
+   case OP_STORE:
+   case OP_VFETCH:
+      break;
+   default:
+      return true;
+   }
+
+   const Value *memA = a->getSrc(0), *memB = b->getSrc(0);
+   const DataFile fileA = memA->reg.file, fileB = memB->reg.file;
+
+   if (fileA != fileB) {
+      // buffers are global memory
+      return (fileA == FILE_MEMORY_GLOBAL || fileA == FILE_MEMORY_BUFFER) &&
+             (fileB == FILE_MEMORY_GLOBAL || fileB == FILE_MEMORY_BUFFER);
+   }
+   if (memA->reg.fileIndex != memB->reg.fileIndex)
+      return fileA == FILE_MEMORY_GLOBAL || fileA == FILE_MEMORY_BUFFER;
+
+   const Value *indA = a->getIndirect(0, 0), *indB = b->getIndirect(0, 0);
+   if (indA || indB) {
+      if (!indA || !indB || indA->reg.file != indB->reg.file ||
+          indA->reg.data.id != indB->reg.data.id)
+         return true;
+   }
+   return memA->reg.data.offset < memB->reg.data.offset + memB->reg.size &&
+          memB->reg.data.offset < memA->reg.data.offset + memA->reg.size;
+}
+
+static bool
+canSwap(const Instruction *a, const Instruction *b)
+{
+   if (!a->isCommutationLegal(b))
+      return false;
+   if (!getMemoryAccess(a) || !getMemoryAccess(b) ||
+       (getMemoryAccess(a) == 1 && getMemoryAccess(b) == 1))
+      return true;
+   return !mayAlias(a, b);
+}
+
+bool
+PostRADualIssue::visit(Function *fn)
+{
+   targ = fn->getProgram()->getTarget();
    return true;
 }
 
+// Return the cycle at which all sources of an instruction are available.
+int
+PostRADualIssue::getReadyCycle(const Instruction *insn) const
+{
+   int ready = 0;
+
+   for (int s = 0; insn->srcExists(s); ++s) {
+      const Value *v = insn->getSrc(s);
+      const int id = v->reg.data.id;
+
+      if (id < 0)
+         continue;
+      switch (v->reg.file) {
+      case FILE_GPR:
+         for (int r = id; r < id + v->reg.size / 4 && r < 256; ++r)
+            ready = MAX2(ready, gprReady[r]);
+         break;
+      case FILE_PREDICATE:
+         if (id < 8)
+            ready = MAX2(ready, predReady[id]);
+         break;
+      case FILE_FLAGS:
+         ready = MAX2(ready, flagsReady);
+         break;
+      default:
+         break;
+      }
+   }
+   return ready;
+}
+
+void
+PostRADualIssue::commit(const Instruction *insn, int cycle)
+{
+   const int ready = cycle + targ->getLatency(insn);
+
+   for (int d = 0; insn->defExists(d); ++d) {
+      const Value *v = insn->getDef(d);
+      const int id = v->reg.data.id;
+
+      if (id < 0)
+         continue;
+      switch (v->reg.file) {
+      case FILE_GPR:
+         for (int r = id; r < id + v->reg.size / 4 && r < 256; ++r)
+            gprReady[r] = ready;
+         break;
+      case FILE_PREDICATE:
+         if (id < 8)
+            predReady[id] = ready;
+         break;
+      case FILE_FLAGS:
+         flagsReady = ready;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+// Whether @a issued at @cycle can be dual issued with @b right after it.
 bool
-PostRADualIssue::visit(BasicBlock *bb)
+PostRADualIssue::canPair(const Instruction *a, const Instruction *b,
+                         int cycle) const
 {
-   const Target *target = prog->getTarget();
-   Instruction *i, *next, *check;
+   return targ->canDualIssue(a, b) && getReadyCycle(b) <= cycle + 1;
+}
 
-   for (i = bb->getEntry(); i; i = next) {
-      next = i->next;
+// Look for an instruction which can be moved right after @insn and issued
+// together with it, or failing that, right before it.
+Instruction *
+PostRADualIssue::findPartner(Instruction *insn, int cycle, bool &before) const
+{
+   Instruction *check = insn->next;
+
+   for (int n = 0; check && n < DUAL_ISSUE_WINDOW; check = check->next, ++n) {
+      if (isOrderFixed(check))
+         break;
 
-      if (!next || next->fixed || next->join || next->asFlow() || target->canDualIssue(i, next))
+      // Check whether the two could be issued together first, most
+      // instructions can't and walking back to @insn for each of them would
+      // make this quadratic in the window size.
+      const bool first = getReadyCycle(check) <= cycle &&
+                         targ->canDualIssue(check, insn) &&
+                         getReadyCycle(insn) <= cycle + 1;
+      const bool second = canPair(insn, check, cycle);
+      if (!first && !second)
          continue;
 
-      for (check = next->next; check; check = check->next) {
-         // we can't move fixed, flow instructions and instruction marked as join
-         if (!check || check->fixed || check->join || check->asFlow())
+      // everything between insn and check has to be allowed to go after it
+      const Instruction *it;
+      for (it = check->prev; it != insn; it = it->prev)
+         if (!canSwap(it, check))
             break;
+      if (it != insn)
+         continue;
+      if (first && canSwap(insn, check)) {
+         before = true;
+         return check;
+      }
+      if (second) {
+         before = false;
+         return check;
+      }
+   }
+   return NULL;
+}
 
-         if (isChainedCommutationLegal(i, check) && target->canDualIssue(i, check)) {
-            while (check->prev != i)
-               bb->permuteAdjacent(check->prev, check);
-            next = check;
-            break;
+bool
+PostRADualIssue::visit(BasicBlock *bb)
+{
+   Instruction *i, *next;
+   int cycle = 0;
+
+   for (int r = 0; r < 256; ++r)
+      gprReady[r] = 0;
+   for (int p = 0; p < 8; ++p)
+      predReady[p] = 0;
+   flagsReady = 0;
+
+   for (i = bb->getEntry(); i; i = next) {
+      Instruction *first = i, *second = i->next;
+
+      cycle = MAX2(cycle, getReadyCycle(i));
+
+      if (!second || !canPair(i, second, cycle)) {
+         bool before = false;
+         Instruction *partner = NULL;
+
+         if (!isOrderFixed(i))
+            partner = findPartner(i, cycle, before);
+
+         second = NULL;
+         if (partner) {
+            bb->remove(partner);
+            if (before) {
+               bb->insertBefore(i, partner);
+               first = partner;
+               second = i;
+            } else {
+               bb->insertAfter(i, partner);
+               second = partner;
+            }
          }
       }
+
+      commit(first, cycle);
+      if (second) {
+         commit(second, cycle);
+         next = second->next;
+      } else {
+         next = first->next;
+      }
+      cycle += 1;
    }
    return true;
 }
@@ -4053,6 +4706,7 @@ PostRADualIssue::visit(BasicBlock *bb)
    if (level >= (l)) {                          \
       if (dbgFlags & NV50_IR_DEBUG_VERBOSE)     \
          INFO("PEEPHOLE: %s\n", #n);            \
+      util_time_report_scope scope(#n);         \
       n pass;                                   \
       if (!pass.f(this))                        \
          return false;                          \
@@ -4076,6 +4730,7 @@ Program::optimizeSSA(int level)
    RUN_PASS(2, MemoryOpt, run);
    RUN_PASS(2, LocalCSE, run);
    RUN_PASS(0, DeadCodeElim, buryAll);
+   RUN_PASS(2, GM107SchedulePreRA, schedule);
 
    return true;
 }
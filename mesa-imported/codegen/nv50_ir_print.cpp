@@ -761,7 +761,7 @@ PrintPass::visit(Function *fn)
 
    if (!fn->outs.empty())
       INFO("out");
-   for (std::deque<ValueRef>::iterator it = fn->outs.begin();
+   for (RefArray::iterator it = fn->outs.begin();
         it != fn->outs.end();
         ++it) {
       it->get()->print(str, sizeof(str), typeOfSize(it->get()->reg.size));
@@ -770,7 +770,7 @@ PrintPass::visit(Function *fn)
 
    if (!fn->ins.empty())
       INFO("%s%sin", colour[TXT_DEFAULT], fn->outs.empty() ? "" : ", ");
-   for (std::deque<ValueDef>::iterator it = fn->ins.begin();
+   for (DefArray::iterator it = fn->ins.begin();
         it != fn->ins.end();
         ++it) {
       it->get()->print(str, sizeof(str), typeOfSize(it->get()->reg.size));
@@ -224,7 +224,7 @@ RegisterSet::release(DataFile f, int32_t reg, unsigned int size)
 class RegAlloc
 {
 public:
-   RegAlloc(Program *program) : prog(program), sequence(0) { }
+   RegAlloc(Program *program) : prog(program) { }
 
    bool exec();
    bool execFunc();
@@ -244,9 +244,11 @@ private:
 
    class BuildIntervalsPass : public Pass {
    private:
+      virtual bool visit(Function *);
       virtual bool visit(BasicBlock *);
-      void collectLiveValues(BasicBlock *);
       void addLiveRange(Value *, const BasicBlock *, int end);
+
+      SparseSet live;
    };
 
    class InsertConstraintsPass : public Pass {
@@ -281,7 +283,7 @@ private:
       const Target *targ;
    };
 
-   bool buildLiveSets(BasicBlock *);
+   bool buildLiveSets();
 
 private:
    Program *prog;
@@ -289,22 +291,32 @@ private:
 
    // instructions in control flow / chronological order
    ArrayList insns;
-
-   int sequence; // for manual passes through CFG
 };
 
 typedef std::pair<Value *, Value *> ValuePair;
 
+// Values that a few simple instructions derive from immediates, constant
+// buffers and invariant system values are recomputed at their uses when they
+// have to be spilled, which is much cheaper than a round trip through local
+// memory. This is the longest such chain of instructions.
+#define REMAT_MAX_COST 3
+
 class SpillCodeInserter
 {
 public:
-   SpillCodeInserter(Function *fn) : func(fn), stackSize(0), stackBase(0) { }
+   SpillCodeInserter(Function *fn) : func(fn), stackSize(0), stackBase(0),
+      stores(0), loads(0), spilledValues(0), rematValues(0) { }
 
    bool run(const std::list<ValuePair>&);
 
    Symbol *assignSlot(const Interval&, const unsigned int size);
    Value *offsetSlot(Value *, const LValue *);
+   int getRematCost(Value *) const;
    inline int32_t getStackSize() const { return stackSize; }
+   inline uint32_t getStoreCount() const { return stores; }
+   inline uint32_t getLoadCount() const { return loads; }
+   inline uint32_t getSpilledValueCount() const { return spilledValues; }
+   inline uint32_t getRematValueCount() const { return rematValues; }
 
 private:
    Function *func;
@@ -320,9 +332,14 @@ private:
    std::list<SpillSlot> slots;
    int32_t stackSize;
    int32_t stackBase;
+   uint32_t stores;
+   uint32_t loads;
+   uint32_t spilledValues; // values spilled to memory or another file
+   uint32_t rematValues;   // values recomputed at their uses instead
 
    LValue *unspill(Instruction *usei, LValue *, Value *slot);
    void spill(Instruction *defi, Value *slot, LValue *);
+   LValue *rematerialize(Instruction *usei, LValue *);
 };
 
 void
@@ -551,100 +568,150 @@ RegAlloc::ArgumentMovesPass::visit(BasicBlock *bb)
    return true;
 }
 
-// Build the set of live-in variables of bb.
-bool
-RegAlloc::buildLiveSets(BasicBlock *bb)
+// Build the sets of live-in variables of all blocks.
+//
+// Each block is summarized once by the values it reads before writing them
+// (gen) and the values it writes (kill, including phi definitions). The
+// live-in sets are then solved with a worklist, processing blocks in
+// post-order and revisiting only the predecessors of blocks whose live-in
+// set grew, which avoids walking the instructions of every block once per
+// loop nesting level.
+//
+// All sets are sparse: the live-in sets are sorted lists of value ids, and
+// the scratch set only costs time for the values it holds, so nothing here
+// scales with the number of blocks times the number of values.
+void
+Function::buildLiveSetsSSA()
 {
-   Function *f = bb->getFunction();
-   BasicBlock *bn;
-   Instruction *i;
-   unsigned int s, d;
-
-   INFO_DBG(prog->dbgFlags, REG_ALLOC, "buildLiveSets(BB:%i)\n", bb->getId());
+   const unsigned int numValues = allLValues.getSize();
+   std::vector<BasicBlock *> order;
+   std::vector<int> index(allBBlocks.getSize(), -1);
 
-   bb->liveSet.allocate(func->allLValues.getSize(), false);
+   for (ArrayList::Iterator bi = allBBlocks.iterator(); !bi.end(); bi.next())
+      BasicBlock::get(bi)->liveIn.clear();
 
-   int n = 0;
-   for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
-      bn = BasicBlock::get(ei.getNode());
-      if (bn == bb)
-         continue;
-      if (bn->cfg.visit(sequence))
-         if (!buildLiveSets(bn))
-            return false;
-      if (n++ || bb->liveSet.marker)
-         bb->liveSet |= bn->liveSet;
-      else
-         bb->liveSet = bn->liveSet;
+   for (IteratorRef it = cfg.iteratorDFS(false); !it->end(); it->next()) {
+      BasicBlock *bb = BasicBlock::get(reinterpret_cast<Graph::Node *>(it->get()));
+      index[bb->getId()] = order.size();
+      order.push_back(bb);
    }
-   if (!n && !bb->liveSet.marker)
-      bb->liveSet.fill(0);
-   bb->liveSet.marker = true;
 
-   if (prog->dbgFlags & NV50_IR_DEBUG_REG_ALLOC) {
-      INFO("BB:%i live set of out blocks:\n", bb->getId());
-      bb->liveSet.print();
-   }
+   std::vector<std::vector<int> > gen(order.size()), kill(order.size());
+   SparseSet live;
+   live.allocate(numValues);
 
-   // if (!bb->getEntry())
-   //   return true;
+   for (size_t n = 0; n < order.size(); ++n) {
+      BasicBlock *bb = order[n];
+      Instruction *i;
 
-   if (bb == BasicBlock::get(f->cfgExit)) {
-      for (std::deque<ValueRef>::iterator it = f->outs.begin();
-           it != f->outs.end(); ++it) {
-         assert(it->get()->asLValue());
-         bb->liveSet.set(it->get()->id);
+      live.clear();
+      for (i = bb->getExit(); i && i->op != OP_PHI; i = i->prev) {
+         for (int d = 0; i->defExists(d); ++d) {
+            live.clr(i->getDef(d)->id);
+            kill[n].push_back(i->getDef(d)->id);
+         }
+         for (int s = 0; i->srcExists(s); ++s)
+            if (i->getSrc(s)->asLValue())
+               live.set(i->getSrc(s)->id);
       }
+      for (i = bb->getPhi(); i && i->op == OP_PHI; i = i->next) {
+         live.clr(i->getDef(0)->id);
+         kill[n].push_back(i->getDef(0)->id);
+      }
+
+      for (unsigned int k = 0; k < live.getSize(); ++k)
+         gen[n].push_back(live[k]);
+      std::sort(gen[n].begin(), gen[n].end());
+      bb->liveIn = gen[n];
    }
 
-   for (i = bb->getExit(); i && i != bb->getEntry()->prev; i = i->prev) {
-      for (d = 0; i->defExists(d); ++d)
-         bb->liveSet.clr(i->getDef(d)->id);
-      for (s = 0; i->srcExists(s); ++s)
-         if (i->getSrc(s)->asLValue())
-            bb->liveSet.set(i->getSrc(s)->id);
+   std::deque<int> worklist;
+   std::vector<bool> queued(order.size(), true);
+   for (size_t n = 0; n < order.size(); ++n)
+      worklist.push_back(n);
+
+   while (!worklist.empty()) {
+      const int n = worklist.front();
+      BasicBlock *bb = order[n];
+      worklist.pop_front();
+      queued[n] = false;
+
+      live.clear();
+      for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
+         const std::vector<int> &in = BasicBlock::get(ei.getNode())->liveIn;
+         for (size_t k = 0; k < in.size(); ++k)
+            live.set(in[k]);
+      }
+      if (bb == BasicBlock::get(cfgExit)) {
+         for (RefArray::iterator it = outs.begin();
+              it != outs.end(); ++it) {
+            assert(it->get()->asLValue());
+            live.set(it->get()->id);
+         }
+      }
+      for (size_t k = 0; k < kill[n].size(); ++k)
+         live.clr(kill[n][k]);
+      for (size_t k = 0; k < gen[n].size(); ++k)
+         live.set(gen[n][k]);
+
+      // the sets only grow, so the same size means nothing was added
+      if (live.getSize() == bb->liveIn.size())
+         continue;
+      bb->liveIn.resize(live.getSize());
+      for (unsigned int k = 0; k < live.getSize(); ++k)
+         bb->liveIn[k] = live[k];
+      std::sort(bb->liveIn.begin(), bb->liveIn.end());
+
+      for (Graph::EdgeIterator ei = bb->cfg.incident(); !ei.end(); ei.next()) {
+         const int p = index[BasicBlock::get(ei.getNode())->getId()];
+         if (p >= 0 && !queued[p]) {
+            queued[p] = true;
+            worklist.push_back(p);
+         }
+      }
    }
-   for (i = bb->getPhi(); i && i->op == OP_PHI; i = i->next)
-      bb->liveSet.clr(i->getDef(0)->id);
+}
+
+bool
+RegAlloc::buildLiveSets()
+{
+   func->buildLiveSetsSSA();
 
    if (prog->dbgFlags & NV50_IR_DEBUG_REG_ALLOC) {
-      INFO("BB:%i live set after propagation:\n", bb->getId());
-      bb->liveSet.print();
+      for (IteratorRef it = func->cfg.iteratorDFS(false); !it->end(); it->next()) {
+         BasicBlock *bb = BasicBlock::get(reinterpret_cast<Graph::Node *>(it->get()));
+         INFO("BB:%i live set:", bb->getId());
+         for (size_t k = 0; k < bb->liveIn.size(); ++k)
+            INFO(" %%%i", bb->liveIn[k]);
+         INFO("\n");
+      }
    }
 
    return true;
 }
 
-void
-RegAlloc::BuildIntervalsPass::collectLiveValues(BasicBlock *bb)
+// Collect the values live at the end of @bb from the live-in sets of its
+// successors. Phi sources are live-out of the block they come from (the
+// moves added by PhiMovesPass), phi results are not.
+static void
+collectLiveOut(BasicBlock *bb, SparseSet& live)
 {
-   BasicBlock *bbA = NULL, *bbB = NULL;
+   live.clear();
 
-   if (bb->cfg.outgoingCount()) {
-      // trickery to save a loop of OR'ing liveSets
-      // aliasing works fine with BitSet::setOr
-      for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
-         if (bbA) {
-            bb->liveSet.setOr(&bbA->liveSet, &bbB->liveSet);
-            bbA = bb;
-         } else {
-            bbA = bbB;
-         }
-         bbB = BasicBlock::get(ei.getNode());
+   if (!bb->cfg.outgoingCount()) {
+      // a lone block keeps its own live-in set
+      if (!bb->cfg.incidentCount()) {
+         for (size_t k = 0; k < bb->liveIn.size(); ++k)
+            live.set(bb->liveIn[k]);
       }
-      bb->liveSet.setOr(&bbB->liveSet, bbA ? &bbA->liveSet : NULL);
-   } else
-   if (bb->cfg.incidentCount()) {
-      bb->liveSet.fill(0);
+      return;
    }
-}
-
-bool
-RegAlloc::BuildIntervalsPass::visit(BasicBlock *bb)
-{
-   collectLiveValues(bb);
 
-   INFO_DBG(prog->dbgFlags, REG_ALLOC, "BuildIntervals(BB:%i)\n", bb->getId());
+   for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
+      const std::vector<int> &in = BasicBlock::get(ei.getNode())->liveIn;
+      for (size_t k = 0; k < in.size(); ++k)
+         live.set(in[k]);
+   }
 
    // go through out blocks and delete phi sources that do not originate from
    // the current block from the live set
@@ -652,28 +719,42 @@ RegAlloc::BuildIntervalsPass::visit(BasicBlock *bb)
       BasicBlock *out = BasicBlock::get(ei.getNode());
 
       for (Instruction *i = out->getPhi(); i && i->op == OP_PHI; i = i->next) {
-         bb->liveSet.clr(i->getDef(0)->id);
+         live.clr(i->getDef(0)->id);
 
          for (int s = 0; i->srcExists(s); ++s) {
             assert(i->src(s).getInsn());
             if (i->getSrc(s)->getUniqueInsn()->bb == bb) // XXX: reachableBy ?
-               bb->liveSet.set(i->getSrc(s)->id);
+               live.set(i->getSrc(s)->id);
             else
-               bb->liveSet.clr(i->getSrc(s)->id);
+               live.clr(i->getSrc(s)->id);
          }
       }
    }
+}
+
+bool
+RegAlloc::BuildIntervalsPass::visit(Function *fn)
+{
+   live.allocate(fn->allLValues.getSize());
+   return true;
+}
+
+bool
+RegAlloc::BuildIntervalsPass::visit(BasicBlock *bb)
+{
+   collectLiveOut(bb, live);
+
+   INFO_DBG(prog->dbgFlags, REG_ALLOC, "BuildIntervals(BB:%i)\n", bb->getId());
 
    // remaining live-outs are live until end
    if (bb->getExit()) {
-      for (unsigned int j = 0; j < bb->liveSet.getSize(); ++j)
-         if (bb->liveSet.test(j))
-            addLiveRange(func->getLValue(j), bb, bb->getExit()->serial + 1);
+      for (unsigned int k = 0; k < live.getSize(); ++k)
+         addLiveRange(func->getLValue(live[k]), bb, bb->getExit()->serial + 1);
    }
 
    for (Instruction *i = bb->getExit(); i && i->op != OP_PHI; i = i->prev) {
       for (int d = 0; i->defExists(d); ++d) {
-         bb->liveSet.clr(i->getDef(d)->id);
+         live.clr(i->getDef(d)->id);
          if (i->getDef(d)->reg.data.id >= 0) // add hazard for fixed regs
             i->getDef(d)->livei.extend(i->serial, i->serial);
       }
@@ -681,15 +762,15 @@ RegAlloc::BuildIntervalsPass::visit(BasicBlock *bb)
       for (int s = 0; i->srcExists(s); ++s) {
          if (!i->getSrc(s)->asLValue())
             continue;
-         if (!bb->liveSet.test(i->getSrc(s)->id)) {
-            bb->liveSet.set(i->getSrc(s)->id);
+         if (!live.test(i->getSrc(s)->id)) {
+            live.set(i->getSrc(s)->id);
             addLiveRange(i->getSrc(s), bb, i->serial);
          }
       }
    }
 
    if (bb == BasicBlock::get(func->cfg.getRoot())) {
-      for (std::deque<ValueDef>::iterator it = func->ins.begin();
+      for (DefArray::iterator it = func->ins.begin();
            it != func->ins.end(); ++it) {
          if (it->get()->reg.data.id >= 0) // add hazard for fixed regs
             it->get()->livei.extend(0, 1);
@@ -770,6 +851,7 @@ private:
    void buildRIG(ArrayList&);
    bool coalesce(ArrayList&);
    bool doCoalesce(ArrayList&, unsigned int mask);
+   void calculateLoopDepths();
    void calculateSpillWeights();
    bool simplify();
    bool selectRegisters();
@@ -825,6 +907,8 @@ private:
 
    SpillCodeInserter& spill;
    std::list<ValuePair> mustSpill;
+
+   std::vector<int> loopDepth; // by BB id
 };
 
 const GCRA::RelDegree GCRA::relDegree;
@@ -1211,7 +1295,7 @@ GCRA::buildRIG(ArrayList& insns)
 {
    std::list<RIG_Node *> values, active;
 
-   for (std::deque<ValueDef>::iterator it = func->ins.begin();
+   for (DefArray::iterator it = func->ins.begin();
         it != func->ins.end(); ++it)
       insertOrderedTail(values, getNode(it->get()->asLValue()));
 
@@ -1243,9 +1327,47 @@ GCRA::buildRIG(ArrayList& insns)
    }
 }
 
+// The loop nesting depth of a block is the number of loop headers whose back
+// edges it can reach without going through the header.
+void
+GCRA::calculateLoopDepths()
+{
+   const int bbCount = func->allBBlocks.getSize();
+   std::vector<int> loop(bbCount, -1);
+   std::stack<BasicBlock *> bbs;
+
+   loopDepth.assign(bbCount, 0);
+
+   for (ArrayList::Iterator bi = func->allBBlocks.iterator();
+        !bi.end(); bi.next()) {
+      BasicBlock *head = reinterpret_cast<BasicBlock *>(bi.get());
+
+      for (Graph::EdgeIterator ei = head->cfg.incident(); !ei.end(); ei.next())
+         if (ei.getType() == Graph::Edge::BACK)
+            bbs.push(BasicBlock::get(ei.getNode()));
+      if (bbs.empty())
+         continue;
+
+      loop[head->getId()] = head->getId();
+      ++loopDepth[head->getId()];
+      while (!bbs.empty()) {
+         BasicBlock *bb = bbs.top();
+         bbs.pop();
+         if (loop[bb->getId()] == head->getId())
+            continue;
+         loop[bb->getId()] = head->getId();
+         ++loopDepth[bb->getId()];
+         for (Graph::EdgeIterator ei = bb->cfg.incident(); !ei.end(); ei.next())
+            bbs.push(BasicBlock::get(ei.getNode()));
+      }
+   }
+}
+
 void
 GCRA::calculateSpillWeights()
 {
+   calculateLoopDepths();
+
    for (unsigned int i = 0; i < nodeCount; ++i) {
       RIG_Node *const n = &nodes[i];
       if (!nodes[i].colors || nodes[i].livei.isEmpty())
@@ -1258,14 +1380,24 @@ GCRA::calculateSpillWeights()
       LValue *val = nodes[i].getValue();
 
       if (!val->noSpill) {
-         int rc = 0;
+         // uses in loops count as if each loop ran 8 times
+         float rc = 0.0f;
          for (Value::DefIterator it = val->defs.begin();
               it != val->defs.end();
-              ++it)
-            rc += (*it)->get()->refCount();
+              ++it) {
+            const Value *def = (*it)->get();
+            for (Value::UseCIterator u = def->uses.begin();
+                 u != def->uses.end(); ++u) {
+               const int depth = loopDepth[(*u)->getInsn()->bb->getId()];
+               rc += (float)(1 << (3 * std::min(depth, 4)));
+            }
+         }
+
+         nodes[i].weight = rc * rc / (float)nodes[i].livei.extent();
 
-         nodes[i].weight =
-            (float)rc * (float)rc / (float)nodes[i].livei.extent();
+         // recomputing the value at its uses is cheap, prefer spilling it
+         if (val->reg.file == FILE_GPR && spill.getRematCost(val))
+            nodes[i].weight *= 0.25f;
       }
 
       if (nodes[i].degree < nodes[i].degreeLimit) {
@@ -1451,7 +1583,8 @@ GCRA::selectRegisters()
          INFO_DBG(prog->dbgFlags, REG_ALLOC, "must spill: %%%i (size %u)\n",
                   lval->id, lval->reg.size);
          Symbol *slot = NULL;
-         if (lval->reg.file == FILE_GPR)
+         // values without a slot are rematerialized, see getRematCost
+         if (lval->reg.file == FILE_GPR && !spill.getRematCost(lval))
             slot = spill.assignSlot(node->livei, lval->reg.size);
          mustSpill.push_back(ValuePair(lval, slot));
       }
@@ -1662,6 +1795,7 @@ SpillCodeInserter::spill(Instruction *defi, Value *slot, LValue *lval)
    Instruction *st;
    if (slot->reg.file == FILE_MEMORY_LOCAL) {
       lval->noSpill = 1;
+      stores += (ty != TYPE_B96) ? 1 : lval->reg.size / 4;
       if (ty != TYPE_B96) {
          st = new_Instruction(func, OP_STORE, ty);
          st->setSrc(0, slot);
@@ -1704,6 +1838,7 @@ SpillCodeInserter::unspill(Instruction *usei, LValue *lval, Value *slot)
    Instruction *ld;
    if (slot->reg.file == FILE_MEMORY_LOCAL) {
       lval->noSpill = 1;
+      loads += (ty != TYPE_B96) ? 1 : lval->reg.size / 4;
       if (ty != TYPE_B96) {
          ld = new_Instruction(func, OP_LOAD, ty);
       } else {
@@ -1737,6 +1872,121 @@ SpillCodeInserter::unspill(Instruction *usei, LValue *lval, Value *slot)
    return lval;
 }
 
+static bool
+isInvariantSysVal(const Value *val)
+{
+   switch (val->reg.data.sv.sv) {
+   case SV_TID:
+   case SV_COMBINED_TID:
+   case SV_CTAID:
+   case SV_NTID:
+   case SV_GRIDID:
+   case SV_NCTAID:
+   case SV_LANEID:
+   case SV_LANEMASK_EQ:
+   case SV_LANEMASK_LT:
+   case SV_LANEMASK_LE:
+   case SV_LANEMASK_GT:
+   case SV_LANEMASK_GE:
+      return true;
+   default:
+      return false;
+   }
+}
+
+// Returns the number of instructions needed to recompute val, or 0 if that
+// takes more than budget instructions or isn't possible at every point of
+// the program.
+static int
+getRecomputeCost(Value *val, int budget)
+{
+   LValue *lval = val->asLValue();
+   if (!lval || lval->reg.file != FILE_GPR || lval->compound || budget <= 0)
+      return 0;
+   if (lval->defs.size() != 1 || lval->defs.front()->get() != lval)
+      return 0;
+
+   const Instruction *insn = lval->defs.front()->getInsn();
+   if (!insn || insn->fixed || insn->defExists(1) || insn->getPredicate() ||
+       insn->flagsDef >= 0 || insn->flagsSrc >= 0)
+      return 0;
+
+   switch (insn->op) {
+   case OP_RDSV:
+      return isInvariantSysVal(insn->getSrc(0)) ? 1 : 0;
+   case OP_LOAD:
+      if (insn->src(0).getFile() != FILE_MEMORY_CONST)
+         return 0;
+      break;
+   case OP_MOV:
+   case OP_ADD:
+   case OP_SUB:
+   case OP_MUL:
+   case OP_MAD:
+   case OP_SHLADD:
+   case OP_SHL:
+   case OP_SHR:
+   case OP_AND:
+   case OP_OR:
+   case OP_XOR:
+   case OP_NOT:
+   case OP_NEG:
+   case OP_ABS:
+   case OP_MIN:
+   case OP_MAX:
+   case OP_EXTBF:
+   case OP_INSBF:
+      break;
+   default:
+      return 0;
+   }
+
+   int cost = 1;
+   for (int s = 0; insn->srcExists(s); ++s) {
+      if (insn->getIndirect(s, 0) || insn->getIndirect(s, 1))
+         return 0;
+      switch (insn->src(s).getFile()) {
+      case FILE_IMMEDIATE:
+      case FILE_MEMORY_CONST:
+         break;
+      default:
+         int srcCost = getRecomputeCost(insn->getSrc(s), budget - cost);
+         if (!srcCost)
+            return 0;
+         cost += srcCost;
+         break;
+      }
+   }
+   return cost;
+}
+
+// Values used by pseudo instructions share their register or memory slot with
+// other values, so they can't be recomputed separately.
+int
+SpillCodeInserter::getRematCost(Value *val) const
+{
+   for (Value::UseCIterator u = val->uses.begin(); u != val->uses.end(); ++u)
+      if ((*u)->getInsn()->isPseudo())
+         return 0;
+   return getRecomputeCost(val, REMAT_MAX_COST);
+}
+
+LValue *
+SpillCodeInserter::rematerialize(Instruction *usei, LValue *lval)
+{
+   Instruction *insn = cloneShallow(func, lval->defs.front()->getInsn());
+
+   for (int s = 0; insn->srcExists(s); ++s)
+      if (insn->src(s).getFile() == FILE_GPR)
+         insn->setSrc(s, rematerialize(usei, insn->getSrc(s)->asLValue()));
+
+   LValue *val = cloneShallow(func, lval);
+   val->noSpill = 1;
+   insn->setDef(0, val);
+   usei->bb->insertBefore(usei, insn);
+   return val;
+}
+
 static bool
 value_cmp(ValueRef *a, ValueRef *b) {
    Instruction *ai = a->getInsn(), *bi = b->getInsn();
@@ -1754,14 +2004,49 @@ value_cmp(ValueRef *a, ValueRef *b) {
 // For "Pseudo" instructions (like PHI, SPLIT, MERGE) we can erase the use
 // if we have spilled to a memory location, or simply with the new register.
 // No load or conversion instruction should be needed.
+//
+// GPR values without a slot are rematerialized instead: the instructions
+// computing them are copied before their uses and the original definition is
+// removed. They go first, so that the values they are computed from haven't
+// been replaced by unspills yet.
 bool
 SpillCodeInserter::run(const std::list<ValuePair>& lst)
 {
+   for (std::list<ValuePair>::const_iterator it = lst.begin(); it != lst.end();
+        ++it) {
+      LValue *lval = it->first->asLValue();
+      if (it->second || lval->reg.file != FILE_GPR)
+         continue;
+      assert(getRematCost(lval));
+
+      Instruction *defi = lval->defs.front()->getInsn();
+      LValue *tmp = NULL;
+      Instruction *last = NULL;
+
+      std::vector<ValueRef *> refs(lval->uses.begin(), lval->uses.end());
+      std::sort(refs.begin(), refs.end(), value_cmp);
+
+      for (std::vector<ValueRef*>::const_iterator u = refs.begin();
+           u != refs.end(); ++u) {
+         Instruction *usei = (*u)->getInsn();
+         if (!last || (usei != last->next && usei != last))
+            tmp = rematerialize(usei, lval);
+         last = usei;
+         (*u)->set(tmp);
+      }
+      delete_Instruction(func->getProgram(), defi);
+      ++rematValues;
+   }
+
    for (std::list<ValuePair>::const_iterator it = lst.begin(); it != lst.end();
         ++it) {
       LValue *lval = it->first->asLValue();
       Symbol *mem = it->second ? it->second->asSym() : NULL;
 
+      if (!mem && lval->reg.file == FILE_GPR)
+         continue;
+      ++spilledValues;
+
       // Keep track of which instructions to delete later. Deleting them
       // inside the loop is unsafe since a single instruction may have
       // multiple destinations that all need to be spilled (like OP_SPLIT).
@@ -1852,7 +2137,7 @@ RegAlloc::execFunc()
 
    GCRA gcra(func, insertSpills);
 
-   unsigned int i, retries;
+   unsigned int retries;
    bool ret;
 
    if (!func->ins.empty()) {
@@ -1882,15 +2167,7 @@ RegAlloc::execFunc()
          func->print();
 
       // spilling to registers may add live ranges, need to rebuild everything
-      ret = true;
-      for (sequence = func->cfg.nextSequence(), i = 0;
-           ret && i <= func->loopNestingBound;
-           sequence = func->cfg.nextSequence(), ++i)
-         ret = buildLiveSets(BasicBlock::get(func->cfg.getRoot()));
-      // reset marker
-      for (ArrayList::Iterator bi = func->allBBlocks.iterator();
-           !bi.end(); bi.next())
-         BasicBlock::get(bi)->liveSet.marker = false;
+      ret = buildLiveSets();
       if (!ret)
          break;
       func->orderInstructions(this->insns);
@@ -1905,6 +2182,10 @@ RegAlloc::execFunc()
    INFO_DBG(prog->dbgFlags, REG_ALLOC, "RegAlloc done: %i\n", ret);
 
    func->tlsSize = insertSpills.getStackSize();
+   prog->spillStores += insertSpills.getStoreCount();
+   prog->spillLoads += insertSpills.getLoadCount();
+   prog->spillValues += insertSpills.getSpilledValueCount();
+   prog->rematValues += insertSpills.getRematValueCount();
 out:
    return ret;
 }
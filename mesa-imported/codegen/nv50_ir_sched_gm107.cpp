@@ -0,0 +1,608 @@
+#include "codegen/nv50_ir_target_gm107.h"
+#include "codegen/nv50_ir_sched_gm107.h"
+
+#include <algorithm>
+#include <map>
+
+namespace nv50_ir {
+
+// Values live after the region never get released in it.
+#define LIVE_OUT (1 << 30)
+
+// Registers a schedule may always use: with up to 32 GPRs a thread, an SM
+// still runs its maximum number of warps. Keep some slack for the allocator,
+// which can't always pack values as tightly as the pressure suggests.
+// Above that, regions may only grow up to the pressure they had before, and
+// only while the program is well below the top of its occupancy bucket: when
+// it's close, filling every region up to its peak makes the allocator use
+// more registers, or spill.
+static const int freeRegs[] = { 28, 4 };
+static const int reservedRegs[] = { 4, 1 };
+
+// Highest GPR count giving the same number of warps as the given one. Each
+// of the 4 SM partitions has a 16K-entry register file and holds up to 16
+// warps, registers are allocated in units of 8 a thread.
+static int
+getOccupancyLimit(int gprs)
+{
+   const int regsPerWarp = 32 * ((MAX2(gprs, 1) + 7) & ~7);
+   const int warps = MAX2(MIN2(0x4000 / regsPerWarp, 16), 1);
+   return (0x4000 / (32 * warps)) & ~7;
+}
+
+enum Unit
+{
+   UNIT_ALU,
+   UNIT_SFU, // also conversions and FP64
+   UNIT_LSU,
+   UNIT_TEX,
+   UNIT_COUNT
+};
+
+enum MemorySpace
+{
+   MEM_GLOBAL, // also buffers and surfaces
+   MEM_SHARED,
+   MEM_LOCAL,
+   MEM_OUTPUT,
+   MEM_COUNT
+};
+
+// Instructions that can't be moved, and that nothing can be moved across.
+static bool
+isSchedulingBarrier(const Instruction *insn)
+{
+   if (insn->fixed || insn->join || insn->terminator || insn->exit ||
+       insn->asFlow())
+      return true;
+
+   switch (insn->op) {
+   case OP_BAR:
+   case OP_CCTL:
+   case OP_DISCARD:
+   case OP_EMIT:
+   case OP_EXIT:
+   case OP_MEMBAR:
+   case OP_QUADON:
+   case OP_QUADPOP:
+   case OP_RESTART:
+   case OP_TEXBAR:
+   case OP_WRSV:
+      return true;
+   default:
+      break;
+   }
+
+   // writes to fixed registers, e.g. arguments of built-in functions
+   for (int d = 0; insn->defExists(d); ++d)
+      if (insn->getDef(d)->reg.data.id >= 0)
+         return true;
+   return false;
+}
+
+// Return the memory space accessed by an instruction, if accesses to it have
+// to stay ordered with writes. Constant buffers, shader inputs and textures
+// are read-only (or can't be written and read back without a barrier).
+static int
+getMemorySpace(const Instruction *insn, bool &write)
+{
+   write = false;
+
+   switch (insn->op) {
+   case OP_ATOM:
+   case OP_EXPORT:
+   case OP_STORE:
+      write = true;
+      /* fallthrough */
+   case OP_LOAD:
+   case OP_VFETCH:
+      switch (insn->src(0).getFile()) {
+      case FILE_MEMORY_SHARED:
+         return MEM_SHARED;
+      case FILE_MEMORY_LOCAL:
+         return MEM_LOCAL;
+      case FILE_SHADER_OUTPUT:
+         return MEM_OUTPUT;
+      case FILE_MEMORY_CONST:
+      case FILE_SHADER_INPUT:
+         if (!write)
+            return -1;
+         break;
+      default:
+         break;
+      }
+      return MEM_GLOBAL;
+   case OP_SUREDB:
+   case OP_SUREDP:
+   case OP_SUSTB:
+   case OP_SUSTP:
+      write = true;
+      /* fallthrough */
+   case OP_SULDB:
+   case OP_SULDP:
+      return MEM_GLOBAL;
+   default:
+      return -1;
+   }
+}
+
+static int
+getPressureClass(const Value *v)
+{
+   // fixed registers (like RZ) are outside of the allocator's control
+   if (v->reg.data.id >= 0)
+      return -1;
+
+   switch (v->reg.file) {
+   case FILE_GPR:
+      return 0;
+   case FILE_PREDICATE:
+      return 1;
+   default:
+      return -1;
+   }
+}
+
+static inline int
+getPressureUnits(const Value *v)
+{
+   return v->reg.file == FILE_GPR ? (v->reg.size + 3) / 4 : 1;
+}
+
+// Whether source s is the first one of the instruction reading its value.
+static bool
+isFirstRead(const Instruction *insn, int s)
+{
+   for (int k = 0; k < s; ++k)
+      if (insn->getSrc(k) == insn->getSrc(s))
+         return false;
+   return true;
+}
+
+void
+GM107SchedulePreRA::setLive(Value *v, bool set)
+{
+   const int c = getPressureClass(v);
+
+   if (c < 0 || !v->asLValue() || live.test(v->id) == set)
+      return;
+   if (set) {
+      live.set(v->id);
+      pressure[c] += getPressureUnits(v);
+   } else {
+      live.clr(v->id);
+      pressure[c] -= getPressureUnits(v);
+   }
+}
+
+// Set up the live set and pressure at the end of a block from the live-in
+// sets of its successors. Phi sources are taken to be live-out of the block
+// defining them, like the register allocator does.
+void
+GM107SchedulePreRA::buildLiveOut(BasicBlock *bb)
+{
+   live.fill(0);
+   for (Graph::EdgeIterator ei = bb->cfg.outgoing(); !ei.end(); ei.next()) {
+      BasicBlock *out = BasicBlock::get(ei.getNode());
+
+      for (size_t k = 0; k < out->liveIn.size(); ++k)
+         live.set(out->liveIn[k]);
+      for (Instruction *i = out->getPhi(); i && i->op == OP_PHI; i = i->next) {
+         for (int s = 0; i->srcExists(s); ++s) {
+            Instruction *def = i->getSrc(s)->getUniqueInsn();
+            if (def && def->bb == bb)
+               live.set(i->getSrc(s)->id);
+         }
+      }
+   }
+   if (bb == BasicBlock::get(func->cfgExit)) {
+      for (RefArray::iterator it = func->outs.begin();
+           it != func->outs.end(); ++it)
+         live.set(it->get()->id);
+   }
+
+   for (int c = 0; c < PRESSURE_COUNT; ++c)
+      pressure[c] = 0;
+   for (int id = live.findSet(0); id >= 0; id = live.findSet(id + 1)) {
+      const LValue *lval = func->getLValue(id);
+      const int c = getPressureClass(lval);
+      if (c >= 0)
+         pressure[c] += getPressureUnits(lval);
+   }
+}
+
+// Update the live set from after an instruction to before it, and record
+// the highest pressure seen on the way if asked for.
+void
+GM107SchedulePreRA::transfer(const Instruction *insn, int *peak)
+{
+   if (peak) {
+      // results take up registers even if they're never read
+      for (int d = 0; insn->defExists(d); ++d)
+         setLive(insn->getDef(d), true);
+      for (int c = 0; c < PRESSURE_COUNT; ++c)
+         peak[c] = MAX2(peak[c], pressure[c]);
+   }
+   for (int d = 0; insn->defExists(d); ++d)
+      setLive(insn->getDef(d), false);
+   for (int s = 0; insn->srcExists(s); ++s)
+      setLive(insn->getSrc(s), true);
+   if (peak) {
+      for (int c = 0; c < PRESSURE_COUNT; ++c)
+         peak[c] = MAX2(peak[c], pressure[c]);
+   }
+}
+
+// Measure the register pressure of the original order, to see how much room
+// the schedule has.
+bool
+GM107SchedulePreRA::visit(Function *fn)
+{
+   int peak[PRESSURE_COUNT] = { 0, 0 };
+
+   fn->buildLiveSetsSSA();
+   live.allocate(fn->allLValues.getSize(), false);
+   usesLeft.assign(fn->allLValues.getSize(), 0);
+
+   for (IteratorRef it = fn->cfg.iteratorDFS(false); !it->end(); it->next()) {
+      BasicBlock *bb = BasicBlock::get(reinterpret_cast<Graph::Node *>(it->get()));
+
+      buildLiveOut(bb);
+      for (Instruction *i = bb->getExit(); i && i->op != OP_PHI; i = i->prev)
+         transfer(i, peak);
+   }
+
+   for (int c = 0; c < PRESSURE_COUNT; ++c) {
+      int size = targ->getFileSize(c == PRESSURE_GPR ? FILE_GPR
+                                                      : FILE_PREDICATE);
+      if (c == PRESSURE_GPR)
+         size = MIN2(size, getOccupancyLimit(peak[c] + reservedRegs[c]));
+      const int avail = MAX2(size - reservedRegs[c], 1);
+
+      freeLimit[c] = MIN2(freeRegs[c], avail);
+      growLimit[c] = peak[c] <= avail * 3 / 4 ? avail : 0;
+   }
+   return true;
+}
+
+bool
+GM107SchedulePreRA::schedule(Program *prog)
+{
+   if (prog->getTarget()->getChipset() < NVISA_GM107_CHIPSET)
+      return true;
+   if (!debug_get_bool_option("NV50_PROG_SCHED_PRE_RA", true))
+      return true;
+   targ = static_cast<const TargetGM107 *>(prog->getTarget());
+   return run(prog, false, true);
+}
+
+void
+GM107SchedulePreRA::addEdge(int from, int to, int latency)
+{
+   Edge edge = { to, latency };
+   nodes[from].succs.push_back(edge);
+   nodes[to].preds++;
+}
+
+// Order a node after the previous accesses to a resource. Only data
+// dependencies (reading a value) have to wait for the producer's results.
+void
+GM107SchedulePreRA::addDeps(Access &access, int node, bool write, bool data)
+{
+   if (access.def >= 0 && access.def != node)
+      addEdge(access.def, node,
+              (data && !write) ? nodes[access.def].latency : 0);
+
+   if (write) {
+      for (size_t u = 0; u < access.uses.size(); ++u)
+         if (access.uses[u] != node)
+            addEdge(access.uses[u], node, 0);
+      access.uses.clear();
+      access.def = node;
+   } else
+   if (access.uses.empty() || access.uses.back() != node) {
+      access.uses.push_back(node);
+   }
+}
+
+void
+GM107SchedulePreRA::buildDAG(const std::vector<Instruction *> &insns)
+{
+   std::map<const Value *, Access> values;
+   Access flags; // there is a single flags register
+   Access memory[MEM_COUNT];
+
+   nodes.resize(insns.size());
+
+   for (size_t n = 0; n < insns.size(); ++n) {
+      Instruction *insn = insns[n];
+      Node &node = nodes[n];
+      const OpClass cl = targ->getOpClass(insn->op);
+      bool write;
+
+      node.insn = insn;
+      node.succs.clear();
+      node.preds = 0;
+      node.ready = 0;
+      if (insn->isPseudo()) {
+         node.latency = 0;
+         node.throughput = 0;
+      } else {
+         node.latency = targ->getResultLatency(insn);
+         node.throughput = targ->getThroughput(insn);
+      }
+      if (cl == OPCLASS_TEXTURE || cl == OPCLASS_SURFACE)
+         node.unit = UNIT_TEX;
+      else
+      if (cl == OPCLASS_LOAD || cl == OPCLASS_STORE || cl == OPCLASS_ATOMIC)
+         node.unit = UNIT_LSU;
+      else
+         node.unit = node.throughput >= 4 ? UNIT_SFU : UNIT_ALU;
+
+      // sources of a union end up in the same register, keep their order
+      if (insn->op == OP_UNION) {
+         std::vector<int> defs;
+         for (int s = 0; insn->srcExists(s); ++s) {
+            std::map<const Value *, Access>::iterator it =
+               values.find(insn->getSrc(s));
+            if (it != values.end() && it->second.def >= 0)
+               defs.push_back(it->second.def);
+         }
+         std::sort(defs.begin(), defs.end());
+         for (size_t k = 1; k < defs.size(); ++k)
+            if (defs[k] != defs[k - 1])
+               addEdge(defs[k - 1], defs[k], 0);
+      }
+
+      for (int s = 0; insn->srcExists(s); ++s) {
+         Value *v = insn->getSrc(s);
+         if (!v->asLValue())
+            continue;
+         if (v->reg.file == FILE_FLAGS)
+            addDeps(flags, n, false, true);
+         addDeps(values[v], n, false, true);
+      }
+      for (int d = 0; insn->defExists(d); ++d) {
+         Value *v = insn->getDef(d);
+         if (v->reg.file == FILE_FLAGS)
+            addDeps(flags, n, true, true);
+         addDeps(values[v], n, true, true);
+      }
+
+      const int space = getMemorySpace(insn, write);
+      if (space >= 0)
+         addDeps(memory[space], n, write, false);
+   }
+
+   // Results that are only read after the region still have to arrive in
+   // time, so they count towards the critical path as well.
+   for (int n = insns.size() - 1; n >= 0; --n) {
+      Node &node = nodes[n];
+      bool liveOut = false;
+
+      for (int d = 0; node.insn->defExists(d); ++d) {
+         const Value *v = node.insn->getDef(d);
+         if (getPressureClass(v) >= 0 && usesLeft[v->id] >= LIVE_OUT)
+            liveOut = true;
+      }
+      node.height = liveOut ? node.latency : MIN2(node.latency, 1);
+      for (size_t e = 0; e < node.succs.size(); ++e) {
+         const Edge &edge = node.succs[e];
+         node.height = MAX2(node.height,
+                            edge.latency + nodes[edge.node].height);
+      }
+   }
+}
+
+// Return by how many registers scheduling an instruction next would exceed
+// the pressure limits.
+int
+GM107SchedulePreRA::calcExcess(const Instruction *insn) const
+{
+   int delta[PRESSURE_COUNT] = { 0, 0 };
+   int excess = 0;
+
+   for (int s = 0; insn->srcExists(s); ++s) {
+      const Value *v = insn->getSrc(s);
+      const int c = getPressureClass(v);
+      if (c >= 0 && isFirstRead(insn, s) && usesLeft[v->id] == 1 &&
+          live.test(v->id))
+         delta[c] -= getPressureUnits(v);
+   }
+   for (int d = 0; insn->defExists(d); ++d) {
+      const Value *v = insn->getDef(d);
+      const int c = getPressureClass(v);
+      if (c >= 0 && usesLeft[v->id] && !live.test(v->id))
+         delta[c] += getPressureUnits(v);
+   }
+
+   for (int c = 0; c < PRESSURE_COUNT; ++c)
+      excess += MAX2(pressure[c] + delta[c] - limit[c], 0);
+   return excess;
+}
+
+bool
+GM107SchedulePreRA::isBetter(const Candidate &a, const Candidate &b) const
+{
+   if (a.excess != b.excess)
+      return a.excess < b.excess;
+   if (a.stall != b.stall)
+      return a.stall < b.stall;
+   if (nodes[a.node].height != nodes[b.node].height)
+      return nodes[a.node].height > nodes[b.node].height;
+   return a.node < b.node;
+}
+
+// Update the live set and pressure for a scheduled instruction.
+void
+GM107SchedulePreRA::commit(const Instruction *insn)
+{
+   for (int s = 0; insn->srcExists(s); ++s) {
+      Value *v = insn->getSrc(s);
+      if (getPressureClass(v) >= 0 && isFirstRead(insn, s) &&
+          --usesLeft[v->id] == 0)
+         setLive(v, false);
+   }
+   for (int d = 0; insn->defExists(d); ++d) {
+      Value *v = insn->getDef(d);
+      if (getPressureClass(v) >= 0 && usesLeft[v->id])
+         setLive(v, true);
+   }
+}
+
+void
+GM107SchedulePreRA::scheduleRegion(BasicBlock *bb,
+                                   const std::vector<Instruction *> &insns)
+{
+   Instruction *prev = insns.front()->prev;
+   std::vector<int> ready, order;
+   int unitFree[UNIT_COUNT] = { 0 };
+   int cycle = 0;
+
+   if (insns.size() < 2) {
+      transfer(insns.front());
+      return;
+   }
+
+   // count the readers of each value, starting from the live set at the
+   // end of the region
+   for (size_t n = 0; n < insns.size(); ++n) {
+      const Instruction *insn = insns[n];
+      for (int s = 0; insn->srcExists(s); ++s) {
+         const Value *v = insn->getSrc(s);
+         if (getPressureClass(v) >= 0 && live.test(v->id))
+            usesLeft[v->id] = LIVE_OUT;
+      }
+      for (int d = 0; insn->defExists(d); ++d) {
+         const Value *v = insn->getDef(d);
+         if (getPressureClass(v) >= 0 && live.test(v->id))
+            usesLeft[v->id] = LIVE_OUT;
+      }
+   }
+   for (size_t n = 0; n < insns.size(); ++n) {
+      const Instruction *insn = insns[n];
+      for (int s = 0; insn->srcExists(s); ++s) {
+         const Value *v = insn->getSrc(s);
+         if (getPressureClass(v) >= 0 && isFirstRead(insn, s) &&
+             usesLeft[v->id] < LIVE_OUT)
+            usesLeft[v->id]++;
+      }
+   }
+
+   buildDAG(insns);
+
+   // The live set at the start of the region doesn't depend on the order.
+   // The pressure may grow as long as it doesn't cost occupancy, and up to
+   // what the region already needs if the program isn't short of registers,
+   // never past its occupancy bucket.
+   for (int c = 0; c < PRESSURE_COUNT; ++c)
+      limit[c] = pressure[c];
+   for (int n = insns.size() - 1; n >= 0; --n)
+      transfer(insns[n], limit);
+   for (int c = 0; c < PRESSURE_COUNT; ++c)
+      limit[c] = MAX2(MIN2(limit[c], growLimit[c]), freeLimit[c]);
+
+   for (size_t n = 0; n < insns.size(); ++n)
+      if (!nodes[n].preds)
+         ready.push_back(n);
+
+   while (!ready.empty()) {
+      Candidate best;
+      size_t bestPos = 0;
+
+      for (size_t r = 0; r < ready.size(); ++r) {
+         const Node &node = nodes[ready[r]];
+         Candidate c;
+         int avail = node.ready;
+
+         if (node.throughput)
+            avail = MAX2(avail, unitFree[node.unit]);
+         c.node = ready[r];
+         c.excess = calcExcess(node.insn);
+         c.stall = MAX2(avail - cycle, 0);
+         if (!r || isBetter(c, best)) {
+            best = c;
+            bestPos = r;
+         }
+      }
+      ready[bestPos] = ready.back();
+      ready.pop_back();
+
+      Node &node = nodes[best.node];
+      const int issue = cycle + best.stall;
+      if (node.throughput) {
+         cycle = issue + 1;
+         unitFree[node.unit] = issue + node.throughput;
+      }
+      commit(node.insn);
+      order.push_back(best.node);
+
+      for (size_t e = 0; e < node.succs.size(); ++e) {
+         Node &succ = nodes[node.succs[e].node];
+         succ.ready = MAX2(succ.ready, issue + node.succs[e].latency);
+         if (--succ.preds == 0)
+            ready.push_back(node.succs[e].node);
+      }
+   }
+   assert(order.size() == insns.size());
+
+   for (size_t n = 0; n < insns.size(); ++n) {
+      const Instruction *insn = insns[n];
+      for (int s = 0; insn->srcExists(s); ++s)
+         if (getPressureClass(insn->getSrc(s)) >= 0)
+            usesLeft[insn->getSrc(s)->id] = 0;
+      for (int d = 0; insn->defExists(d); ++d)
+         if (getPressureClass(insn->getDef(d)) >= 0)
+            usesLeft[insn->getDef(d)->id] = 0;
+   }
+
+   // Now at the end of the region, go back to its start.
+   for (int n = insns.size() - 1; n >= 0; --n)
+      transfer(insns[order[n]]);
+
+   size_t n;
+   for (n = 0; n < order.size() && order[n] == (int)n; ++n);
+   if (n == order.size())
+      return;
+
+   for (n = 0; n < insns.size(); ++n)
+      bb->remove(insns[n]);
+   for (n = 0; n < order.size(); ++n) {
+      Instruction *insn = insns[order[n]];
+      if (prev)
+         bb->insertAfter(prev, insn);
+      else
+         bb->insertHead(insn);
+      prev = insn;
+   }
+}
+
+bool
+GM107SchedulePreRA::visit(BasicBlock *bb)
+{
+   std::vector<Instruction *> region;
+   Instruction *i, *prev;
+
+   buildLiveOut(bb);
+
+   for (i = bb->getExit(); ; i = prev) {
+      const bool end = !i || i->op == OP_PHI;
+
+      if (end || isSchedulingBarrier(i)) {
+         if (!region.empty()) {
+            std::reverse(region.begin(), region.end());
+            scheduleRegion(bb, region);
+            region.clear();
+         }
+         if (end)
+            break;
+         transfer(i);
+      } else {
+         region.push_back(i);
+      }
+      prev = i->prev;
+   }
+   return true;
+}
+
+} // namespace nv50_ir
@@ -0,0 +1,98 @@
+#include "codegen/nv50_ir.h"
+
+#include <vector>
+
+namespace nv50_ir {
+
+class TargetGM107;
+
+// List scheduler, the last SSA optimization before register allocation.
+//
+// Basic blocks are split into regions at the instructions that have to stay
+// in place, and the instructions of each region are reordered along their
+// dependency graph so that long latency results (texture fetches, memory
+// loads, SFU operations) are requested as early as possible and consumed as
+// late as needed. The register pressure is tracked all along, and the
+// schedule only grows it up to what doesn't affect occupancy, or, when the
+// program has registers to spare, to what the original order of the region
+// already needs, within the occupancy bucket of the program. Above that,
+// instructions freeing registers go first.
+//
+// Only runs on GM107 and later, NV50_PROG_SCHED_PRE_RA=0 turns it off.
+class GM107SchedulePreRA : public Pass
+{
+public:
+   GM107SchedulePreRA() : targ(NULL) { }
+
+   bool schedule(Program *);
+
+private:
+   enum PressureClass
+   {
+      PRESSURE_GPR,
+      PRESSURE_PRED,
+      PRESSURE_COUNT
+   };
+
+   struct Edge
+   {
+      int node;
+      int latency;
+   };
+
+   struct Node
+   {
+      Instruction *insn;
+      std::vector<Edge> succs;
+      int preds;      // number of unscheduled predecessors
+      int latency;    // cycles until the results are available
+      int throughput; // cycles the unit is busy issuing the instruction
+      int unit;
+      int height;     // length of the critical path to the end of the region
+      int ready;      // cycle at which all sources are available
+   };
+
+   // last instruction writing a resource and the ones reading it since
+   struct Access
+   {
+      Access() : def(-1) { }
+      int def;
+      std::vector<int> uses;
+   };
+
+   struct Candidate
+   {
+      int node;
+      int excess; // registers above the limit after scheduling the node
+      int stall;
+   };
+
+   virtual bool visit(Function *);
+   virtual bool visit(BasicBlock *);
+
+   void setLive(Value *, bool);
+   void buildLiveOut(BasicBlock *);
+   void transfer(const Instruction *, int *peak = NULL);
+
+   void addEdge(int from, int to, int latency);
+   void addDeps(Access&, int node, bool write, bool data);
+   void buildDAG(const std::vector<Instruction *>&);
+
+   int calcExcess(const Instruction *) const;
+   bool isBetter(const Candidate&, const Candidate&) const;
+   void commit(const Instruction *);
+   void scheduleRegion(BasicBlock *, const std::vector<Instruction *>&);
+
+   const TargetGM107 *targ;
+
+   BitSet live;
+   int pressure[PRESSURE_COUNT];
+   int limit[PRESSURE_COUNT];     // for the current region
+   int freeLimit[PRESSURE_COUNT]; // pressure that doesn't limit occupancy
+   int growLimit[PRESSURE_COUNT]; // up to which regions may keep their peak
+
+   std::vector<Node> nodes;
+   std::vector<int> usesLeft; // by value id, readers left in the region
+};
+
+} // namespace nv50_ir
@@ -251,7 +251,7 @@ Function::buildLiveSetsPreSSA(BasicBlock *bb, const int seq)
    }
 
    if (bb == BasicBlock::get(f->cfgExit)) {
-      for (std::deque<ValueRef>::iterator it = f->outs.begin();
+      for (RefArray::iterator it = f->outs.begin();
            it != f->outs.end(); ++it) {
          if (!assigned.test(it->get()->id))
             usedBeforeAssigned.set(it->get()->id);
@@ -458,7 +458,7 @@ void RenamePass::search(BasicBlock *bb)
    // Put current definitions for function inputs values on the stack.
    // They can be used before any redefinitions are pushed.
    if (bb == BasicBlock::get(func->cfg.getRoot())) {
-      for (std::deque<ValueDef>::iterator it = func->ins.begin();
+      for (DefArray::iterator it = func->ins.begin();
            it != func->ins.end(); ++it) {
          lval = it->get()->asLValue();
          assert(lval);
@@ -528,7 +528,7 @@ void RenamePass::search(BasicBlock *bb)
    // Update function outputs to the last definitions of their pre-SSA values.
    // I hope they're unique, i.e. that we get PHIs for all of them ...
    if (bb == BasicBlock::get(func->cfgExit)) {
-      for (std::deque<ValueRef>::iterator it = func->outs.begin();
+      for (RefArray::iterator it = func->outs.begin();
            it != func->outs.end(); ++it) {
          lval = it->get()->asLValue();
          if (!lval)
@@ -536,4 +536,52 @@ nv50_ir_get_target_library(uint32_t chipset,
    nv50_ir::Target::destroy(targ);
 }
 
+bool
+nv50_ir_get_timings(uint32_t chipset, struct nv50_ir_timing *timings)
+{
+   nv50_ir::Target *targ = nv50_ir::Target::create(chipset);
+   if (!targ)
+      return false;
+   bool ret = targ->getTimings(timings);
+   nv50_ir::Target::destroy(targ);
+   return ret;
+}
+
+const char *
+nv50_ir_get_timing_class_name(unsigned int timingClass)
+{
+   static const char *const names[NV50_IR_TIMING_COUNT] =
+   {
+      "alu",
+      "alu_half",
+      "imul",
+      "rro",
+      "mufu",
+      "bitscan",
+      "convert",
+      "f64",
+      "cs2r",
+      "s2r",
+      "shfl",
+      "quad",
+      "interp",
+      "attr",
+      "al2p",
+      "pixld",
+      "ld_const",
+      "ld_shared",
+      "ld_local",
+      "ld_global",
+      "store",
+      "st_global",
+      "out",
+      "atom",
+      "tex",
+      "txq",
+      "surface",
+      "other",
+   };
+   return timingClass < NV50_IR_TIMING_COUNT ? names[timingClass] : NULL;
+}
+
 }
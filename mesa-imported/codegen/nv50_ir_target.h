@@ -157,7 +157,8 @@ enum OpClass
 class Target
 {
 public:
-   Target(bool m, bool j, bool s) : hasJoin(m), joinAnterior(j), hasSWSched(s) { }
+   Target(bool m, bool j, bool s) : hasJoin(m), joinAnterior(j), hasSWSched(s),
+      gprBudget(0) { }
    virtual ~Target() { }
 
    static Target *create(uint32_t chipset);
@@ -183,6 +184,7 @@ public:
       } else {
          threads = 32; // doesn't matter, just not too big.
       }
+      gprBudget = info->gprBudget;
    }
 
    virtual bool runLegalizePass(Program *, CGStage stage) const = 0;
@@ -234,6 +236,8 @@ public:
                              const Instruction *next) const { return false; }
    virtual int getLatency(const Instruction *) const { return 1; }
    virtual int getThroughput(const Instruction *) const { return 1; }
+   // copy the timing model behind the above, if the target has a table
+   virtual bool getTimings(struct nv50_ir_timing *) const { return false; }
 
    virtual unsigned int getFileSize(DataFile) const = 0;
    virtual unsigned int getFileUnit(DataFile) const = 0;
@@ -260,6 +264,7 @@ public:
 protected:
    uint32_t chipset;
    uint32_t threads;
+   uint32_t gprBudget; // limits the size of the GPR file if non-zero
 
    DataFile nativeFileMap[DATA_FILE_COUNT];
 
@@ -31,6 +31,77 @@ Target *getTargetGM107(unsigned int chipset)
    return new TargetGM107(chipset);
 }
 
+// Default timings, indexed by nv50_ir_timing_class. None of these values were
+// measured: they are legacy estimates, to be replaced with --timings when
+// better numbers are available.
+// - Latencies are the stall counts of the previous getLatency(), which were
+//   themselves marked as "good enough for now". Fixed latency classes must
+//   not go below what the hardware needs.
+// - Result latencies are rough guesses of the average number of cycles until
+//   a scoreboarded result is available (cache hits for memory accesses).
+// - Throughputs are derived from the unit counts per SM sub-partition (32
+//   FP32/integer lanes, 8 SFU and 8 load/store lanes, while the 4 FP64 units
+//   of an SM are shared), not from issue rate measurements.
+static const struct nv50_ir_timing gm107Timings[NV50_IR_TIMING_COUNT] =
+{
+   /* ALU */       {  6,   6,  1 },
+   /* ALU_HALF */  {  6,   6,  2 },
+   /* IMUL */      {  6,  20,  4 },
+   /* RRO */       {  6,   6,  4 },
+   /* MUFU */      { 13,  20,  4 },
+   /* BITSCAN */   { 13,  20,  4 },
+   /* CONVERT */   { 15,  20,  4 },
+   /* F64 */       { 15,  48, 32 },
+   /* CS2R */      {  6,   6,  4 },
+   /* S2R */       { 15,  25,  4 },
+   /* SHFL */      {  2,  30,  4 },
+   /* QUAD */      { 13,  13,  1 },
+   /* INTERP */    { 15,  20,  4 },
+   /* ATTR */      { 15,  30,  4 },
+   /* AL2P */      { 15,  30,  1 },
+   /* PIXLD */     {  1,  30,  1 },
+   /* LD_CONST */  { 15,  30,  4 },
+   /* LD_SHARED */ { 15,  30,  4 },
+   /* LD_LOCAL */  { 15, 200,  4 },
+   /* LD_GLOBAL */ { 15, 200,  4 },
+   /* STORE */     {  1,  30,  4 },
+   /* ST_GLOBAL */ {  1, 200,  4 },
+   /* OUT */       {  1,  20,  1 },
+   /* ATOM */      { 15, 200,  4 },
+   /* TEX */       { 15, 200,  4 },
+   /* TXQ */       { 15,  40,  4 },
+   /* SURFACE */   { 15, 200,  4 },
+   /* OTHER */     { 15,  20,  1 },
+};
+
+TargetGM107::TargetGM107(unsigned int chipset) : TargetNVC0(chipset)
+{
+   memcpy(timings, gm107Timings, sizeof(timings));
+}
+
+// Replace the timing model with the one supplied by the driver. Stall counts
+// are limited to what the hardware can encode.
+void
+TargetGM107::parseDriverInfo(const struct nv50_ir_prog_info *info)
+{
+   if (info->timings) {
+      for (int c = 0; c < NV50_IR_TIMING_COUNT; ++c) {
+         timings[c] = info->timings[c];
+         timings[c].latency = CLAMP(timings[c].latency, 1, 15);
+         timings[c].resultLatency = MAX2(timings[c].resultLatency, 1);
+         timings[c].throughput = MAX2(timings[c].throughput, 1);
+      }
+   }
+   TargetNVC0::parseDriverInfo(info);
+}
+
+bool
+TargetGM107::getTimings(struct nv50_ir_timing *out) const
+{
+   memcpy(out, timings, sizeof(timings));
+   return true;
+}
+
 // BULTINS / LIBRARY FUNCTIONS:
 
 // lazyness -> will just hardcode everything for the time being
@@ -301,24 +372,94 @@ TargetGM107::canDualIssue(const Instruction *a, const Instruction *b) const
    return ac == ALU && bc != ALU;
 }
 
-// Return the number of stall counts needed to complete a single instruction.
-// On Maxwell GPUs, the pipeline depth is 6, but some instructions require
-// different number of stall counts like memory operations.
+// Return the timing class of an instruction, see nv50_ir_timing_class. Any
+// instruction with FP64 operands has the result latency and throughput of the
+// F64 class, but only FP64 arithmetic also takes its stall counts.
 int
-TargetGM107::getLatency(const Instruction *insn) const
+TargetGM107::getTimingClass(const Instruction *insn) const
 {
-   // TODO: better values! This should be good enough for now though.
    switch (insn->op) {
    case OP_EMIT:
-   case OP_EXPORT:
-   case OP_PIXLD:
    case OP_RESTART:
+      return NV50_IR_TIMING_OUT;
+   case OP_EXPORT:
+      return NV50_IR_TIMING_STORE;
    case OP_STORE:
+      switch (insn->src(0).getFile()) {
+      case FILE_MEMORY_GLOBAL:
+      case FILE_MEMORY_BUFFER:
+      case FILE_MEMORY_LOCAL:
+         return NV50_IR_TIMING_ST_GLOBAL;
+      default:
+         return NV50_IR_TIMING_STORE;
+      }
    case OP_SUSTB:
    case OP_SUSTP:
-      return 1;
+      return NV50_IR_TIMING_ST_GLOBAL;
+   case OP_ATOM:
+   case OP_SUREDB:
+   case OP_SUREDP:
+      return NV50_IR_TIMING_ATOM;
+   case OP_LOAD:
+      switch (insn->src(0).getFile()) {
+      case FILE_MEMORY_CONST:
+         return NV50_IR_TIMING_LD_CONST;
+      case FILE_MEMORY_SHARED:
+         return NV50_IR_TIMING_LD_SHARED;
+      case FILE_MEMORY_LOCAL:
+         return NV50_IR_TIMING_LD_LOCAL;
+      case FILE_MEMORY_GLOBAL:
+      case FILE_MEMORY_BUFFER:
+         return NV50_IR_TIMING_LD_GLOBAL;
+      default:
+         return NV50_IR_TIMING_ATTR;
+      }
+   case OP_VFETCH:
+      return NV50_IR_TIMING_ATTR;
+   case OP_AFETCH:
+   case OP_PFETCH:
+      return NV50_IR_TIMING_AL2P;
+   case OP_PIXLD:
+      return NV50_IR_TIMING_PIXLD;
+   case OP_LINTERP:
+   case OP_PINTERP:
+      return NV50_IR_TIMING_INTERP;
+   case OP_TXQ:
+      return NV50_IR_TIMING_TXQ;
    case OP_SHFL:
-      return 2;
+      return NV50_IR_TIMING_SHFL;
+   case OP_RDSV:
+      if (isCS2RSV(insn->getSrc(0)->reg.data.sv.sv))
+         return NV50_IR_TIMING_CS2R;
+      return NV50_IR_TIMING_S2R;
+   case OP_BFIND:
+   case OP_POPCNT:
+      return NV50_IR_TIMING_BITSCAN;
+   case OP_COS:
+   case OP_EX2:
+   case OP_LG2:
+   case OP_RCP:
+   case OP_RSQ:
+   case OP_SIN:
+   case OP_SQRT:
+      return NV50_IR_TIMING_MUFU;
+   case OP_QUADON:
+   case OP_QUADPOP:
+      return NV50_IR_TIMING_QUAD;
+   default:
+      break;
+   }
+
+   switch (getOpClass(insn->op)) {
+   case OPCLASS_TEXTURE:
+      return NV50_IR_TIMING_TEX;
+   case OPCLASS_SURFACE:
+      return NV50_IR_TIMING_SURFACE;
+   default:
+      break;
+   }
+
+   switch (insn->op) {
    case OP_ADD:
    case OP_AND:
    case OP_EXTBF:
@@ -347,11 +488,25 @@ TargetGM107::getLatency(const Instruction *insn) const
    case OP_VOTE:
    case OP_XOR:
    case OP_XMAD:
-      if (insn->dType != TYPE_F64)
-         return 6;
-      break;
-   case OP_RDSV:
-      return isCS2RSV(insn->getSrc(0)->reg.data.sv.sv) ? 6 : 15;
+      if (insn->dType == TYPE_F64)
+         return NV50_IR_TIMING_F64;
+      switch (insn->op) {
+      case OP_EXTBF:
+      case OP_INSBF:
+      case OP_SHL:
+      case OP_SHR:
+         return NV50_IR_TIMING_ALU_HALF;
+      case OP_MAD:
+      case OP_MUL:
+         if (!isFloatType(insn->dType))
+            return NV50_IR_TIMING_IMUL;
+         return NV50_IR_TIMING_ALU;
+      case OP_PREEX2:
+      case OP_PRESIN:
+         return NV50_IR_TIMING_RRO;
+      default:
+         return NV50_IR_TIMING_ALU;
+      }
    case OP_ABS:
    case OP_CEIL:
    case OP_CVT:
@@ -359,27 +514,24 @@ TargetGM107::getLatency(const Instruction *insn) const
    case OP_NEG:
    case OP_SAT:
    case OP_TRUNC:
-      if (insn->op == OP_CVT && (insn->def(0).getFile() == FILE_PREDICATE ||
-                                 insn->src(0).getFile() == FILE_PREDICATE))
-         return 6;
-      break;
-   case OP_BFIND:
-   case OP_COS:
-   case OP_EX2:
-   case OP_LG2:
-   case OP_POPCNT:
-   case OP_QUADON:
-   case OP_QUADPOP:
-   case OP_RCP:
-   case OP_RSQ:
-   case OP_SIN:
-   case OP_SQRT:
-      return 13;
+      if (insn->def(0).getFile() == FILE_PREDICATE ||
+          insn->src(0).getFile() == FILE_PREDICATE)
+         return insn->op == OP_CVT ? NV50_IR_TIMING_ALU : NV50_IR_TIMING_OTHER;
+      return NV50_IR_TIMING_CONVERT;
    default:
       break;
    }
    // Use the maximum number of stall counts for other instructions.
-   return 15;
+   return NV50_IR_TIMING_OTHER;
+}
+
+// Return the number of stall counts needed to complete a single instruction.
+// On Maxwell GPUs, the pipeline depth is 6, but some instructions require
+// different number of stall counts like memory operations.
+int
+TargetGM107::getLatency(const Instruction *insn) const
+{
+   return timings[getTimingClass(insn)].latency;
 }
 
 // Return the operand read latency which is the number of stall counts before
@@ -443,6 +595,31 @@ TargetGM107::getReadLatency(const Instruction *insn) const
    return 0;
 }
 
+// Return the estimated number of cycles until the results of an instruction
+// can be read. This is the same as getLatency() for fixed latency
+// instructions, but variable latency ones are only waited for with barriers
+// and their stall counts say nothing about how long the results take to
+// arrive.
+int
+TargetGM107::getResultLatency(const Instruction *insn) const
+{
+   if (!isBarrierRequired(insn))
+      return getLatency(insn);
+   if (insn->dType == TYPE_F64 || insn->sType == TYPE_F64)
+      return timings[NV50_IR_TIMING_F64].resultLatency;
+   return timings[getTimingClass(insn)].resultLatency;
+}
+
+// These are "inverse" throughput values, i.e. the number of cycles one SM
+// sub-partition needs to issue an instruction for a full warp.
+int
+TargetGM107::getThroughput(const Instruction *insn) const
+{
+   if (insn->dType == TYPE_F64 || insn->sType == TYPE_F64)
+      return timings[NV50_IR_TIMING_F64].throughput;
+   return timings[getTimingClass(insn)].throughput;
+}
+
 bool
 TargetGM107::isCS2RSV(SVSemantic sv) const
 {
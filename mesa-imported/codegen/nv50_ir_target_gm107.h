@@ -5,7 +5,7 @@ namespace nv50_ir {
 class TargetGM107 : public TargetNVC0
 {
 public:
-   TargetGM107(unsigned int chipset) : TargetNVC0(chipset) {}
+   TargetGM107(unsigned int chipset);
 
    virtual CodeEmitter *getCodeEmitter(Program::Type);
    CodeEmitter *createCodeEmitterGM107(Program::Type);
@@ -15,6 +15,8 @@ public:
    virtual void getBuiltinCode(const uint32_t **, uint32_t *) const;
    virtual uint32_t getBuiltinOffset(int) const;
 
+   virtual void parseDriverInfo(const struct nv50_ir_prog_info *);
+
    virtual bool isOpSupported(operation, DataType) const;
    virtual bool isReuseSupported(const Instruction *) const;
 
@@ -23,8 +25,15 @@ public:
    virtual bool canDualIssue(const Instruction *, const Instruction *) const;
    virtual int getLatency(const Instruction *) const;
    virtual int getReadLatency(const Instruction *) const;
+   virtual int getThroughput(const Instruction *) const;
+   int getResultLatency(const Instruction *) const;
+   virtual bool getTimings(struct nv50_ir_timing *) const;
+   int getTimingClass(const Instruction *) const;
 
    virtual bool isCS2RSV(SVSemantic) const;
+
+private:
+   struct nv50_ir_timing timings[NV50_IR_TIMING_COUNT];
 };
 
 } // namespace nv50_ir
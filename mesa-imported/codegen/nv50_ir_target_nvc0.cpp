@@ -269,7 +269,10 @@ TargetNVC0::getFileSize(DataFile file) const
    const unsigned int smregs = (chipset >= NVISA_GK104_CHIPSET) ? 65536 : 32768;
    switch (file) {
    case FILE_NULL:          return 0;
-   case FILE_GPR:           return MIN2(gprs, smregs / threads);
+   case FILE_GPR:
+      if (gprBudget)
+         return MIN3(gprs, smregs / threads, gprBudget);
+      return MIN2(gprs, smregs / threads);
    case FILE_PREDICATE:     return 7;
    case FILE_FLAGS:         return 1;
    case FILE_ADDRESS:       return 0;
@@ -24,6 +24,83 @@
 
 namespace nv50_ir {
 
+Arena::~Arena()
+{
+   for (Chunk *next, *chunk = chunks; chunk; chunk = next) {
+      next = chunk->next;
+      util_time_report_mem(-(ptrdiff_t)chunk->size);
+      FREE(chunk);
+   }
+}
+
+void *
+Arena::allocateChunk(size_t size, bool current)
+{
+   const size_t headerSize = (sizeof(Chunk) + ALIGN - 1) & ~(ALIGN - 1);
+
+   Chunk *chunk = (Chunk *)MALLOC(headerSize + size);
+   if (!chunk)
+      return NULL;
+   chunk->size = headerSize + size;
+   reserved += chunk->size;
+   util_time_report_mem(chunk->size);
+
+   // Oversized blocks get a chunk of their own, which goes after the current
+   // one so that the space left in it can still be used.
+   if (current || !chunks) {
+      chunk->next = chunks;
+      chunks = chunk;
+   } else {
+      chunk->next = chunks->next;
+      chunks->next = chunk;
+   }
+
+   uint8_t *mem = (uint8_t *)chunk + headerSize;
+   if (current) {
+      pos = mem;
+      end = mem + size;
+   }
+   return mem;
+}
+
+void *
+Arena::allocate(size_t size)
+{
+   size = size ? (size + ALIGN - 1) & ~(ALIGN - 1) : ALIGN;
+
+   if (size <= MAX_RECYCLED_SIZE) {
+      void *&list = freeLists[size / ALIGN - 1];
+      if (list) {
+         void *ret = list;
+         list = *(void **)list;
+         return ret;
+      }
+   }
+
+   if (size > (size_t)(end - pos)) {
+      if (size > CHUNK_SIZE / 4)
+         return allocateChunk(size, false);
+      if (!allocateChunk(CHUNK_SIZE, true))
+         return NULL;
+   }
+
+   void *ret = pos;
+   pos += size;
+   return ret;
+}
+
+void
+Arena::release(void *ptr, size_t size)
+{
+   // Larger blocks are only reclaimed when the arena is destroyed.
+   size = size ? (size + ALIGN - 1) & ~(ALIGN - 1) : ALIGN;
+   if (size <= MAX_RECYCLED_SIZE) {
+      void *&list = freeLists[size / ALIGN - 1];
+      *(void **)ptr = list;
+      list = ptr;
+   }
+}
+
 void DLList::clear()
 {
    for (Item *next, *item = head.next; item != &head; item = next) {
@@ -239,6 +316,21 @@ BitSet& BitSet::operator|=(const BitSet &set)
    return *this;
 }
 
+int BitSet::findSet(unsigned int i) const
+{
+   if (i >= size)
+      return -1;
+
+   unsigned int w = i / 32;
+   uint32_t bits = data[w] & ~((1u << (i % 32)) - 1);
+   while (!bits) {
+      if (++w >= (size + 31) / 32)
+         return -1;
+      bits = data[w];
+   }
+   return w * 32 + ffs(bits) - 1;
+}
+
 bool BitSet::resize(unsigned int nBits)
 {
    if (!data || !nBits)
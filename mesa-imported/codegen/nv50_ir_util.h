@@ -26,8 +26,10 @@
 #include <new>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <memory>
 #include <map>
+#include <vector>
 
 #ifndef NDEBUG
 # include <typeinfo>
@@ -35,6 +37,7 @@
 
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
+#include "util/u_time_report.h"
 
 #define ERROR(args...) debug_printf("ERROR: " args)
 #define WARN(args...) debug_printf("WARNING: " args)
@@ -547,6 +550,9 @@ public:
 
    BitSet& operator|=(const BitSet&);
 
+   // Find the first set bit at or after i, returns -1 if there is none.
+   int findSet(unsigned int i) const;
+
    BitSet& operator=(const BitSet& set)
    {
       assert(data && set.data);
@@ -576,6 +582,53 @@ private:
    unsigned int size;
 };
 
+// Set of integers below a fixed bound (value ids, usually) that only costs
+// time proportional to its number of elements to iterate over or clear, not
+// to the bound. Insertion, removal and membership tests are O(1). Removal
+// doesn't preserve the order of the remaining elements.
+class SparseSet
+{
+public:
+   SparseSet() : count(0) { }
+
+   inline void allocate(unsigned int bound)
+   {
+      sparse.assign(bound, 0);
+      dense.resize(bound);
+      count = 0;
+   }
+
+   inline unsigned int getSize() const { return count; }
+   inline int operator[](unsigned int i) const { return dense[i]; }
+
+   inline bool test(unsigned int i) const
+   {
+      assert(i < sparse.size());
+      return sparse[i] < count && dense[sparse[i]] == i;
+   }
+   inline void set(unsigned int i)
+   {
+      if (!test(i)) {
+         sparse[i] = count;
+         dense[count++] = i;
+      }
+   }
+   inline void clr(unsigned int i)
+   {
+      if (test(i)) {
+         const unsigned int last = dense[--count];
+         dense[sparse[i]] = last;
+         sparse[last] = sparse[i];
+      }
+   }
+   inline void clear() { count = 0; }
+
+private:
+   std::vector<unsigned int> sparse; // position in dense
+   std::vector<unsigned int> dense;
+   unsigned int count;
+};
+
 void Interval::checkTail() const
 {
 #if NV50_DEBUG & NV50_DEBUG_PROG_RA
@@ -586,61 +639,105 @@ void Interval::checkTail() const
 #endif
 }
 
-class MemoryPool
+// Memory arena backing all allocations of a compilation. Memory is carved out
+// of large chunks, which are only given back to the system (all at once) when
+// the arena is destroyed. Small blocks released before that are recycled.
+class Arena
 {
-private:
-   inline bool enlargeAllocationsArray(const unsigned int id, unsigned int nr)
+public:
+   Arena() : chunks(NULL), pos(NULL), end(NULL), reserved(0)
    {
-      const unsigned int size = sizeof(uint8_t *) * id;
-      const unsigned int incr = sizeof(uint8_t *) * nr;
-
-      uint8_t **alloc = (uint8_t **)REALLOC(allocArray, size, size + incr);
-      if (!alloc)
-         return false;
-      allocArray = alloc;
-      return true;
+      memset(freeLists, 0, sizeof(freeLists));
    }
+   ~Arena();
+
+   // 16 byte aligned, returns NULL if out of memory
+   void *allocate(size_t size);
+   void release(void *ptr, size_t size);
+
+   // memory obtained from the system, which is also the high-water mark
+   size_t getReservedSize() const { return reserved; }
 
-   inline bool enlargeCapacity()
+private:
+   static const size_t ALIGN = 16;
+   static const size_t CHUNK_SIZE = 64 << 10;
+   static const size_t MAX_RECYCLED_SIZE = 512;
+
+   struct Chunk
    {
-      const unsigned int id = count >> objStepLog2;
+      Chunk *next;
+      size_t size;
+   };
+
+   void *allocateChunk(size_t size, bool current);
 
-      uint8_t *const mem = (uint8_t *)MALLOC(objSize << objStepLog2);
+   Chunk *chunks;
+   uint8_t *pos; // free space left in the current chunk
+   uint8_t *end;
+   void *freeLists[MAX_RECYCLED_SIZE / ALIGN]; // released blocks by size
+   size_t reserved;
+};
+
+// STL allocator drawing memory from an Arena, or from the heap if there is
+// none (e.g. for temporary objects that don't belong to a Program).
+template<typename T>
+class ArenaAllocator
+{
+public:
+   typedef T value_type;
+
+   ArenaAllocator(Arena *arena = NULL) : arena(arena) { }
+   template<typename U>
+   ArenaAllocator(const ArenaAllocator<U>& that) : arena(that.arena) { }
+
+   T *allocate(size_t n)
+   {
+      if (!arena)
+         return static_cast<T *>(::operator new(n * sizeof(T)));
+      void *mem = arena->allocate(n * sizeof(T));
       if (!mem)
-         return false;
+         throw std::bad_alloc();
+      return static_cast<T *>(mem);
+   }
 
-      if (!(id % 32)) {
-         if (!enlargeAllocationsArray(id, 32)) {
-            FREE(mem);
-            return false;
-         }
-      }
-      allocArray[id] = mem;
-      return true;
+   void deallocate(T *ptr, size_t n)
+   {
+      if (arena)
+         arena->release(ptr, n * sizeof(T));
+      else
+         ::operator delete(ptr);
    }
 
-public:
-   MemoryPool(unsigned int size, unsigned int incr) : objSize(size),
-                                                      objStepLog2(incr)
+   template<typename U>
+   bool operator==(const ArenaAllocator<U>& that) const
    {
-      allocArray = NULL;
-      released = NULL;
-      count = 0;
+      return arena == that.arena;
+   }
+   template<typename U>
+   bool operator!=(const ArenaAllocator<U>& that) const
+   {
+      return arena != that.arena;
    }
 
-   ~MemoryPool()
+   Arena *arena;
+};
+
+class MemoryPool
+{
+public:
+   // Objects are allocated in groups of (1 << incr), from the given arena
+   // or from a private one.
+   MemoryPool(unsigned int size, unsigned int incr, Arena *arena = NULL)
+      : objSize(size), objStepLog2(incr), arena(arena ? arena : &ownArena)
    {
-      unsigned int allocCount = (count + (1 << objStepLog2) - 1) >> objStepLog2;
-      for (unsigned int i = 0; i < allocCount && allocArray[i]; ++i)
-         FREE(allocArray[i]);
-      if (allocArray)
-         FREE(allocArray);
+      next = NULL;
+      left = 0;
+      released = NULL;
    }
 
    void *allocate()
    {
       void *ret;
-      const unsigned int mask = (1 << objStepLog2) - 1;
 
       if (released) {
          ret = released;
@@ -648,12 +745,16 @@ public:
          return ret;
       }
 
-      if (!(count & mask))
-         if (!enlargeCapacity())
+      if (!left) {
+         next = (uint8_t *)arena->allocate(objSize << objStepLog2);
+         if (!next)
             return NULL;
+         left = 1 << objStepLog2;
+      }
 
-      ret = allocArray[count >> objStepLog2] + (count & mask) * objSize;
-      ++count;
+      ret = next;
+      next += objSize;
+      --left;
       return ret;
    }
 
@@ -664,14 +765,16 @@ public:
    }
 
 private:
-   uint8_t **allocArray; // array (list) of MALLOC allocations
+   uint8_t *next; // next free object in the current group
+   unsigned int left; // number of free objects in the current group
 
    void *released; // list of released objects
 
-   unsigned int count; // highest allocated object
-
    const unsigned int objSize;
    const unsigned int objStepLog2;
+
+   Arena ownArena;
+   Arena *const arena;
 };
 
 /**
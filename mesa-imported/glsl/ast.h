@@ -1179,6 +1179,9 @@ public:
 
    ast_node *body;
 
+   /** Unroll hint from a preceding pragma (see ir_loop::unroll_hint) */
+   int unroll_hint;
+
    /**
     * Generate IR from the condition of a loop
     *
@@ -776,11 +776,12 @@ no_matching_function_error(const char *name,
                            exec_list *actual_parameters,
                            _mesa_glsl_parse_state *state)
 {
-   gl_shader *sh = _mesa_glsl_get_builtin_function_shader();
-
+   /* Built-ins are materialized on demand (possibly by other threads), so
+    * they must be looked up through the locked accessor.
+    */
    if (state->symbols->get_function(name) == NULL
        && (!state->uses_builtin_functions
-           || sh->symbols->get_function(name) == NULL)) {
+           || _mesa_glsl_get_builtin_function(name) == NULL)) {
       _mesa_glsl_error(loc, state, "no function with name '%s'", name);
    } else {
       char *str = prototype_string(NULL, name, actual_parameters);
@@ -795,7 +796,7 @@ no_matching_function_error(const char *name,
 
       if (state->uses_builtin_functions) {
          print_function_prototypes(state, loc,
-                                   sh->symbols->get_function(name));
+                                   _mesa_glsl_get_builtin_function(name));
       }
    }
 }
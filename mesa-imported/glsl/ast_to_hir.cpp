@@ -6934,6 +6934,11 @@ ast_iteration_statement::hir(exec_list *instructions,
       init_statement->hir(instructions, state);
 
    ir_loop *const stmt = new(ctx) ir_loop();
+   stmt->unroll_hint = unroll_hint;
+   YYLTYPE loc = this->get_location();
+   stmt->unroll_hint_location.source = loc.source;
+   stmt->unroll_hint_location.line = loc.first_line;
+   stmt->unroll_hint_location.column = loc.first_column;
    instructions->push_tail(stmt);
 
    /* Track the current loop nesting. */
@@ -8390,7 +8395,11 @@ ast_interface_block::hir(exec_list *instructions,
           * validate_intrastage_interface_blocks() from getting confused and
           * thinking there are conflicting definitions of gl_PerVertex in the
           * shader.
+          *
+          * Built-in variables that haven't been looked up yet must be
+          * disabled as well.
           */
+         state->symbols->import_builtin_variables(var_mode);
          foreach_in_list_safe(ir_instruction, node, instructions) {
             ir_variable *const var = node->as_variable();
             if (var != NULL &&
@@ -8445,6 +8454,7 @@ ast_tcs_output_layout::hir(exec_list *instructions,
    /* If any shader outputs occurred before this declaration and did not
     * specify an array size, their size is determined now.
     */
+   state->symbols->import_builtin_variables(ir_var_shader_out);
    foreach_in_list (ir_instruction, node, instructions) {
       ir_variable *var = node->as_variable();
       if (var == NULL || var->data.mode != ir_var_shader_out)
@@ -8498,6 +8508,7 @@ ast_gs_input_layout::hir(exec_list *instructions,
    /* If any shader inputs occurred before this declaration and did not
     * specify an array size, their size is determined now.
     */
+   state->symbols->import_builtin_variables(ir_var_shader_in);
    foreach_in_list(ir_instruction, node, instructions) {
       ir_variable *var = node->as_variable();
       if (var == NULL || var->data.mode != ir_var_shader_in)
@@ -83,6 +83,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #define M_PIf   ((float) M_PI)
 #define M_PI_2f ((float) M_PI_2)
@@ -720,6 +721,7 @@ public:
    void release();
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
+   ir_function *get_function(const char *name);
 
    /**
     * A shader to hold all the built-in signatures; created by this module.
@@ -733,6 +735,24 @@ public:
 private:
    void *mem_ctx;
 
+   /**
+    * Built-in functions are only built the first time a shader refers to
+    * them (by name), since a typical shader uses a handful of the several
+    * thousand signatures available.  Intrinsics are always built upfront,
+    * as the bodies of many built-ins call them.
+    *
+    * While create_builtins() runs on behalf of materialize(), only the
+    * function whose name matches materialize_name is actually built.
+    */
+   const char *materialize_name;
+   struct set *materialized;
+
+   void materialize(const char *name);
+   bool wants_function(const char *name) const
+   {
+      return materialize_name == NULL || strcmp(name, materialize_name) == 0;
+   }
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
@@ -1090,6 +1110,8 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   materialize_name = NULL;
+   materialized = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1110,7 +1132,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1122,6 +1144,33 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   materialize(name);
+   return shader->symbols->get_function(name);
+}
+
+void
+builtin_builder::materialize(const char *name)
+{
+   if (_mesa_set_search(materialized, name) != NULL ||
+       strncmp(name, "__intrinsic_", 12) == 0)
+      return;
+
+   materialize_name = name;
+   create_builtins();
+   materialize_name = NULL;
+
+   /* Only remember names of actual built-ins: user-defined function names
+    * would otherwise pile up for as long as the compiler is alive (e.g. in
+    * server mode).
+    */
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL)
+      _mesa_set_add(materialized, f->name);
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1130,9 +1179,10 @@ builtin_builder::initialize()
       return;
 
    mem_ctx = ralloc_context(NULL);
+   materialized = _mesa_set_create(mem_ctx, _mesa_key_hash_string,
+                                   _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
-   create_builtins();
 }
 
 void
@@ -1140,6 +1190,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   materialized = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1372,6 +1423,13 @@ builtin_builder::create_intrinsics()
 void
 builtin_builder::create_builtins()
 {
+   /* Skip evaluating the signatures of functions that aren't wanted. */
+#define add_function(NAME, ...)                 \
+   do {                                         \
+      if (wants_function(NAME))                 \
+         add_function(NAME, __VA_ARGS__);       \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
@@ -3482,6 +3540,7 @@ builtin_builder::create_builtins()
 #undef FIUD_VEC
 #undef FIUBD_VEC
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -3554,6 +3613,9 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   if (!wants_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -6486,7 +6548,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -6500,6 +6562,17 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
+{
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
+}
+
 gl_shader *
 _mesa_glsl_get_builtin_function_shader()
 {
@@ -31,6 +31,8 @@
 #include "program/prog_statevars.h"
 #include "program/prog_instruction.h"
 #include "builtin_functions.h"
+#include "util/hash_table.h"
+#include "c11/threads.h"
 
 using namespace ir_builder;
 
@@ -356,7 +358,7 @@ per_vertex_accumulator::construct_interface_instance() const
 class builtin_variable_generator
 {
 public:
-   builtin_variable_generator(exec_list *instructions,
+   builtin_variable_generator(glsl_builtin_variables *builtins,
                               struct _mesa_glsl_parse_state *state);
    void generate_constants();
    void generate_uniforms();
@@ -410,7 +412,9 @@ private:
    ir_variable *add_const_ivec3(const char *name, int x, int y, int z);
    void add_varying(int slot, const glsl_type *type, const char *name);
 
-   exec_list * const instructions;
+   void add_to_set(ir_variable *var);
+
+   glsl_builtin_variables * const builtins;
    struct _mesa_glsl_parse_state * const state;
    glsl_symbol_table * const symtab;
 
@@ -439,8 +443,8 @@ private:
 
 
 builtin_variable_generator::builtin_variable_generator(
-   exec_list *instructions, struct _mesa_glsl_parse_state *state)
-   : instructions(instructions), state(state), symtab(state->symbols),
+   glsl_builtin_variables *builtins, struct _mesa_glsl_parse_state *state)
+   : builtins(builtins), state(state), symtab(state->symbols),
      compatibility(state->compat_shader || state->ARB_compatibility_enable),
      bool_t(glsl_type::bool_type), int_t(glsl_type::int_type),
      uint_t(glsl_type::uint_type),
@@ -452,12 +456,25 @@ builtin_variable_generator::builtin_variable_generator(
 {
 }
 
+/**
+ * Add a variable to the set, where shaders look it up by name.  As with
+ * symbol tables, the first variable of a given name wins.
+ */
+void
+builtin_variable_generator::add_to_set(ir_variable *var)
+{
+   builtins->variables.push_tail(var);
+
+   if (!_mesa_hash_table_search(builtins->names, var->name))
+      _mesa_hash_table_insert(builtins->names, var->name, var);
+}
+
 ir_variable *
 builtin_variable_generator::add_index_variable(const char *name,
                                          const glsl_type *type,
                                          enum ir_variable_mode mode, int slot, int index)
 {
-   ir_variable *var = new(symtab) ir_variable(type, name, mode);
+   ir_variable *var = new(builtins) ir_variable(type, name, mode);
    var->data.how_declared = ir_var_declared_implicitly;
 
    switch (var->data.mode) {
@@ -484,12 +501,7 @@ builtin_variable_generator::add_index_variable(const char *name,
    var->data.explicit_index = 1;
    var->data.index = index;
 
-   /* Once the variable is created an initialized, add it to the symbol table
-    * and add the declaration to the IR stream.
-    */
-   instructions->push_tail(var);
-
-   symtab->add_variable(var);
+   add_to_set(var);
    return var;
 }
 
@@ -498,7 +510,7 @@ builtin_variable_generator::add_variable(const char *name,
                                          const glsl_type *type,
                                          enum ir_variable_mode mode, int slot)
 {
-   ir_variable *var = new(symtab) ir_variable(type, name, mode);
+   ir_variable *var = new(builtins) ir_variable(type, name, mode);
    var->data.how_declared = ir_var_declared_implicitly;
 
    switch (var->data.mode) {
@@ -524,12 +536,7 @@ builtin_variable_generator::add_variable(const char *name,
    var->data.explicit_location = (slot >= 0);
    var->data.explicit_index = 0;
 
-   /* Once the variable is created an initialized, add it to the symbol table
-    * and add the declaration to the IR stream.
-    */
-   instructions->push_tail(var);
-
-   symtab->add_variable(var);
+   add_to_set(var);
    return var;
 }
 
@@ -1461,11 +1468,47 @@ builtin_variable_generator::generate_varyings()
 }; /* Anonymous namespace */
 
 
-void
-_mesa_glsl_initialize_variables(exec_list *instructions,
-				struct _mesa_glsl_parse_state *state)
+/* Sets of built-in variables, by shader configuration.  They are never
+ * modified once created, and are freed along with the glsl_types they use.
+ */
+static void *builtin_variables_mem;
+static struct hash_table *builtin_variable_sets;
+static mtx_t builtin_variables_lock = _MTX_INITIALIZER_NP;
+
+/**
+ * Return a key for everything the built-in variables depend on: stage,
+ * version, profile, enabled extensions and implementation constants.
+ */
+static char *
+builtin_variables_key(void *mem_ctx, struct _mesa_glsl_parse_state *state)
 {
-   builtin_variable_generator gen(instructions, state);
+   const struct gl_constants *consts = &state->ctx->Const;
+   unsigned consts_hash =
+      _mesa_hash_data(&state->Const, sizeof(state->Const));
+
+   char *key = ralloc_asprintf(mem_ctx, "%d/%u/%u/%d%d/%08x/%u/%u/%u/%d%d%d%d/",
+                               state->stage, state->language_version,
+                               state->forced_language_version,
+                               state->es_shader, state->compat_shader,
+                               consts_hash, consts->MaxVarying,
+                               consts->Program[MESA_SHADER_VERTEX].MaxOutputComponents,
+                               consts->Program[MESA_SHADER_FRAGMENT].MaxInputComponents,
+                               consts->NoPrimitiveBoundingBoxOutput,
+                               consts->GLSLTessLevelsAsInputs,
+                               consts->GLSLFragCoordIsSysVal,
+                               consts->GLSLFrontFacingIsSysVal);
+   _mesa_glsl_append_extension_flags(state, &key);
+   return key;
+}
+
+static glsl_builtin_variables *
+generate_builtin_variables(void *mem_ctx, struct _mesa_glsl_parse_state *state)
+{
+   glsl_builtin_variables *builtins = new(mem_ctx) glsl_builtin_variables;
+   builtins->names = _mesa_hash_table_create(builtins, _mesa_key_hash_string,
+                                             _mesa_key_string_equal);
+
+   builtin_variable_generator gen(builtins, state);
 
    gen.generate_constants();
    gen.generate_uniforms();
@@ -1495,4 +1538,52 @@ _mesa_glsl_initialize_variables(exec_list *instructions,
    default:
       break;
    }
+
+   return builtins;
+}
+
+/**
+ * Make the built-in variables available to a shader.  Most shaders only use
+ * a few of the hundreds of built-in variables, so rather than adding all of
+ * them to the symbol table and the IR of every shader, they are generated
+ * once for each shader configuration and only copied into the shader when it
+ * looks them up (see glsl_symbol_table::set_builtin_variables).
+ */
+void
+_mesa_glsl_initialize_variables(exec_list *instructions,
+				struct _mesa_glsl_parse_state *state)
+{
+   glsl_builtin_variables *builtins = NULL;
+   char *key = builtin_variables_key(state, state);
+
+   mtx_lock(&builtin_variables_lock);
+   if (builtin_variable_sets == NULL) {
+      builtin_variables_mem = ralloc_context(NULL);
+      builtin_variable_sets =
+         _mesa_hash_table_create(builtin_variables_mem, _mesa_key_hash_string,
+                                 _mesa_key_string_equal);
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(builtin_variable_sets, key);
+   if (entry) {
+      builtins = (glsl_builtin_variables *) entry->data;
+   } else {
+      builtins = generate_builtin_variables(builtin_variables_mem, state);
+      _mesa_hash_table_insert(builtin_variable_sets,
+                              ralloc_strdup(builtins, key), builtins);
+   }
+   mtx_unlock(&builtin_variables_lock);
+
+   ralloc_free(key);
+   state->symbols->set_builtin_variables(builtins, instructions);
+}
+
+void
+_mesa_glsl_release_builtin_variables(void)
+{
+   mtx_lock(&builtin_variables_lock);
+   ralloc_free(builtin_variables_mem);
+   builtin_variables_mem = NULL;
+   builtin_variable_sets = NULL;
+   mtx_unlock(&builtin_variables_lock);
 }
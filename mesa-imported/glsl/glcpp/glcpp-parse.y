@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
 #include <inttypes.h>
 
 #include "glsl/glcpp/glcpp.h" // fincs-edit
@@ -152,6 +153,12 @@ glcpp_parser_lex_from(glcpp_parser_t *parser, token_list_t *list);
 static void
 add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
 
+static void
+add_user_defines(glcpp_parser_t *parser);
+
+static macro_t *
+_glcpp_parser_lookup_macro(glcpp_parser_t *parser, const char *identifier);
+
 %}
 
 %define api.pure // fincs-edit
@@ -174,11 +181,11 @@ add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
         /* We use HASH_TOKEN, DEFINE_TOKEN and VERSION_TOKEN (as opposed to
          * HASH, DEFINE, and VERSION) to avoid conflicts with other symbols,
          * (such as the <HASH> and <DEFINE> start conditions in the lexer). */
-%token DEFINED ELIF_EXPANDED HASH_TOKEN DEFINE_TOKEN FUNC_IDENTIFIER OBJ_IDENTIFIER ELIF ELSE ENDIF ERROR_TOKEN IF IFDEF IFNDEF LINE PRAGMA UNDEF VERSION_TOKEN GARBAGE IDENTIFIER IF_EXPANDED INTEGER INTEGER_STRING LINE_EXPANDED NEWLINE OTHER PLACEHOLDER SPACE PLUS_PLUS MINUS_MINUS
+%token DEFINED ELIF_EXPANDED HASH_TOKEN DEFINE_TOKEN FUNC_IDENTIFIER OBJ_IDENTIFIER ELIF ELSE ENDIF ERROR_TOKEN IF IFDEF IFNDEF INCLUDE LINE PRAGMA UNDEF VERSION_TOKEN GARBAGE IDENTIFIER IF_EXPANDED INTEGER INTEGER_STRING LINE_EXPANDED NEWLINE OTHER PLACEHOLDER SPACE PLUS_PLUS MINUS_MINUS
 %token PASTE
 %type <ival> INTEGER operator SPACE integer_constant version_constant
 %type <expression_value> expression
-%type <str> IDENTIFIER FUNC_IDENTIFIER OBJ_IDENTIFIER INTEGER_STRING OTHER ERROR_TOKEN PRAGMA
+%type <str> IDENTIFIER FUNC_IDENTIFIER OBJ_IDENTIFIER INCLUDE INTEGER_STRING OTHER ERROR_TOKEN PRAGMA
 %type <string_list> identifier_list
 %type <token> preprocessing_token
 %type <token_list> pp_tokens replacement_list text_line
@@ -225,11 +232,16 @@ expanded_line:
 		_glcpp_parser_skip_stack_change_if (parser, & @1, "elif", $2.value);
 	}
 |	LINE_EXPANDED integer_constant NEWLINE {
+		/* The included file cache can't know what this refers to */
+		if (parser->recording)
+			glcpp_recording_invalidate(parser->recording);
 		parser->has_new_line_number = 1;
 		parser->new_line_number = $2;
 		_mesa_string_buffer_printf(parser->output, "#line %" PRIiMAX "\n", $2);
 	}
 |	LINE_EXPANDED integer_constant integer_constant NEWLINE {
+		if (parser->recording)
+			glcpp_recording_invalidate(parser->recording);
 		parser->has_new_line_number = 1;
 		parser->new_line_number = $2;
 		parser->has_new_source_number = 1;
@@ -319,10 +331,29 @@ control_line_success:
 		}
 
 		entry = _mesa_hash_table_search (parser->defines, $3);
+		if (parser->recording)
+			glcpp_recording_read (parser->recording, $3,
+					      entry ? entry->data : NULL);
 		if (entry) {
 			_mesa_hash_table_remove (parser->defines, entry);
+			if (parser->recording)
+				glcpp_recording_write (parser->recording, $3);
 		}
 	}
+|	HASH_TOKEN INCLUDE NEWLINE {
+		/* The token holds the whole directive: include "path" or
+		 * include <path> */
+		char *path = $2 + strlen("include");
+		bool system_path;
+
+		while (*path == ' ' || *path == '\t' || *path == '\v' || *path == '\f')
+			path++;
+		system_path = *path == '<';
+		path++;
+		path[strlen(path) - 1] = '\0';
+
+		glcpp_parser_include (parser, & @1, path, system_path);
+	}
 |	HASH_TOKEN IF pp_tokens NEWLINE {
 		/* Be careful to only evaluate the 'if' expression if
 		 * we are not skipping. When we are skipping, we
@@ -355,15 +386,11 @@ control_line_success:
 		_glcpp_parser_skip_stack_push_if (parser, & @1, 0);
 	}
 |	HASH_TOKEN IFDEF IDENTIFIER junk NEWLINE {
-		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
-		macro_t *macro = entry ? entry->data : NULL;
+		macro_t *macro = _glcpp_parser_lookup_macro(parser, $3);
 		_glcpp_parser_skip_stack_push_if (parser, & @1, macro != NULL);
 	}
 |	HASH_TOKEN IFNDEF IDENTIFIER junk NEWLINE {
-		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
-		macro_t *macro = entry ? entry->data : NULL;
+		macro_t *macro = _glcpp_parser_lookup_macro(parser, $3);
 		_glcpp_parser_skip_stack_push_if (parser, & @3, macro == NULL);
 	}
 |	HASH_TOKEN ELIF pp_tokens NEWLINE {
@@ -1351,6 +1378,138 @@ add_builtin_define(glcpp_parser_t *parser, const char *name, int value)
    _define_object_macro(parser, NULL, name, list);
 }
 
+static bool
+is_identifier(const char *str, size_t len)
+{
+   if (len == 0 || !(isalpha((unsigned char) str[0]) || str[0] == '_'))
+      return false;
+
+   for (size_t i = 1; i < len; i++) {
+      if (!(isalnum((unsigned char) str[i]) || str[i] == '_'))
+         return false;
+   }
+
+   return true;
+}
+
+/* Tokenizes the value of a macro given by the caller, the way the body of a
+ * #define is tokenized. The lexer keeps its state in the parser, so it runs
+ * on a scratch copy of it to leave the state of the shader being lexed alone.
+ */
+static token_list_t *
+_glcpp_parser_lex_user_define(glcpp_parser_t *parser, YYLTYPE *loc,
+                              const char *def, const char *value)
+{
+   glcpp_parser_t lexer = *parser;
+   token_list_t *list = NULL;
+   YYSTYPE yylval;
+   YYLTYPE yylloc;
+   int type;
+
+   lexer.lexing_directive = 0;
+   lexer.lexing_version_directive = 0;
+   lexer.space_tokens = 0;
+   lexer.last_token_was_newline = 0;
+   lexer.last_token_was_space = 0;
+   lexer.first_non_space_token_this_line = 0;
+   lexer.in_define = false;
+   lexer.commented_newlines = 0;
+   lexer.skip_stack = NULL;
+   lexer.error = 0;
+   lexer.has_new_line_number = false;
+   lexer.has_new_source_number = false;
+
+   glcpp_lex_init_extra(&lexer, &lexer.scanner);
+   glcpp_lex_set_source_string(&lexer, value);
+
+   while ((type = glcpp_lex(&yylval, &yylloc, lexer.scanner)) != 0 &&
+          type != NEWLINE) {
+      token_t *tok;
+
+      switch (type) {
+      case IDENTIFIER:
+      case INTEGER_STRING:
+      case OTHER:
+         tok = _token_create_str(parser, type, yylval.str);
+         break;
+      case HASH_TOKEN:
+         glcpp_error(loc, parser, "invalid macro definition \"%s\"\n", def);
+         list = NULL;
+         goto done;
+      default:
+         tok = _token_create_ival(parser, type, type);
+         break;
+      }
+
+      tok->location = yylloc;
+
+      if (list == NULL) {
+         list = _token_list_create(parser);
+         lexer.space_tokens = 1;
+      }
+      _token_list_append(parser, list, tok);
+   }
+
+   if (type == NEWLINE && glcpp_lex(&yylval, &yylloc, lexer.scanner) != 0) {
+      glcpp_error(loc, parser, "invalid macro definition \"%s\"\n", def);
+      list = NULL;
+   }
+
+done:
+   glcpp_lex_destroy(lexer.scanner);
+   if (lexer.error)
+      parser->error = 1;
+
+   return list;
+}
+
+/* Defines the macros given by the caller as "NAME[=VALUE]" strings, as if
+ * by "#define NAME VALUE".
+ */
+static void
+add_user_defines(glcpp_parser_t *parser)
+{
+   YYLTYPE loc;
+   memset(&loc, 0, sizeof(loc));
+
+   if (parser->user_defines == NULL)
+      return;
+
+   for (const char * const *def = parser->user_defines; *def; def++) {
+      const char *eq = strchr(*def, '=');
+      size_t name_len = eq ? (size_t) (eq - *def) : strlen(*def);
+
+      if (!is_identifier(*def, name_len)) {
+         glcpp_error(&loc, parser, "invalid macro definition \"%s\"\n", *def);
+         continue;
+      }
+
+      char *name = linear_alloc_child(parser->linalloc, name_len + 1);
+      memcpy(name, *def, name_len);
+      name[name_len] = '\0';
+
+      token_list_t *list = NULL;
+      if (eq && eq[1])
+         list = _glcpp_parser_lex_user_define(parser, &loc, *def, eq + 1);
+
+      _define_object_macro(parser, &loc, name, list);
+   }
+}
+
+/* Looks up a macro, noting what the included file being recorded (if any)
+ * depends on. */
+static macro_t *
+_glcpp_parser_lookup_macro(glcpp_parser_t *parser, const char *identifier)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(parser->defines, identifier);
+   macro_t *macro = entry ? entry->data : NULL;
+
+   if (parser->recording)
+      glcpp_recording_read(parser->recording, identifier, macro);
+
+   return macro;
+}
+
 /* Initial output buffer size, 4096 minus ralloc() overhead. It was selected
  * to minimize total amount of allocated memory during shader-db run.
  */
@@ -1398,6 +1557,13 @@ glcpp_parser_create(const struct gl_extensions *extension_list,
    parser->api = api;
    parser->version = 0;
    parser->version_set = false;
+   parser->user_defines = NULL;
+
+   parser->include = NULL;
+   parser->include_data = NULL;
+   parser->include_depth = 0;
+   parser->recording = NULL;
+   parser->disable_line_continuations = false;
 
    parser->has_new_line_number = 0;
    parser->new_line_number = 1;
@@ -1593,8 +1759,8 @@ _glcpp_parser_evaluate_defined(glcpp_parser_t *parser, token_node_t *node,
 
    *last = node;
 
-   return _mesa_hash_table_search(parser->defines,
-                                  argument->token->value.str) ? 1 : 0;
+   return _glcpp_parser_lookup_macro(parser,
+                                     argument->token->value.str) ? 1 : 0;
 
 FAIL:
    glcpp_error (&defined->token->location, parser,
@@ -1842,7 +2008,6 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
 {
    token_t *token = node->token;
    const char *identifier;
-   struct hash_entry *entry;
    macro_t *macro;
 
    /* We only expand identifiers */
@@ -1860,14 +2025,17 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
          return _token_list_create_with_one_integer(parser,
                                                     node->token->location.first_line);
 
-      if (strcmp(identifier, "__FILE__") == 0)
+      if (strcmp(identifier, "__FILE__") == 0) {
+         /* Source string numbers aren't fixed for included files */
+         if (parser->recording)
+            glcpp_recording_invalidate(parser->recording);
          return _token_list_create_with_one_integer(parser,
                                                     node->token->location.source);
+      }
    }
 
    /* Look up this identifier in the hash table. */
-   entry = _mesa_hash_table_search(parser->defines, identifier);
-   macro = entry ? entry->data : NULL;
+   macro = _glcpp_parser_lookup_macro(parser, identifier);
 
    /* Not a macro, so no expansion needed. */
    if (macro == NULL)
@@ -2115,7 +2283,6 @@ _define_object_macro(glcpp_parser_t *parser, YYLTYPE *loc,
                      const char *identifier, token_list_t *replacements)
 {
    macro_t *macro, *previous;
-   struct hash_entry *entry;
 
    /* We define pre-defined macros before we've started parsing the actual
     * file. So if there's no location defined yet, that's what were doing and
@@ -2130,8 +2297,7 @@ _define_object_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    macro->identifier = linear_strdup(parser->linalloc, identifier);
    macro->replacements = replacements;
 
-   entry = _mesa_hash_table_search(parser->defines, identifier);
-   previous = entry ? entry->data : NULL;
+   previous = _glcpp_parser_lookup_macro(parser, identifier);
    if (previous) {
       if (_macro_equal (macro, previous)) {
          return;
@@ -2140,6 +2306,8 @@ _define_object_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    }
 
    _mesa_hash_table_insert (parser->defines, identifier, macro);
+   if (parser->recording)
+      glcpp_recording_write(parser->recording, identifier);
 }
 
 void
@@ -2148,7 +2316,6 @@ _define_function_macro(glcpp_parser_t *parser, YYLTYPE *loc,
                        token_list_t *replacements)
 {
    macro_t *macro, *previous;
-   struct hash_entry *entry;
    const char *dup;
 
    _check_for_reserved_macro_name(parser, loc, identifier);
@@ -2165,8 +2332,7 @@ _define_function_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    macro->identifier = linear_strdup(parser->linalloc, identifier);
    macro->replacements = replacements;
 
-   entry = _mesa_hash_table_search(parser->defines, identifier);
-   previous = entry ? entry->data : NULL;
+   previous = _glcpp_parser_lookup_macro(parser, identifier);
    if (previous) {
       if (_macro_equal (macro, previous)) {
          return;
@@ -2175,6 +2341,8 @@ _define_function_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    }
 
    _mesa_hash_table_insert(parser->defines, identifier, macro);
+   if (parser->recording)
+      glcpp_recording_write(parser->recording, identifier);
 }
 
 static int
@@ -2220,9 +2388,7 @@ glcpp_parser_lex(YYSTYPE *yylval, YYLTYPE *yylloc, glcpp_parser_t *parser)
                ret == ENDIF || ret == HASH_TOKEN) {
          parser->in_control_line = 1;
       } else if (ret == IDENTIFIER) {
-         struct hash_entry *entry = _mesa_hash_table_search(parser->defines,
-                                                            yylval->str);
-         macro_t *macro = entry ? entry->data : NULL;
+         macro_t *macro = _glcpp_parser_lookup_macro(parser, yylval->str);
          if (macro && macro->is_function) {
             parser->newline_as_space = 1;
             parser->paren_count = 0;
@@ -2384,6 +2550,8 @@ _glcpp_parser_handle_version_declaration(glcpp_parser_t *parser, intmax_t versio
       }
    }
 
+   add_user_defines(parser);
+
    if (explicitly_set) {
       _mesa_string_buffer_printf(parser->output,
                                  "#version %" PRIiMAX "%s%s", version,
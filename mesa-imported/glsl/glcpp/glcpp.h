@@ -131,6 +131,8 @@ typedef struct argument_list {
 
 typedef struct glcpp_parser glcpp_parser_t;
 
+struct glcpp_include_recording;
+
 typedef enum {
 	TOKEN_CLASS_IDENTIFIER,
 	TOKEN_CLASS_IDENTIFIER_FINALIZED,
@@ -184,6 +186,15 @@ typedef void (*glcpp_extension_iterator)(
 		unsigned version,
 		bool es);
 
+/* Resolves an #include directive. Returns the contents of the file (which
+ * must remain valid until preprocessing is done) or NULL if it can't be
+ * found, and sets the source string number that refers to it. includer is
+ * the source string number of the file containing the directive.
+ */
+typedef const char *(*glcpp_include_func)(void *data, const char *path,
+					  bool system_path, unsigned includer,
+					  unsigned *source_number);
+
 struct glcpp_parser {
 	void *linalloc;
 	yyscan_t scanner;
@@ -213,6 +224,23 @@ struct glcpp_parser {
 	gl_api api;
 	unsigned version;
 
+	/**
+	 * Macros given by the caller, as a NULL-terminated list of
+	 * "NAME[=VALUE]" strings. They are defined right after the
+	 * built-in macros, i.e. once the #version has been resolved.
+	 */
+	const char * const *user_defines;
+
+	/** #include resolution (see glcpp_include_func), NULL if unsupported */
+	glcpp_include_func include;
+	void *include_data;
+	unsigned include_depth;
+
+	/** Records what the file being included depends on (include_cache.c) */
+	struct glcpp_include_recording *recording;
+
+	bool disable_line_continuations;
+
 	/**
 	 * Has the #version been set?
 	 *
@@ -244,7 +272,59 @@ glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser);
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 		 glcpp_extension_iterator extensions, void *state,
-		 struct gl_context *g_ctx);
+		 struct gl_context *g_ctx, const char * const *defines,
+		 glcpp_include_func include, void *include_data);
+
+void
+glcpp_parser_include(glcpp_parser_t *parser, YYLTYPE *loc,
+		     const char *path, bool system_path);
+
+/* Cache of preprocessed #include files (include_cache.c) */
+
+void
+glcpp_include_cache_init(void);
+
+void
+glcpp_include_cache_release(void);
+
+/* Returns the preprocessed text of an included file if it is cached (after
+ * applying its effects on macros), and otherwise NULL along with a new
+ * recording to use while preprocessing it (or NULL if it can't be cached).
+ */
+const char *
+glcpp_include_cache_lookup(glcpp_parser_t *parser, const char *shader,
+			   unsigned source_number,
+			   struct glcpp_include_recording **recording);
+
+/* Caches the included file if possible, frees the recording, and returns
+ * the text to output.
+ */
+const char *
+glcpp_recording_end(struct glcpp_include_recording *rec,
+		    glcpp_parser_t *parser, glcpp_parser_t *inc);
+
+void
+glcpp_recording_read(struct glcpp_include_recording *rec,
+		     const char *identifier, const macro_t *macro);
+
+void
+glcpp_recording_write(struct glcpp_include_recording *rec,
+		      const char *identifier);
+
+void
+glcpp_recording_invalidate(struct glcpp_include_recording *rec);
+
+/* Return the index of a file in the recording (used as a placeholder for
+ * its source string number), or -1 (invalidating the recording). */
+int
+glcpp_recording_add_file(struct glcpp_include_recording *rec,
+			 unsigned includer_source, const char *path,
+			 bool system_path, const char *shader,
+			 unsigned source_number);
+
+int
+glcpp_recording_find_file(struct glcpp_include_recording *rec,
+			  unsigned source_number);
 
 /* Functions for writing to the info log */
 
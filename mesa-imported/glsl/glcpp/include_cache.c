@@ -0,0 +1,477 @@
+/*
+ * Cache of preprocessed #include files.
+ *
+ * The first time a file is included, the macros it looks up (and their
+ * definitions at that point), the macros it defines or undefines, the files
+ * it includes in turn and its preprocessed text are recorded. When the same
+ * file is included again with the same definitions for all the macros it
+ * looks up, the recorded text and macro changes are replayed instead of
+ * preprocessing the file again. This mostly helps large headers shared by
+ * many shaders, or by many permutations of the same shader.
+ *
+ * Source string numbers depend on the order in which a shader includes its
+ * files, so the recorded text refers to them through placeholders, which
+ * are replaced when the text is used.
+ *
+ * The cache is shared by all threads; entries are never modified once
+ * added, and are only freed by glcpp_include_cache_release().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glsl/glcpp/glcpp.h"
+#include "glsl/glcpp/glcpp-parse.h"
+#include "c11/threads.h"
+#include "util/mesa-sha1.h"
+
+/* Upper bound of the memory used by the cache, after which new entries are
+ * no longer added. */
+#define INCLUDE_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* Surrounds the index of a file of the recording in the recorded text. */
+#define SOURCE_PLACEHOLDER '\x01'
+
+struct include_file {
+	unsigned includer;     /* index of the including file */
+	const char *path;
+	bool system_path;
+	unsigned char sha1[20];
+	unsigned source_number;
+};
+
+struct macro_state {
+	const char *identifier;
+	macro_t *macro;        /* NULL if not defined */
+};
+
+struct include_cache_entry {
+	struct include_cache_entry *next;
+	unsigned num_reads;
+	struct macro_state *reads;
+	unsigned num_writes;
+	struct macro_state *writes;
+	unsigned num_files;
+	struct include_file *files; /* files[0] is the included file itself */
+	const char *output;
+};
+
+struct glcpp_include_recording {
+	void *linalloc;
+	char *key;
+	struct hash_table *reads;
+	struct hash_table *writes;
+	unsigned num_files;
+	struct include_file *files;
+	bool valid;
+};
+
+static struct {
+	void *mem;
+	struct hash_table *entries; /* key -> list of include_cache_entry */
+	size_t size;
+} cache;
+
+static mtx_t cache_lock = _MTX_INITIALIZER_NP;
+
+void
+glcpp_include_cache_init(void)
+{
+	mtx_lock(&cache_lock);
+	if (cache.mem == NULL) {
+		cache.mem = ralloc_context(NULL);
+		cache.entries = _mesa_hash_table_create(cache.mem,
+							_mesa_key_hash_string,
+							_mesa_key_string_equal);
+		cache.size = 0;
+	}
+	mtx_unlock(&cache_lock);
+}
+
+void
+glcpp_include_cache_release(void)
+{
+	mtx_lock(&cache_lock);
+	ralloc_free(cache.mem);
+	cache.mem = NULL;
+	cache.entries = NULL;
+	mtx_unlock(&cache_lock);
+}
+
+/* The preprocessed text of a file also depends on the GLSL version and on
+ * whether line continuations are handled. */
+static char *
+_make_key(void *mem_ctx, glcpp_parser_t *parser, const unsigned char sha1[20])
+{
+	char hex[41];
+	_mesa_sha1_format(hex, sha1);
+	return ralloc_asprintf(mem_ctx, "%s/%u%s%s", hex, parser->version,
+			       parser->is_gles ? "es" : "",
+			       parser->disable_line_continuations ? "" : "/lc");
+}
+
+static token_list_t *
+_token_list_copy(void *linalloc, const token_list_t *list)
+{
+	token_list_t *copy;
+	token_node_t *node;
+
+	if (list == NULL)
+		return NULL;
+
+	copy = linear_zalloc_child(linalloc, sizeof(token_list_t));
+	for (node = list->head; node; node = node->next) {
+		token_node_t *copy_node = linear_alloc_child(linalloc, sizeof(token_node_t));
+		token_t *token = linear_alloc_child(linalloc, sizeof(token_t));
+
+		*token = *node->token;
+		if (token->type == IDENTIFIER || token->type == INTEGER_STRING ||
+		    token->type == OTHER)
+			token->value.str = linear_strdup(linalloc, token->value.str);
+
+		copy_node->token = token;
+		copy_node->next = NULL;
+		if (copy->head == NULL)
+			copy->head = copy_node;
+		else
+			copy->tail->next = copy_node;
+		copy->tail = copy_node;
+		if (token->type != SPACE)
+			copy->non_space_tail = copy_node;
+	}
+
+	return copy;
+}
+
+static macro_t *
+_macro_copy(void *linalloc, const macro_t *macro)
+{
+	macro_t *copy;
+
+	if (macro == NULL)
+		return NULL;
+
+	copy = linear_alloc_child(linalloc, sizeof(macro_t));
+	copy->is_function = macro->is_function;
+	copy->identifier = linear_strdup(linalloc, macro->identifier);
+	copy->replacements = _token_list_copy(linalloc, macro->replacements);
+	copy->parameters = NULL;
+
+	if (macro->parameters) {
+		string_node_t *node, **tail;
+
+		copy->parameters = linear_zalloc_child(linalloc, sizeof(string_list_t));
+		tail = &copy->parameters->head;
+		for (node = macro->parameters->head; node; node = node->next) {
+			string_node_t *copy_node = linear_alloc_child(linalloc, sizeof(string_node_t));
+			copy_node->str = linear_strdup(linalloc, node->str);
+			copy_node->next = NULL;
+			*tail = copy_node;
+			tail = &copy_node->next;
+			copy->parameters->tail = copy_node;
+		}
+	}
+
+	return copy;
+}
+
+/* Unlike _macro_equal, spaces matter here: they end up in the output. */
+static bool
+_macro_equal_exact(const macro_t *a, const macro_t *b)
+{
+	const string_node_t *sa, *sb;
+	const token_node_t *ta, *tb;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	if (a->is_function != b->is_function)
+		return false;
+
+	sa = a->parameters ? a->parameters->head : NULL;
+	sb = b->parameters ? b->parameters->head : NULL;
+	for (; sa && sb; sa = sa->next, sb = sb->next) {
+		if (strcmp(sa->str, sb->str) != 0)
+			return false;
+	}
+	if (sa || sb)
+		return false;
+
+	ta = a->replacements ? a->replacements->head : NULL;
+	tb = b->replacements ? b->replacements->head : NULL;
+	for (; ta && tb; ta = ta->next, tb = tb->next) {
+		const token_t *x = ta->token, *y = tb->token;
+		if (x->type != y->type)
+			return false;
+		if (x->type == INTEGER && x->value.ival != y->value.ival)
+			return false;
+		if ((x->type == IDENTIFIER || x->type == INTEGER_STRING ||
+		     x->type == OTHER) && strcmp(x->value.str, y->value.str) != 0)
+			return false;
+	}
+	return ta == NULL && tb == NULL;
+}
+
+static macro_t *
+_lookup_macro(glcpp_parser_t *parser, const char *identifier)
+{
+	struct hash_entry *entry = _mesa_hash_table_search(parser->defines, identifier);
+	return entry ? entry->data : NULL;
+}
+
+/* Replaces the placeholders in a recorded text by source string numbers. */
+static char *
+_resolve_placeholders(void *mem_ctx, const char *text, const struct include_file *files)
+{
+	char *out = ralloc_strdup(mem_ctx, "");
+	const char *start = text, *p;
+
+	while ((p = strchr(start, SOURCE_PLACEHOLDER)) != NULL) {
+		char *end;
+		unsigned index = strtoul(p + 1, &end, 10);
+
+		ralloc_strncat(&out, start, p - start);
+		ralloc_asprintf_append(&out, "%u", files[index].source_number);
+		start = end + 1;
+	}
+
+	ralloc_strcat(&out, start);
+	return out;
+}
+
+static struct glcpp_include_recording *
+_recording_create(glcpp_parser_t *parser, const unsigned char sha1[20],
+		  unsigned source_number)
+{
+	struct glcpp_include_recording *rec;
+
+	rec = rzalloc(NULL, struct glcpp_include_recording);
+	rec->linalloc = linear_alloc_parent(rec, 0);
+	rec->key = _make_key(rec, parser, sha1);
+	rec->reads = _mesa_hash_table_create(rec, _mesa_key_hash_string,
+					     _mesa_key_string_equal);
+	rec->writes = _mesa_hash_table_create(rec, _mesa_key_hash_string,
+					      _mesa_key_string_equal);
+	rec->valid = true;
+
+	rec->files = ralloc_array(rec, struct include_file, 1);
+	rec->files[0].includer = 0;
+	rec->files[0].path = NULL;
+	rec->files[0].system_path = false;
+	memcpy(rec->files[0].sha1, sha1, sizeof(rec->files[0].sha1));
+	rec->files[0].source_number = source_number;
+	rec->num_files = 1;
+
+	return rec;
+}
+
+void
+glcpp_recording_read(struct glcpp_include_recording *rec,
+		     const char *identifier, const macro_t *macro)
+{
+	/* Only the definitions the file starts with matter */
+	if (_mesa_hash_table_search(rec->writes, identifier) ||
+	    _mesa_hash_table_search(rec->reads, identifier))
+		return;
+
+	macro_t *copy = _macro_copy(rec->linalloc, macro);
+	_mesa_hash_table_insert(rec->reads,
+				linear_strdup(rec->linalloc, identifier), copy);
+}
+
+void
+glcpp_recording_write(struct glcpp_include_recording *rec,
+		      const char *identifier)
+{
+	if (!_mesa_hash_table_search(rec->writes, identifier))
+		_mesa_hash_table_insert(rec->writes,
+					linear_strdup(rec->linalloc, identifier), NULL);
+}
+
+void
+glcpp_recording_invalidate(struct glcpp_include_recording *rec)
+{
+	rec->valid = false;
+}
+
+int
+glcpp_recording_add_file(struct glcpp_include_recording *rec,
+			 unsigned includer_source, const char *path,
+			 bool system_path, const char *shader,
+			 unsigned source_number)
+{
+	struct include_file *file;
+	int includer = -1;
+
+	/* Nested files can't be cached if they contain placeholders, nor can
+	 * files whose includer isn't known (after a #line directive) */
+	for (unsigned i = rec->num_files; i-- > 0;) {
+		if (rec->files[i].source_number == includer_source) {
+			includer = i;
+			break;
+		}
+	}
+
+	if (includer < 0 || strchr(shader, SOURCE_PLACEHOLDER) != NULL) {
+		rec->valid = false;
+		return -1;
+	}
+
+	rec->files = reralloc(rec, rec->files, struct include_file, rec->num_files + 1);
+	file = &rec->files[rec->num_files];
+	file->includer = includer;
+	file->path = linear_strdup(rec->linalloc, path);
+	file->system_path = system_path;
+	_mesa_sha1_compute(shader, strlen(shader), file->sha1);
+	file->source_number = source_number;
+
+	return rec->num_files++;
+}
+
+int
+glcpp_recording_find_file(struct glcpp_include_recording *rec,
+			  unsigned source_number)
+{
+	for (unsigned i = rec->num_files; i-- > 0;) {
+		if (rec->files[i].source_number == source_number)
+			return i;
+	}
+
+	rec->valid = false;
+	return -1;
+}
+
+const char *
+glcpp_recording_end(struct glcpp_include_recording *rec,
+		    glcpp_parser_t *parser, glcpp_parser_t *inc)
+{
+	const char *output = _resolve_placeholders(parser, inc->output->buf, rec->files);
+
+	if (!rec->valid || inc->error || inc->info_log->length != 0) {
+		ralloc_free(rec);
+		return output;
+	}
+
+	/* Build the entry in the memory of the recording, and hand it over to
+	 * the cache. */
+	struct include_cache_entry *entry = rzalloc(rec, struct include_cache_entry);
+	unsigned i = 0;
+
+	entry->num_reads = _mesa_hash_table_num_entries(rec->reads);
+	entry->reads = ralloc_array(rec, struct macro_state, entry->num_reads);
+	hash_table_foreach(rec->reads, e) {
+		entry->reads[i].identifier = e->key;
+		entry->reads[i].macro = e->data;
+		i++;
+	}
+
+	i = 0;
+	entry->num_writes = _mesa_hash_table_num_entries(rec->writes);
+	entry->writes = ralloc_array(rec, struct macro_state, entry->num_writes);
+	hash_table_foreach(rec->writes, e) {
+		entry->writes[i].identifier = e->key;
+		entry->writes[i].macro = _macro_copy(rec->linalloc,
+						     _lookup_macro(parser, e->key));
+		i++;
+	}
+
+	entry->num_files = rec->num_files;
+	entry->files = rec->files;
+	entry->output = ralloc_strdup(rec, inc->output->buf);
+
+	size_t size = strlen(entry->output) +
+		      (entry->num_reads + entry->num_writes) * 128 +
+		      entry->num_files * sizeof(struct include_file);
+
+	mtx_lock(&cache_lock);
+	if (cache.mem != NULL && cache.size + size <= INCLUDE_CACHE_MAX_SIZE) {
+		struct hash_entry *list = _mesa_hash_table_search(cache.entries, rec->key);
+		if (list)
+			entry->next = list->data;
+		_mesa_hash_table_insert(cache.entries, rec->key, entry);
+		ralloc_steal(cache.mem, rec);
+		cache.size += size;
+		rec = NULL;
+	}
+	mtx_unlock(&cache_lock);
+
+	ralloc_free(rec);
+	return output;
+}
+
+const char *
+glcpp_include_cache_lookup(glcpp_parser_t *parser, const char *shader,
+			   unsigned source_number,
+			   struct glcpp_include_recording **recording)
+{
+	struct include_cache_entry *entry = NULL;
+	struct include_file *files;
+	unsigned char sha1[20], nested_sha1[20];
+	char *key;
+
+	*recording = NULL;
+	if (cache.mem == NULL || strchr(shader, SOURCE_PLACEHOLDER) != NULL)
+		return NULL;
+
+	_mesa_sha1_compute(shader, strlen(shader), sha1);
+	key = _make_key(parser, parser, sha1);
+
+	mtx_lock(&cache_lock);
+	if (cache.mem != NULL) {
+		struct hash_entry *list = _mesa_hash_table_search(cache.entries, key);
+		for (entry = list ? list->data : NULL; entry; entry = entry->next) {
+			unsigned i;
+			for (i = 0; i < entry->num_reads; i++) {
+				if (!_macro_equal_exact(_lookup_macro(parser, entry->reads[i].identifier),
+							entry->reads[i].macro))
+					break;
+			}
+			if (i == entry->num_reads)
+				break;
+		}
+	}
+	mtx_unlock(&cache_lock);
+	ralloc_free(key);
+
+	if (entry == NULL)
+		goto miss;
+
+	/* The nested files are looked up again, as they may resolve to
+	 * different files now, or have changed since. */
+	files = ralloc_array(parser, struct include_file, entry->num_files);
+	memcpy(files, entry->files, entry->num_files * sizeof(*files));
+	files[0].source_number = source_number;
+
+	for (unsigned i = 1; i < entry->num_files; i++) {
+		const char *nested;
+
+		nested = parser->include(parser->include_data, files[i].path,
+					 files[i].system_path,
+					 files[files[i].includer].source_number,
+					 &files[i].source_number);
+		if (nested == NULL)
+			goto miss;
+
+		_mesa_sha1_compute(nested, strlen(nested), nested_sha1);
+		if (memcmp(nested_sha1, files[i].sha1, sizeof(nested_sha1)) != 0)
+			goto miss;
+	}
+
+	for (unsigned i = 0; i < entry->num_writes; i++) {
+		macro_t *macro = _macro_copy(parser->linalloc, entry->writes[i].macro);
+		struct hash_entry *e =
+			_mesa_hash_table_search(parser->defines, entry->writes[i].identifier);
+
+		if (macro)
+			_mesa_hash_table_insert(parser->defines, macro->identifier, macro);
+		else if (e)
+			_mesa_hash_table_remove(parser->defines, e);
+	}
+
+	return _resolve_placeholders(parser, entry->output, files);
+
+miss:
+	*recording = _recording_create(parser, sha1, source_number);
+	return NULL;
+}
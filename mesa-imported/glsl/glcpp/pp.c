@@ -221,16 +221,134 @@ remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 	return sb->buf;
 }
 
+/* Maximum nesting depth of #include directives, which also catches files
+ * that (directly or not) include themselves.
+ */
+#define MAX_INCLUDE_DEPTH 32
+
+void
+glcpp_parser_include(glcpp_parser_t *parser, YYLTYPE *loc,
+		     const char *path, bool system_path)
+{
+	glcpp_parser_t *inc;
+	struct glcpp_include_recording *rec = NULL;
+	const char *shader, *output;
+	unsigned source_number;
+	int line_adjust, index = -1, includer_index = -1;
+
+	if (parser->include == NULL) {
+		glcpp_error(loc, parser, "#include is not supported\n");
+		return;
+	}
+
+	if (parser->include_depth >= MAX_INCLUDE_DEPTH) {
+		glcpp_error(loc, parser, "#include nested too deeply\n");
+		return;
+	}
+
+	shader = parser->include(parser->include_data, path, system_path,
+				 loc->source, &source_number);
+	if (shader == NULL) {
+		glcpp_error(loc, parser, "cannot find include file \"%s\"\n", path);
+		return;
+	}
+
+	/* Files included by a file being recorded for the cache are recorded
+	 * along with it, with placeholders for their source string numbers.
+	 * Otherwise, the output may be taken from the cache. */
+	if (parser->recording) {
+		index = glcpp_recording_add_file(parser->recording, loc->source,
+						 path, system_path, shader,
+						 source_number);
+		includer_index = glcpp_recording_find_file(parser->recording,
+							   loc->source);
+	} else {
+		output = glcpp_include_cache_lookup(parser, shader, source_number,
+						    &rec);
+		if (output != NULL)
+			goto emit;
+	}
+
+	inc = glcpp_parser_create(parser->extension_list, parser->extensions,
+				  parser->state, parser->api);
+
+	/* The included file sees and defines the same macros as the including
+	 * one, so they must also live in the same memory. */
+	_mesa_hash_table_destroy(inc->defines, NULL);
+	inc->defines = parser->defines;
+	inc->linalloc = parser->linalloc;
+
+	inc->version = parser->version;
+	inc->version_set = true;
+	inc->is_gles = parser->is_gles;
+	inc->include = parser->include;
+	inc->include_data = parser->include_data;
+	inc->include_depth = parser->include_depth + 1;
+	inc->disable_line_continuations = parser->disable_line_continuations;
+	inc->recording = parser->recording ? parser->recording : rec;
+	inc->has_new_source_number = true;
+	inc->new_source_number = source_number;
+
+	if (! inc->disable_line_continuations)
+		shader = remove_line_continuations(inc, shader);
+
+	glcpp_lex_set_source_string(inc, shader);
+	glcpp_parser_parse(inc);
+
+	if (inc->skip_stack)
+		glcpp_error(&inc->skip_stack->loc, inc, "Unterminated #if\n");
+
+	_mesa_string_buffer_append(parser->info_log, inc->info_log->buf);
+	if (inc->error)
+		parser->error = 1;
+
+	if (rec)
+		output = glcpp_recording_end(rec, parser, inc);
+	else
+		output = ralloc_strdup(parser, inc->output->buf);
+
+	inc->defines = NULL;
+	glcpp_parser_destroy(inc);
+
+emit:
+	/* Tell the compiler where the included text comes from, and where the
+	 * including file resumes. Before GLSL 3.30 (except in GLSL ES),
+	 * "#line N" numbers the line following the directive N+1 rather than N.
+	 * The trailing newline is added by the caller, as for any directive. */
+	line_adjust = (parser->version >= 330 || parser->is_gles) ? 0 : 1;
+	if (index >= 0)
+		_mesa_string_buffer_printf(parser->output, "#line %d \x01%d\x01\n",
+					   1 - line_adjust, index);
+	else
+		_mesa_string_buffer_printf(parser->output, "#line %d %u\n",
+					   1 - line_adjust, source_number);
+	_mesa_string_buffer_append(parser->output, output);
+	if (includer_index >= 0)
+		_mesa_string_buffer_printf(parser->output, "#line %d \x01%d\x01",
+					   loc->first_line + 1 - line_adjust,
+					   includer_index);
+	else
+		_mesa_string_buffer_printf(parser->output, "#line %d %d",
+					   loc->first_line + 1 - line_adjust,
+					   loc->source);
+}
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
                  glcpp_extension_iterator extensions, void *state,
-                 struct gl_context *gl_ctx)
+                 struct gl_context *gl_ctx, const char * const *defines,
+                 glcpp_include_func include, void *include_data)
 {
 	int errors;
 	glcpp_parser_t *parser =
 		glcpp_parser_create(&gl_ctx->Extensions, extensions, state, gl_ctx->API);
 
-	if (! gl_ctx->Const.DisableGLSLLineContinuations)
+	parser->user_defines = defines;
+	parser->include = include;
+	parser->include_data = include_data;
+	parser->disable_line_continuations = gl_ctx->Const.DisableGLSLLineContinuations;
+
+	if (! parser->disable_line_continuations)
 		*shader = remove_line_continuations(parser, *shader);
 
 	glcpp_lex_set_source_string (parser, *shader);
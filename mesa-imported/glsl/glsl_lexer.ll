@@ -308,6 +308,30 @@ HASH		^{SPC}#{SPC}
 				  BEGIN PP;
 				  return PRAGMA_INVARIANT_ALL;
 				}
+^{SPC}#{SPC}pragma{SPCP}max_gprs{SPC}\({SPC}{DEC_INT}{SPC}\) {
+				  /* Not a token: the budget is only consumed by
+				   * the code generator, so just record it.
+				   */
+				  yyextra->max_gprs = strtoul(strchr(yytext, '(') + 1, NULL, 10);
+				  BEGIN PRAGMA;
+				}
+^{SPC}#{SPC}pragma{SPCP}unroll{SPC}\({SPC}{DEC_INT}{SPC}\) {
+				  /* An unroll factor of 1 means no unrolling */
+				  long factor = strtol(strchr(yytext, '(') + 1, NULL, 10);
+				  if (factor > INT_MAX)
+				     factor = INT_MAX;
+				  yyextra->pending_unroll_hint = factor > 1 ?
+				     (int) factor : ir_loop::unroll_never;
+				  BEGIN PRAGMA;
+				}
+^{SPC}#{SPC}pragma{SPCP}unroll{SPC}$ {
+				  yyextra->pending_unroll_hint = ir_loop::unroll_full;
+				  BEGIN PRAGMA;
+				}
+^{SPC}#{SPC}pragma{SPCP}nounroll{SPC}$ {
+				  yyextra->pending_unroll_hint = ir_loop::unroll_never;
+				  BEGIN PRAGMA;
+				}
 ^{SPC}#{SPC}pragma{SPCP}	{ BEGIN PRAGMA; }
 
 <PRAGMA>\n			{ BEGIN 0; yylineno++; yycolumn = 0; }
@@ -349,10 +373,23 @@ uint		TYPE(130, 300, 130, 300, glsl_type::uint_type);
 
 break		return BREAK;
 continue	return CONTINUE;
-do		return DO;
-while		return WHILE;
+do		{
+			  /* Loop keywords carry the pending unroll hint */
+			  yylval->n = yyextra->pending_unroll_hint;
+			  yyextra->pending_unroll_hint = ir_loop::unroll_default;
+			  return DO;
+			}
+while		{
+			  yylval->n = yyextra->pending_unroll_hint;
+			  yyextra->pending_unroll_hint = ir_loop::unroll_default;
+			  return WHILE;
+			}
 else		return ELSE;
-for		return FOR;
+for		{
+			  yylval->n = yyextra->pending_unroll_hint;
+			  yyextra->pending_unroll_hint = ir_loop::unroll_default;
+			  return FOR;
+			}
 if		return IF;
 discard		return DISCARD;
 return		return RETURN;
@@ -45,12 +45,6 @@ static void yyerror(YYLTYPE *loc, _mesa_glsl_parse_state *st, const char *msg)
    _mesa_glsl_error(loc, st, "%s", msg);
 }
 
-static int
-_mesa_glsl_lex(YYSTYPE *val, YYLTYPE *loc, _mesa_glsl_parse_state *state)
-{
-   return _mesa_glsl_lexer_lex(val, loc, state->scanner);
-}
-
 static bool match_layout_qualifier(const char *s1, const char *s2,
                                    _mesa_glsl_parse_state *state)
 {
@@ -136,15 +130,33 @@ static bool match_layout_qualifier(const char *s1, const char *s2,
    const glsl_type *type;
 }
 
+%code {
+/* Needs the token values, which are only defined after the prologue */
+static int
+_mesa_glsl_lex(YYSTYPE *val, YYLTYPE *loc, _mesa_glsl_parse_state *state)
+{
+   int token = _mesa_glsl_lexer_lex(val, loc, state->scanner);
+
+   /* An unroll pragma only applies to the loop that immediately follows it;
+    * the loop keywords consume it in the lexer, anything else drops it.
+    */
+   if (token != DO && token != WHILE && token != FOR)
+      state->pending_unroll_hint = ir_loop::unroll_default;
+
+   return token;
+}
+}
+
 %token ATTRIBUTE CONST_TOK
 %token <type> BASIC_TYPE_TOK
-%token BREAK BUFFER CONTINUE DO ELSE FOR IF DISCARD RETURN SWITCH CASE DEFAULT
+%token BREAK BUFFER CONTINUE ELSE IF DISCARD RETURN SWITCH CASE DEFAULT
+%token <n> DO FOR WHILE /* value: pending unroll hint */
 %token CENTROID IN_TOK OUT_TOK INOUT_TOK UNIFORM VARYING SAMPLE
 %token NOPERSPECTIVE FLAT SMOOTH
 %token IMAGE1DSHADOW IMAGE2DSHADOW IMAGE1DARRAYSHADOW IMAGE2DARRAYSHADOW
 %token COHERENT VOLATILE RESTRICT READONLY WRITEONLY
 %token SHARED
-%token STRUCT VOID_TOK WHILE
+%token STRUCT VOID_TOK
 %token <identifier> IDENTIFIER TYPE_IDENTIFIER NEW_IDENTIFIER
 %type <identifier> any_identifier
 %type <interface_block> instance_name_opt
@@ -2673,22 +2685,31 @@ iteration_statement:
    WHILE '(' condition ')' statement_no_new_scope
    {
       void *ctx = state->linalloc;
-      $$ = new(ctx) ast_iteration_statement(ast_iteration_statement::ast_while,
-                                            NULL, $3, NULL, $5);
+      ast_iteration_statement *loop =
+         new(ctx) ast_iteration_statement(ast_iteration_statement::ast_while,
+                                          NULL, $3, NULL, $5);
+      loop->unroll_hint = $1;
+      $$ = loop;
       $$->set_location_range(@1, @4);
    }
    | DO statement WHILE '(' expression ')' ';'
    {
       void *ctx = state->linalloc;
-      $$ = new(ctx) ast_iteration_statement(ast_iteration_statement::ast_do_while,
-                                            NULL, $5, NULL, $2);
+      ast_iteration_statement *loop =
+         new(ctx) ast_iteration_statement(ast_iteration_statement::ast_do_while,
+                                          NULL, $5, NULL, $2);
+      loop->unroll_hint = $1;
+      $$ = loop;
       $$->set_location_range(@1, @6);
    }
    | FOR '(' for_init_statement for_rest_statement ')' statement_no_new_scope
    {
       void *ctx = state->linalloc;
-      $$ = new(ctx) ast_iteration_statement(ast_iteration_statement::ast_for,
-                                            $3, $4.cond, $4.rest, $6);
+      ast_iteration_statement *loop =
+         new(ctx) ast_iteration_statement(ast_iteration_statement::ast_for,
+                                          $3, $4.cond, $4.rest, $6);
+      loop->unroll_hint = $1;
+      $$ = loop;
       $$->set_location_range(@1, @6);
    }
    ;
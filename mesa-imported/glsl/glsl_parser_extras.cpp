@@ -32,6 +32,7 @@
 #include "main/shaderobj.h"
 #include "util/u_atomic.h" /* for p_atomic_cmpxchg */
 #include "util/ralloc.h"
+#include "util/u_time_report.h"
 //#include "util/disk_cache.h" // fincs-edit
 //#include "util/mesa-sha1.h" // fincs-edit
 #include "ast.h"
@@ -198,6 +199,8 @@ _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
    this->toplevel_ir = NULL;
    this->found_return = false;
    this->all_invariant = false;
+   this->max_gprs = 0;
+   this->pending_unroll_hint = ir_loop::unroll_default;
    this->user_structures = NULL;
    this->num_user_structures = 0;
    this->num_subroutines = 0;
@@ -781,6 +784,22 @@ static const _mesa_glsl_extension *find_extension(const char *name)
    return NULL;
 }
 
+void
+_mesa_glsl_append_extension_flags(const _mesa_glsl_parse_state *state,
+                                  char **key)
+{
+   char flags[ARRAY_SIZE(_mesa_glsl_supported_extensions) + 1];
+
+   for (unsigned i = 0; i < ARRAY_SIZE(_mesa_glsl_supported_extensions); ++i) {
+      const _mesa_glsl_extension *extension = &_mesa_glsl_supported_extensions[i];
+      flags[i] = '0' + (state->*(extension->enable_flag) ? 1 : 0) +
+                 (state->*(extension->warn_flag) ? 2 : 0);
+   }
+   flags[ARRAY_SIZE(_mesa_glsl_supported_extensions)] = '\0';
+
+   ralloc_strcat(key, flags);
+}
+
 bool
 _mesa_glsl_process_extension(const char *name, YYLTYPE *name_locp,
 			     const char *behavior_string, YYLTYPE *behavior_locp,
@@ -1679,6 +1698,7 @@ ast_iteration_statement::ast_iteration_statement(int mode,
    this->condition = condition;
    this->rest_expression = rest_expression;
    this->body = body;
+   this->unroll_hint = ir_loop::unroll_default;
 }
 
 
@@ -1881,6 +1901,7 @@ set_shader_inout_layout(struct gl_shader *shader,
    shader->bound_image = state->bound_image_specified;
    shader->redeclares_gl_layer = state->redeclares_gl_layer;
    shader->layer_viewport_relative = state->layer_viewport_relative;
+   shader->MaxGPRs = state->max_gprs;
 }
 
 /* src can be NULL if only the symbols found in the exec_list should be
@@ -2017,9 +2038,8 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
                              ctx->Const.NativeIntegers);
    } else {
       /* Repeat it until it stops making changes. */
-      while (do_common_optimization(shader->ir, false, false, options,
-                                    ctx->Const.NativeIntegers))
-         ;
+      do_common_optimization_loop(shader->ir, false, false, options,
+                                  ctx->Const.NativeIntegers);
    }
 
    validate_ir_tree(shader->ir);
@@ -2104,14 +2124,20 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
                               false, true);
 
+   util_time_report_begin("glcpp_preprocess");
    state->error = glcpp_preprocess(state, &source, &state->info_log,
-                                   add_builtin_defines, state, ctx);
+                                   add_builtin_defines, state, ctx,
+                                   shader->Defines, shader->IncludeFunc,
+                                   shader->IncludeData);
+   util_time_report_end();
 
    if (!state->error) {
+     util_time_report_begin("parse");
      _mesa_glsl_lexer_ctor(state, source);
      _mesa_glsl_parse(state);
      _mesa_glsl_lexer_dtor(state);
      do_late_parsing_checks(state);
+     util_time_report_end();
    }
 
    if (dump_ast) {
@@ -2123,8 +2149,11 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 
    ralloc_free(shader->ir);
    shader->ir = new(shader) exec_list;
-   if (!state->error && !state->translation_unit.is_empty())
+   if (!state->error && !state->translation_unit.is_empty()) {
+      util_time_report_begin("ast_to_hir");
       _mesa_ast_to_hir(shader->ir, state);
+      util_time_report_end();
+   }
 
    if (!state->error) {
       validate_ir_tree(shader->ir);
@@ -2173,7 +2202,162 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    */
 }
 
+/**
+ * Run only the preprocessor on a shader source string.
+ *
+ * The preprocessed text is allocated out of \c mem_ctx. On failure NULL is
+ * returned, and the preprocessor log is stored in \c info_log (if non-NULL).
+ * \c defines is an optional NULL-terminated list of "NAME[=VALUE]" macros,
+ * as in gl_shader::Defines, and \c include resolves #include directives.
+ */
+char *
+_mesa_glsl_preprocess_shader(struct gl_context *ctx, gl_shader_stage stage,
+                             const char *source, void *mem_ctx,
+                             char **info_log, const char * const *defines,
+                             glcpp_include_func include, void *include_data)
+{
+   struct _mesa_glsl_parse_state *state =
+      new(mem_ctx) _mesa_glsl_parse_state(ctx, stage, mem_ctx);
+
+   util_time_report_begin("glcpp_preprocess");
+   int error = glcpp_preprocess(state, &source, &state->info_log,
+                                add_builtin_defines, state, ctx, defines,
+                                include, include_data);
+   util_time_report_end();
+
+   if (info_log)
+      *info_log = state->info_log;
+
+   delete state->symbols;
+   state->symbols = NULL;
+
+   return error ? NULL : (char *) source;
+}
+
 } /* extern "C" */
+
+ir_optimization_tracker::ir_optimization_tracker(unsigned max_iterations)
+   : iterations(0), max_iterations(max_iterations), num_passes(0),
+     generation(1), current(NULL), untracked(false)
+{
+}
+
+bool
+ir_optimization_tracker::begin_pass(const char *name)
+{
+   current = NULL;
+   untracked = false;
+   for (unsigned i = 0; i < num_passes; i++) {
+      if (passes[i].name == name || strcmp(passes[i].name, name) == 0) {
+         current = &passes[i];
+         break;
+      }
+   }
+
+   if (!current) {
+      /* Untracked passes always run, and any progress they make counts
+       * as a change of the IR for all the tracked passes.
+       */
+      if (num_passes == ARRAY_SIZE(passes)) {
+         untracked = true;
+         return true;
+      }
+
+      current = &passes[num_passes++];
+      memset(current, 0, sizeof(*current));
+      current->name = name;
+   }
+
+   if (current->clean_generation == generation) {
+      current->skips++;
+      current = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+void
+ir_optimization_tracker::end_pass(bool progress)
+{
+   if (!current) {
+      if (untracked && progress)
+         generation++;
+      untracked = false;
+      return;
+   }
+
+   current->runs++;
+   if (progress) {
+      current->progress++;
+      current->clean_generation = 0;
+      generation++;
+   } else {
+      current->clean_generation = generation;
+   }
+   current = NULL;
+}
+
+bool
+ir_optimization_tracker::next_iteration(bool progress)
+{
+   iterations++;
+   return progress && iterations < max_iterations;
+}
+
+void
+ir_optimization_tracker::print_stats(FILE *f) const
+{
+   fprintf(f, "GLSL optimization: %u iterations%s\n", iterations,
+           iterations == max_iterations ? " (limit reached)" : "");
+   for (unsigned i = 0; i < num_passes; i++) {
+      fprintf(f, "  %-32s %3u runs, %3u skipped, %3u made progress\n",
+              passes[i].name, passes[i].runs, passes[i].skips,
+              passes[i].progress);
+   }
+}
+
+/**
+ * Analyze loops and unroll them, cleaning up after each round of unrolling.
+ */
+static bool
+do_loop_unrolling(exec_list *ir, const struct gl_shader_compiler_options *options)
+{
+   bool progress = false;
+
+   loop_state *ls = analyze_loop_variables(ir);
+   if (ls->loop_found) {
+      bool loop_progress = unroll_loops(ir, ls, options);
+      while (loop_progress) {
+         progress = true;
+         loop_progress = false;
+         loop_progress |= do_constant_propagation(ir);
+         loop_progress |= do_if_simplification(ir);
+
+         /* Some drivers only call do_common_optimization() once rather
+          * than in a loop. So we must call do_lower_jumps() after
+          * unrolling a loop because for drivers that use LLVM validation
+          * will fail if a jump is not the last instruction in the block.
+          * For example the following will fail LLVM validation:
+          *
+          *   (loop (
+          *      ...
+          *   break
+          *   (assign  (x) (var_ref v124)  (expression int + (var_ref v124)
+          *      (constant int (1)) ) )
+          *   ))
+          */
+         loop_progress |= do_lower_jumps(ir, true, true,
+                                         options->EmitNoMainReturn,
+                                         options->EmitNoCont,
+                                         options->EmitNoLoops);
+      }
+   }
+   delete ls;
+
+   return progress;
+}
+
 /**
  * Do the set of common optimizations passes
  *
@@ -2192,27 +2376,37 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
  *                                    implementations supporting integers
  *                                    natively (as opposed to supporting
  *                                    integers in floating point registers).
+ * \param tracker                     State of the enclosing fixed-point loop,
+ *                                    used to skip passes that can't make
+ *                                    progress.  May be \c NULL.
  */
 bool
 do_common_optimization(exec_list *ir, bool linked,
 		       bool uniform_locations_assigned,
                        const struct gl_shader_compiler_options *options,
-                       bool native_integers)
+                       bool native_integers,
+                       ir_optimization_tracker *tracker)
 {
    const bool debug = false;
    GLboolean progress = GL_FALSE;
+   util_time_report_scope time_report_scope("do_common_optimization");
 
 #define OPT(PASS, ...) do {                                             \
-      if (debug) {                                                      \
+      if (tracker && !tracker->begin_pass(#PASS))                       \
+         break;                                                         \
+      util_time_report_begin(#PASS);                                    \
+      if (debug)                                                        \
          fprintf(stderr, "START GLSL optimization %s\n", #PASS);        \
-         const bool opt_progress = PASS(__VA_ARGS__);                   \
-         progress = opt_progress || progress;                           \
+      const bool opt_progress = PASS(__VA_ARGS__);                      \
+      util_time_report_end();                                           \
+      if (tracker)                                                      \
+         tracker->end_pass(opt_progress);                               \
+      progress = opt_progress || progress;                              \
+      if (debug) {                                                      \
          if (opt_progress)                                              \
             _mesa_print_ir(stderr, ir, NULL);                           \
          fprintf(stderr, "GLSL optimization %s: %s progress\n",         \
                  #PASS, opt_progress ? "made" : "no");                  \
-      } else {                                                          \
-         progress = PASS(__VA_ARGS__) || progress;                      \
       }                                                                 \
    } while (false)
 
@@ -2260,43 +2454,37 @@ do_common_optimization(exec_list *ir, bool linked,
    OPT(optimize_split_arrays, ir, linked);
    OPT(optimize_redundant_jumps, ir);
 
-   if (options->MaxUnrollIterations) {
-      loop_state *ls = analyze_loop_variables(ir);
-      if (ls->loop_found) {
-         bool loop_progress = unroll_loops(ir, ls, options);
-         while (loop_progress) {
-            loop_progress = false;
-            loop_progress |= do_constant_propagation(ir);
-            loop_progress |= do_if_simplification(ir);
-
-            /* Some drivers only call do_common_optimization() once rather
-             * than in a loop. So we must call do_lower_jumps() after
-             * unrolling a loop because for drivers that use LLVM validation
-             * will fail if a jump is not the last instruction in the block.
-             * For example the following will fail LLVM validation:
-             *
-             *   (loop (
-             *      ...
-             *   break
-             *   (assign  (x) (var_ref v124)  (expression int + (var_ref v124)
-             *      (constant int (1)) ) )
-             *   ))
-             */
-            loop_progress |= do_lower_jumps(ir, true, true,
-                                            options->EmitNoMainReturn,
-                                            options->EmitNoCont,
-                                            options->EmitNoLoops);
-         }
-         progress |= loop_progress;
-      }
-      delete ls;
-   }
+   if (options->MaxUnrollIterations)
+      OPT(do_loop_unrolling, ir, options);
 
 #undef OPT
 
    return progress;
 }
 
+/**
+ * Repeat do_common_optimization() until it stops making progress, or until
+ * an iteration limit is reached.  Passes that can't make progress since
+ * they last ran are skipped (see ir_optimization_tracker).
+ */
+void
+do_common_optimization_loop(exec_list *ir, bool linked,
+                            bool uniform_locations_assigned,
+                            const struct gl_shader_compiler_options *options,
+                            bool native_integers)
+{
+   const bool debug = false;
+   ir_optimization_tracker tracker;
+
+   while (tracker.next_iteration(
+             do_common_optimization(ir, linked, uniform_locations_assigned,
+                                    options, native_integers, &tracker)))
+      ;
+
+   if (debug)
+      tracker.print_stats(stderr);
+}
+
 extern "C" {
 
 /**
@@ -603,6 +603,17 @@ struct _mesa_glsl_parse_state {
     */
    bool all_invariant;
 
+   /**
+    * Register budget requested with the 'max_gprs(N)' pragma, or 0 if none.
+    */
+   unsigned max_gprs;
+
+   /**
+    * Unroll hint from an 'unroll', 'unroll(N)' or 'nounroll' pragma, which
+    * applies to the next loop statement (see ir_loop::unroll_hint).
+    */
+   int pending_unroll_hint;
+
    /** Loop or switch statement containing the current instructions. */
    class ast_iteration_statement *loop_nesting_ast;
 
@@ -975,6 +986,13 @@ extern bool _mesa_glsl_process_extension(const char *name, YYLTYPE *name_locp,
                                          YYLTYPE *behavior_locp,
                                          _mesa_glsl_parse_state *state);
 
+/**
+ * Append the behavior set by #extension directives for every supported
+ * extension to \c key (one character per extension).
+ */
+extern void _mesa_glsl_append_extension_flags(const _mesa_glsl_parse_state *state,
+                                              char **key);
+
 #endif /* __cplusplus */
 
 
@@ -994,10 +1012,20 @@ typedef void (*glcpp_extension_iterator)(
               unsigned version,
               bool es);
 
+typedef const char *(*glcpp_include_func)(void *data, const char *path,
+                                          bool system_path, unsigned includer,
+                                          unsigned *source_number);
+
 extern int glcpp_preprocess(void *ctx, const char **shader, char **info_log,
                             glcpp_extension_iterator extensions,
                             struct _mesa_glsl_parse_state *state,
-                            struct gl_context *gl_ctx);
+                            struct gl_context *gl_ctx,
+                            const char * const *defines,
+                            glcpp_include_func include, void *include_data);
+
+/* Cache of preprocessed #include files, shared by all compilations */
+extern void glcpp_include_cache_init(void);
+extern void glcpp_include_cache_release(void);
 
 extern void _mesa_destroy_shader_compiler(void);
 extern void _mesa_destroy_shader_compiler_caches(void);
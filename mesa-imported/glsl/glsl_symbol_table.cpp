@@ -24,6 +24,7 @@
 
 #include "glsl_symbol_table.h"
 #include "ast.h"
+#include "util/hash_table.h"
 
 class symbol_table_entry {
 public:
@@ -107,6 +108,8 @@ glsl_symbol_table::glsl_symbol_table()
    this->table = _mesa_symbol_table_ctor();
    this->mem_ctx = ralloc_context(NULL);
    this->linalloc = linear_alloc_parent(this->mem_ctx, 0);
+   this->builtins = NULL;
+   this->builtin_instructions = NULL;
 }
 
 glsl_symbol_table::~glsl_symbol_table()
@@ -264,8 +267,54 @@ int glsl_symbol_table::get_default_precision_qualifier(const char *type_name)
 
 symbol_table_entry *glsl_symbol_table::get_entry(const char *name)
 {
-   return (symbol_table_entry *)
+   symbol_table_entry *entry = (symbol_table_entry *)
       _mesa_symbol_table_find_symbol(table, name);
+
+   if (entry == NULL && builtins != NULL && is_gl_identifier(name))
+      entry = import_builtin_variable(name);
+
+   return entry;
+}
+
+void
+glsl_symbol_table::set_builtin_variables(const glsl_builtin_variables *builtins,
+                                         exec_list *instructions)
+{
+   this->builtins = builtins;
+   this->builtin_instructions = instructions;
+}
+
+symbol_table_entry *
+glsl_symbol_table::import_builtin_variable(const char *name)
+{
+   struct hash_entry *builtin = _mesa_hash_table_search(builtins->names, name);
+   if (builtin == NULL)
+      return NULL;
+
+   /* Built-in variables live in the outermost scope, and are declared at
+    * the top of the IR, as if they had all been added before parsing.
+    */
+   ir_variable *var = ((const ir_variable *) builtin->data)->clone(this, NULL);
+   builtin_instructions->push_head(var);
+
+   symbol_table_entry *entry = new(linalloc) symbol_table_entry(var);
+   int added = _mesa_symbol_table_add_global_symbol(table, var->name, entry);
+   assert(added == 0);
+   (void)added;
+   return entry;
+}
+
+void
+glsl_symbol_table::import_builtin_variables(enum ir_variable_mode mode)
+{
+   if (builtins == NULL)
+      return;
+
+   foreach_in_list(const ir_variable, builtin, &builtins->variables) {
+      if (builtin->data.mode == mode &&
+          _mesa_symbol_table_find_symbol(table, builtin->name) == NULL)
+         import_builtin_variable(builtin->name);
+   }
 }
 
 void
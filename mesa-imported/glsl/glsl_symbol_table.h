@@ -33,6 +33,18 @@
 class symbol_table_entry;
 struct glsl_type;
 
+/**
+ * Built-in variables of a shader configuration, shared by all the shaders
+ * with that configuration (see _mesa_glsl_initialize_variables).  They must
+ * not be modified, shaders get copies of them.
+ */
+struct glsl_builtin_variables {
+   DECLARE_RALLOC_CXX_OPERATORS(glsl_builtin_variables)
+
+   exec_list variables;
+   struct hash_table *names; /**< name -> ir_variable */
+};
+
 /**
  * Facade class for _mesa_symbol_table
  *
@@ -102,12 +114,29 @@ struct glsl_symbol_table {
     */
    void replace_variable(const char *name, ir_variable *v);
 
+   /**
+    * Make built-in variables visible at global scope.  A copy of each of them
+    * is added to the table and to \c instructions when it is first looked up.
+    */
+   void set_builtin_variables(const glsl_builtin_variables *builtins,
+                              exec_list *instructions);
+
+   /**
+    * Add copies of all the built-in variables of the given mode that haven't
+    * been looked up yet, for code that walks the IR to update them all.
+    */
+   void import_builtin_variables(enum ir_variable_mode mode);
+
 private:
    symbol_table_entry *get_entry(const char *name);
+   symbol_table_entry *import_builtin_variable(const char *name);
 
    struct _mesa_symbol_table *table;
    void *mem_ctx;
    void *linalloc;
+
+   const glsl_builtin_variables *builtins;
+   exec_list *builtin_instructions;
 };
 
 #endif /* GLSL_SYMBOL_TABLE */
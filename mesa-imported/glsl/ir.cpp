@@ -1365,8 +1365,11 @@ ir_constant::is_uint16_constant() const
 }
 
 ir_loop::ir_loop()
-   : ir_instruction(ir_type_loop)
+   : ir_instruction(ir_type_loop), unroll_hint(unroll_default)
 {
+   unroll_hint_location.source = 0;
+   unroll_hint_location.line = 0;
+   unroll_hint_location.column = 0;
 }
 
 
@@ -1428,6 +1428,28 @@ public:
 
    /** List of ir_instruction that make up the body of the loop. */
    exec_list body_instructions;
+
+   enum {
+      unroll_default = 0, /**< Left to the unroller's cost model */
+      unroll_never = -1,  /**< #pragma nounroll */
+      unroll_full = -2,   /**< #pragma unroll */
+   };
+
+   /**
+    * Unrolling requested with a pragma: one of the values above, or a
+    * positive partial unroll factor (#pragma unroll(N)).
+    */
+   int unroll_hint;
+
+   /**
+    * Source location of the loop, used to report a partial unroll factor
+    * that couldn't be honored (the unroller leaves such a factor in place).
+    */
+   struct {
+      unsigned source;
+      unsigned line;
+      unsigned column;
+   } unroll_hint_location;
 };
 
 
@@ -2426,6 +2448,9 @@ extern void
 _mesa_glsl_initialize_variables(exec_list *instructions,
 				struct _mesa_glsl_parse_state *state);
 
+extern void
+_mesa_glsl_release_builtin_variables(void);
+
 extern void
 reparent_ir(exec_list *list, void *mem_ctx);
 
@@ -130,6 +130,8 @@ ir_loop *
 ir_loop::clone(void *mem_ctx, struct hash_table *ht) const
 {
    ir_loop *new_loop = new(mem_ctx) ir_loop();
+   new_loop->unroll_hint = this->unroll_hint;
+   new_loop->unroll_hint_location = this->unroll_hint_location;
 
    foreach_in_list(ir_instruction, ir, &this->body_instructions) {
       new_loop->body_instructions.push_tail(ir->clone(mem_ctx, ht));
@@ -30,6 +30,8 @@
 #ifndef GLSL_IR_OPTIMIZATION_H
 #define GLSL_IR_OPTIMIZATION_H
 
+#include <stdio.h>
+
 struct gl_linked_shader;
 struct gl_shader_program;
 
@@ -89,10 +91,60 @@ enum lower_packing_builtins_op {
    LOWER_PACK_USE_BFE                   = 0x0800,
 };
 
+/**
+ * State of a do_common_optimization() fixed-point loop.
+ *
+ * Passes are deterministic, so a pass which made no progress can't make any
+ * until some other pass changes the IR.  Each pass remembers the generation
+ * of the IR (the number of passes that made progress so far) at which it
+ * last made no progress, and is skipped for as long as the generation stays
+ * the same.  Statistics about each pass are kept as well.
+ */
+class ir_optimization_tracker {
+public:
+   ir_optimization_tracker(unsigned max_iterations = 64);
+
+   /**
+    * Returns whether the named pass can make progress, in which case it must
+    * be followed by a call to end_pass().  The name must have static storage
+    * duration.
+    */
+   bool begin_pass(const char *name);
+   void end_pass(bool progress);
+
+   /** Returns whether another iteration of the loop should be run. */
+   bool next_iteration(bool progress);
+
+   void print_stats(FILE *f) const;
+
+   unsigned iterations;
+   unsigned max_iterations;
+
+private:
+   struct pass_stats {
+      const char *name;
+      unsigned clean_generation; /**< 0 if the pass may make progress */
+      unsigned runs;
+      unsigned skips;
+      unsigned progress;
+   };
+
+   pass_stats passes[32];
+   unsigned num_passes;
+   unsigned generation;
+   pass_stats *current;
+   bool untracked; /**< the current pass didn't fit in passes[] */
+};
+
 bool do_common_optimization(exec_list *ir, bool linked,
 			    bool uniform_locations_assigned,
                             const struct gl_shader_compiler_options *options,
-                            bool native_integers);
+                            bool native_integers,
+                            ir_optimization_tracker *tracker = NULL);
+void do_common_optimization_loop(exec_list *ir, bool linked,
+                                 bool uniform_locations_assigned,
+                                 const struct gl_shader_compiler_options *options,
+                                 bool native_integers);
 
 bool ir_constant_fold(ir_rvalue **rvalue);
 
@@ -90,6 +90,8 @@ ir_print_visitor::ir_print_visitor(FILE *f)
    : f(f)
 {
    indentation = 0;
+   next_parameter = 1;
+   next_suffix = 1;
    printable_names = _mesa_pointer_hash_table_create(NULL);
    symbols = _mesa_symbol_table_ctor();
    mem_ctx = ralloc_context(NULL);
@@ -117,8 +119,7 @@ ir_print_visitor::unique_name(ir_variable *var)
     * names hash because this is the only scope where it can ever appear.
     */
    if (var->name == NULL) {
-      static unsigned arg = 1;
-      return ralloc_asprintf(this->mem_ctx, "parameter@%u", arg++);
+      return ralloc_asprintf(this->mem_ctx, "parameter@%u", next_parameter++);
    }
 
    /* Do we already have a name for this variable? */
@@ -134,8 +135,7 @@ ir_print_visitor::unique_name(ir_variable *var)
    if (_mesa_symbol_table_find_symbol(this->symbols, var->name) == NULL) {
       name = var->name;
    } else {
-      static unsigned i = 1;
-      name = ralloc_asprintf(this->mem_ctx, "%s@%u", var->name, ++i);
+      name = ralloc_asprintf(this->mem_ctx, "%s@%u", var->name, ++next_suffix);
    }
    _mesa_hash_table_insert(this->printable_names, var, (void *) name);
    _mesa_symbol_table_add_symbol(this->symbols, name, var);
@@ -84,6 +84,13 @@ private:
    hash_table *printable_names;
    _mesa_symbol_table *symbols;
 
+   /**
+    * Counters for generated names, per visitor rather than global since IR
+    * may be printed from several compiler threads at once.
+    */
+   unsigned next_parameter;
+   unsigned next_suffix;
+
    void *mem_ctx;
    FILE *f;
 
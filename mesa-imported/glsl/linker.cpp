@@ -4885,10 +4885,9 @@ linker_optimisation_loop(struct gl_context *ctx, exec_list *ir,
                                 ctx->Const.NativeIntegers);
       } else {
          /* Repeat it until it stops making changes. */
-         while (do_common_optimization(ir, true, false,
-                                       &ctx->Const.ShaderCompilerOptions[stage],
-                                       ctx->Const.NativeIntegers))
-            ;
+         do_common_optimization_loop(ir, true, false,
+                                     &ctx->Const.ShaderCompilerOptions[stage],
+                                     ctx->Const.NativeIntegers);
       }
 }
 
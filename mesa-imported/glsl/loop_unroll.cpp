@@ -27,6 +27,11 @@
 
 #include "main/mtypes.h"
 
+/* Largest factor used when partially unrolling a loop that is too large to
+ * be fully unrolled, and wasn't given an explicit factor with a pragma.
+ */
+#define MAX_AUTO_PARTIAL_UNROLL 4
+
 namespace {
 
 class loop_unroll_visitor : public ir_hierarchical_visitor {
@@ -41,6 +46,7 @@ public:
 
    virtual ir_visitor_status visit_leave(ir_loop *ir);
    void simple_unroll(ir_loop *ir, int iterations);
+   bool partial_unroll(ir_loop *ir, int iterations, int factor);
    void complex_unroll(ir_loop *ir, int iterations,
                        bool continue_from_then_branch,
                        bool limiting_term_first,
@@ -242,6 +248,69 @@ loop_unroll_visitor::simple_unroll(ir_loop *ir, int iterations)
 }
 
 
+/**
+ * Partially unroll a loop by replicating its body \c factor times, keeping a
+ * single copy of the limiting terminator at the top.  For example, if the
+ * input is:
+ *
+ *     (loop ((if (cond) (break)) ...instrs...))
+ *
+ * And the factor is 2, the output will be:
+ *
+ *     (loop ((if (cond) (break)) ...instrs... ...instrs...))
+ *
+ * This is only valid when the iteration count is a multiple of the factor,
+ * so that the terminator can only fire at the top of the new body, and when
+ * the limiting terminator is the only jump out of the loop.  Returns false
+ * if the loop doesn't have that shape.
+ */
+bool
+loop_unroll_visitor::partial_unroll(ir_loop *ir, int iterations, int factor)
+{
+   void *const mem_ctx = ralloc_parent(ir);
+   loop_variable_state *const ls = this->state->get(ir);
+
+   if (ls->num_loop_jumps != 1 || iterations % factor != 0)
+      return false;
+
+   ir_if *limit_if = ls->limiting_terminator->ir;
+   if (limit_if != ((ir_instruction *) ir->body_instructions.get_head())->as_if())
+      return false;
+
+   /* The terminator must consist of nothing but the break. */
+   exec_list *const break_list = is_break((ir_instruction *)
+      limit_if->then_instructions.get_tail()) ?
+      &limit_if->then_instructions : &limit_if->else_instructions;
+   exec_list *const cont_list = break_list == &limit_if->then_instructions ?
+      &limit_if->else_instructions : &limit_if->then_instructions;
+   if (!cont_list->is_empty() ||
+       break_list->get_head() != break_list->get_tail())
+      return false;
+
+   exec_list unrolled;
+   unrolled.make_empty();
+   for (int i = 1; i < factor; i++) {
+      exec_list copy_list;
+
+      copy_list.make_empty();
+      clone_ir_list(mem_ctx, &copy_list, &ir->body_instructions);
+
+      /* Only the original terminator is kept. */
+      ((ir_instruction *) copy_list.get_head())->remove();
+      unrolled.append_list(&copy_list);
+   }
+   ir->body_instructions.append_list(&unrolled);
+
+   /* The induction variable is now updated several times per iteration, so
+    * the loop can't be analyzed (nor unrolled) any further.
+    */
+   ir->unroll_hint = ir_loop::unroll_never;
+
+   this->progress = true;
+   return true;
+}
+
+
 /**
  * Unroll a loop whose last statement is an ir_if.  If \c
  * continue_from_then_branch is true, the loop is repeated only when the
@@ -464,6 +533,9 @@ loop_unroll_visitor::visit_leave(ir_loop *ir)
       return visit_continue;
    }
 
+   if (ir->unroll_hint == ir_loop::unroll_never)
+      return visit_continue;
+
    int iterations = ls->limiting_terminator->iterations;
 
    const int max_iterations = options->MaxUnrollIterations;
@@ -473,16 +545,43 @@ loop_unroll_visitor::visit_leave(ir_loop *ir)
    if (iterations > max_iterations)
       return visit_continue;
 
-   /* Don't try to unroll nested loops and loops with a huge body.
+   /* An explicit unroll factor smaller than the iteration count means
+    * partial unrolling, which is done regardless of the size budget.  If the
+    * loop doesn't have the required shape the factor is left on the loop,
+    * so that the pragma can be reported as having had no effect.
+    */
+   if (ir->unroll_hint > 0 && ir->unroll_hint < iterations) {
+      partial_unroll(ir, iterations, ir->unroll_hint);
+      return visit_continue;
+   }
+
+   /* Don't try to unroll nested loops, and weigh the size of the unrolled
+    * loop against the budget unless full unrolling was requested.
     */
    loop_unroll_count count(&ir->body_instructions, ls, options);
 
+   const uint64_t max_size = options->MaxUnrollSize ?
+      options->MaxUnrollSize : (uint64_t) max_iterations * 5;
+   const uint64_t unrolled_size = (uint64_t) count.nodes * iterations;
+   const bool full_requested = ir->unroll_hint != ir_loop::unroll_default;
+
    bool loop_too_large =
-      count.nested_loop || count.nodes * iterations > max_iterations * 5;
+      count.nested_loop || (!full_requested && unrolled_size > max_size);
 
    if (loop_too_large && !count.unsupported_variable_indexing &&
-       !count.array_indexed_by_induction_var_with_exact_iterations)
+       !count.array_indexed_by_induction_var_with_exact_iterations) {
+      /* Unroll by a small factor instead, if that fits in the budget. */
+      if (!count.nested_loop && !full_requested) {
+         for (int factor = MAX_AUTO_PARTIAL_UNROLL; factor > 1; factor--) {
+            if (iterations % factor == 0 &&
+                (uint64_t) count.nodes * factor <= max_size) {
+               partial_unroll(ir, iterations, factor);
+               break;
+            }
+         }
+      }
       return visit_continue;
+   }
 
    /* Note: the limiting terminator contributes 1 to ls->num_loop_jumps.
     * We'll be removing the limiting terminator before we unroll.
@@ -25,6 +25,8 @@
 #ifndef GLSL_PROGRAM_H
 #define GLSL_PROGRAM_H
 
+#include "compiler/shader_enums.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,6 +39,14 @@ extern void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 			  bool dump_ast, bool dump_hir, bool force_recompile);
 
+extern char *
+_mesa_glsl_preprocess_shader(struct gl_context *ctx, gl_shader_stage stage,
+                             const char *source, void *mem_ctx,
+                             char **info_log, const char * const *defines,
+                             const char *(*include)(void *, const char *, bool,
+                                                    unsigned, unsigned *),
+                             void *include_data);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -2605,6 +2605,14 @@ struct gl_shader
 #endif
    const GLchar *Source;  /**< Source code string */
 
+   /** Extra "NAME[=VALUE]" macros for the preprocessor (NULL-terminated) */
+   const char * const *Defines;
+
+   /** #include resolution for the preprocessor (see glcpp_include_func) */
+   const char *(*IncludeFunc)(void *data, const char *path, bool system_path,
+                              unsigned includer, unsigned *source_number);
+   void *IncludeData;
+
    const GLchar *FallbackSource;  /**< Fallback string used by on-disk cache*/
 
    GLchar *InfoLog;
@@ -2659,6 +2667,12 @@ struct gl_shader
    bool redeclares_gl_layer;
    bool layer_viewport_relative;
 
+   /**
+    * Register budget for the code generator, from the 'max_gprs' pragma
+    * (0 if not specified).
+    */
+   unsigned MaxGPRs;
+
    /** Global xfb_stride out qualifier if any */
    GLuint TransformFeedbackBufferStride[MAX_FEEDBACK_BUFFERS];
 
@@ -3174,6 +3188,7 @@ struct gl_shader_compiler_options
 
    GLuint MaxIfDepth;               /**< Maximum nested IF blocks */
    GLuint MaxUnrollIterations;
+   GLuint MaxUnrollSize;            /**< Budget in IR nodes for unrolled loops (0 = MaxUnrollIterations*5) */
 
    /**
     * Optimize code for array of structures backends.
@@ -249,7 +249,8 @@ _mesa_opcode_string(enum prog_opcode opcode)
    if (opcode < MAX_OPCODE)
       return InstInfo[opcode].Name;
    else {
-      static char s[20];
+      /* Per thread, as programs may be compiled concurrently. */
+      static _Thread_local char s[20];
       _mesa_snprintf(s, sizeof(s), "OP%u", opcode);
       return s;
    }
@@ -213,7 +213,7 @@ static unsigned is_precise(const ir_variable *ir)
 }
 
 class variable_storage {
-   DECLARE_RZALLOC_CXX_OPERATORS(variable_storage)
+   DECLARE_LINEAR_ZALLOC_CXX_OPERATORS(variable_storage)
 
 public:
    variable_storage(ir_variable *var, gl_register_file file, int index,
@@ -237,6 +237,8 @@ public:
 
 class immediate_storage : public exec_node {
 public:
+   DECLARE_LINEAR_ALLOC_CXX_OPERATORS(immediate_storage)
+
    immediate_storage(gl_constant_value *values, int size32, GLenum type)
    {
       memcpy(this->values, values, size32 * sizeof(gl_constant_value));
@@ -336,6 +338,7 @@ public:
    bool image_wr[PIPE_MAX_SHADER_IMAGES];
    bool indirect_addr_consts;
    int wpos_transform_const;
+   int in_array; /* nesting depth of array constants being visited */
 
    bool native_integers;
    bool have_sqrt;
@@ -491,6 +494,7 @@ public:
    void print_stats();
 
    void *mem_ctx;
+   void *linalloc; /**< for objects that live as long as the visitor */
 };
 
 static st_dst_reg address_reg = st_dst_reg(PROGRAM_ADDRESS, WRITEMASK_X,
@@ -536,7 +540,7 @@ glsl_to_tgsi_visitor::emit_asm(ir_instruction *ir, enum tgsi_opcode op,
                                st_src_reg src0, st_src_reg src1,
                                st_src_reg src2, st_src_reg src3)
 {
-   glsl_to_tgsi_instruction *inst = new(mem_ctx) glsl_to_tgsi_instruction();
+   glsl_to_tgsi_instruction *inst = new(linalloc) glsl_to_tgsi_instruction();
    int num_reladdr = 0, i, j;
    bool dst_is_64bit[2];
 
@@ -701,7 +705,7 @@ glsl_to_tgsi_visitor::emit_asm(ir_instruction *ir, enum tgsi_opcode op,
             dinst = inst;
          } else {
             /* create a new instructions for subsequent attempts */
-            dinst = new(mem_ctx) glsl_to_tgsi_instruction();
+            dinst = new(linalloc) glsl_to_tgsi_instruction();
             *dinst = *inst;
             dinst->next = NULL;
             dinst->prev = NULL;
@@ -1040,7 +1044,7 @@ glsl_to_tgsi_visitor::add_constant(gl_register_file file,
    for (i = 0; i * 4 < size32; i++) {
       int slot_size = MIN2(size32 - (i * 4), 4);
       /* Add this immediate to the list. */
-      entry = new(mem_ctx) immediate_storage(&values[i * 4],
+      entry = new(linalloc) immediate_storage(&values[i * 4],
                                              slot_size, datatype);
       this->immediates.push_tail(entry);
       this->num_immediates++;
@@ -1258,7 +1262,7 @@ glsl_to_tgsi_visitor::visit(ir_variable *ir)
       st_dst_reg dst;
       if (i == ir->get_num_state_slots()) {
          /* We'll set the index later. */
-         storage = new(mem_ctx) variable_storage(ir, PROGRAM_STATE_VAR, -1);
+         storage = new(linalloc) variable_storage(ir, PROGRAM_STATE_VAR, -1);
 
          _mesa_hash_table_insert(this->variables, ir, storage);
 
@@ -1272,7 +1276,7 @@ glsl_to_tgsi_visitor::visit(ir_variable *ir)
 
          dst = st_dst_reg(get_temp(ir->type));
 
-         storage = new(mem_ctx) variable_storage(ir, dst.file, dst.index,
+         storage = new(linalloc) variable_storage(ir, dst.file, dst.index,
                                                  dst.array_id);
 
          _mesa_hash_table_insert(this->variables, ir, storage);
@@ -2601,7 +2605,7 @@ glsl_to_tgsi_visitor::visit(ir_dereference_variable *ir)
    if (!entry) {
       switch (var->data.mode) {
       case ir_var_uniform:
-         entry = new(mem_ctx) variable_storage(var, PROGRAM_UNIFORM,
+         entry = new(linalloc) variable_storage(var, PROGRAM_UNIFORM,
                                                var->data.param_index);
          _mesa_hash_table_insert(this->variables, var, entry);
          break;
@@ -2644,7 +2648,7 @@ glsl_to_tgsi_visitor::visit(ir_dereference_variable *ir)
          else
             decl->size = type_size(var->type);
 
-         entry = new(mem_ctx) variable_storage(var,
+         entry = new(linalloc) variable_storage(var,
                                                PROGRAM_INPUT,
                                                decl->mesa_index,
                                                decl->array_id);
@@ -2701,10 +2705,10 @@ glsl_to_tgsi_visitor::visit(ir_dereference_variable *ir)
             st_src_reg src = st_src_reg(PROGRAM_OUTPUT, decl->mesa_index,
                                         var->type, component, decl->array_id);
             emit_asm(NULL, TGSI_OPCODE_FBFETCH, dst, src);
-            entry = new(mem_ctx) variable_storage(var, dst.file, dst.index,
+            entry = new(linalloc) variable_storage(var, dst.file, dst.index,
                                                   dst.array_id);
          } else {
-            entry = new(mem_ctx) variable_storage(var,
+            entry = new(linalloc) variable_storage(var,
                                                   PROGRAM_OUTPUT,
                                                   decl->mesa_index,
                                                   decl->array_id);
@@ -2716,7 +2720,7 @@ glsl_to_tgsi_visitor::visit(ir_dereference_variable *ir)
          break;
       }
       case ir_var_system_value:
-         entry = new(mem_ctx) variable_storage(var,
+         entry = new(linalloc) variable_storage(var,
                                                PROGRAM_SYSTEM_VALUE,
                                                var->data.location);
          break;
@@ -2724,7 +2728,7 @@ glsl_to_tgsi_visitor::visit(ir_dereference_variable *ir)
       case ir_var_temporary:
          st_src_reg src = get_temp(var->type);
 
-         entry = new(mem_ctx) variable_storage(var, src.file, src.index,
+         entry = new(linalloc) variable_storage(var, src.file, src.index,
                                                src.array_id);
          _mesa_hash_table_insert(this->variables, var, entry);
 
@@ -3268,7 +3272,6 @@ glsl_to_tgsi_visitor::visit(ir_constant *ir)
    gl_constant_value *values = (gl_constant_value *) stack_vals;
    GLenum gl_type = GL_NONE;
    unsigned int i, elements;
-   static int in_array = 0;
    gl_register_file file = in_array ? PROGRAM_CONSTANT : PROGRAM_IMMEDIATE;
 
    /* Unfortunately, 4 floats is all we can get into
@@ -3479,7 +3482,7 @@ glsl_to_tgsi_visitor::visit_atomic_counter_intrinsic(ir_call *ir)
                         location->data.binding);
 
       if (!entry) {
-         entry = new(mem_ctx) variable_storage(location, PROGRAM_HW_ATOMIC,
+         entry = new(linalloc) variable_storage(location, PROGRAM_HW_ATOMIC,
                                                num_atomics);
          _mesa_hash_table_insert(this->variables, location, entry);
 
@@ -4630,8 +4633,9 @@ glsl_to_tgsi_visitor::visit(ir_texture *ir)
 
    if (ir->offset) {
       if (!inst->tex_offsets)
-         inst->tex_offsets = rzalloc_array(inst, st_src_reg,
-                                           MAX_GLSL_TEXTURE_OFFSET);
+         inst->tex_offsets = (st_src_reg *)
+            linear_zalloc_child(linalloc, sizeof(st_src_reg) *
+                                          MAX_GLSL_TEXTURE_OFFSET);
 
       for (i = 0; i < MAX_GLSL_TEXTURE_OFFSET &&
                   offset[i].file != PROGRAM_UNDEFINED; i++)
@@ -4750,8 +4754,10 @@ glsl_to_tgsi_visitor::glsl_to_tgsi_visitor()
    images_used = 0;
    indirect_addr_consts = false;
    wpos_transform_const = -1;
+   in_array = 0;
    native_integers = false;
    mem_ctx = ralloc_context(NULL);
+   linalloc = linear_alloc_parent(mem_ctx, 0);
    ctx = NULL;
    prog = NULL;
    precise = 0;
@@ -4766,16 +4772,10 @@ glsl_to_tgsi_visitor::glsl_to_tgsi_visitor()
    variables = NULL;
 }
 
-static void var_destroy(struct hash_entry *entry)
-{
-   variable_storage *storage = (variable_storage *)entry->data;
-
-   delete storage;
-}
-
 glsl_to_tgsi_visitor::~glsl_to_tgsi_visitor()
 {
-   _mesa_hash_table_destroy(variables, var_destroy);
+   /* The variable storage entries are freed along with linalloc. */
+   _mesa_hash_table_destroy(variables, NULL);
    free(array_sizes);
    ralloc_free(mem_ctx);
 }
@@ -5515,7 +5515,6 @@ glsl_to_tgsi_visitor::eliminate_dead_code(void)
 
       if ((inst->dst[0].writemask & ~inst->dead_mask) == 0) {
          inst->remove();
-         delete inst;
          removed++;
       } else {
          if (glsl_base_type_is_64bit(inst->dst[0].type)) {
@@ -5537,7 +5536,7 @@ glsl_to_tgsi_visitor::eliminate_dead_code(void)
 void
 glsl_to_tgsi_visitor::merge_two_dsts(void)
 {
-   /* We never delete inst, but we may delete its successor. */
+   /* We never remove inst, but we may remove its successor. */
    foreach_in_list(glsl_to_tgsi_instruction, inst, &this->instructions) {
       glsl_to_tgsi_instruction *inst2;
       unsigned defined;
@@ -5581,7 +5580,6 @@ glsl_to_tgsi_visitor::merge_two_dsts(void)
 
       inst->dst[defined ^ 1] = inst2->dst[defined ^ 1];
       inst2->remove();
-      delete inst2;
    }
 }
 
@@ -7547,13 +7545,20 @@ st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
          } while (has_unsupported_control_flow(ir, options));
       } else {
          /* Repeat it until it stops making changes. */
+         ir_optimization_tracker tracker;
          bool progress;
          do {
             progress = do_common_optimization(ir, true, true, options,
-                                              ctx->Const.NativeIntegers);
-            progress |= lower_if_to_cond_assign((gl_shader_stage)i, ir,
-                                                options->MaxIfDepth, if_threshold);
-         } while (progress);
+                                              ctx->Const.NativeIntegers,
+                                              &tracker);
+            if (tracker.begin_pass("lower_if_to_cond_assign")) {
+               bool if_progress =
+                  lower_if_to_cond_assign((gl_shader_stage)i, ir,
+                                          options->MaxIfDepth, if_threshold);
+               tracker.end_pass(if_progress);
+               progress |= if_progress;
+            }
+         } while (tracker.next_iteration(progress));
       }
 
       /* Do this again to lower ir_binop_vector_extract introduced
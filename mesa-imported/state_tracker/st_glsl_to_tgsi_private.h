@@ -121,9 +121,12 @@ bool operator == (const st_dst_reg& lhs, const st_dst_reg& rhs);
 std::ostream& operator << (std::ostream& os, const st_dst_reg& reg);
 
 
+/* Instructions are allocated from the visitor's linear allocator, and are
+ * never freed individually.
+ */
 class glsl_to_tgsi_instruction : public exec_node {
 public:
-   DECLARE_RALLOC_CXX_OPERATORS(glsl_to_tgsi_instruction)
+   DECLARE_LINEAR_ALLOC_CXX_OPERATORS(glsl_to_tgsi_instruction)
 
    st_dst_reg dst[2];
    st_src_reg src[4];
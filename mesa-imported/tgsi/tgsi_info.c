@@ -25,6 +25,8 @@
  * 
  **************************************************************************/
 
+#include <pthread.h>
+
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "tgsi_info.h"
@@ -50,21 +52,25 @@ static const struct tgsi_opcode_info opcode_info[TGSI_OPCODE_LAST] =
 #undef OPCODE
 #undef OPCODE_GAP
 
+static void
+check_opcode_info(void)
+{
+   unsigned i;
+   for (i = 0; i < ARRAY_SIZE(opcode_info); i++)
+      assert(opcode_info[i].opcode == i);
+}
+
 const struct tgsi_opcode_info *
 tgsi_get_opcode_info(enum tgsi_opcode opcode)
 {
-   static boolean firsttime = 1;
+   /* Several shaders may be translated concurrently. */
+   static pthread_once_t checked = PTHREAD_ONCE_INIT;
 
    ASSERT_BITFIELD_SIZE(struct tgsi_opcode_info, opcode, TGSI_OPCODE_LAST - 1);
    ASSERT_BITFIELD_SIZE(struct tgsi_opcode_info, output_mode,
                         TGSI_OUTPUT_OTHER);
 
-   if (firsttime) {
-      unsigned i;
-      firsttime = 0;
-      for (i = 0; i < ARRAY_SIZE(opcode_info); i++)
-         assert(opcode_info[i].opcode == i);
-   }
+   pthread_once(&checked, check_opcode_info);
    
    if (opcode < TGSI_OPCODE_LAST)
       return &opcode_info[opcode];
@@ -826,17 +826,14 @@ scan_property(struct tgsi_shader_info *info,
 
 
 /**
- * Scan the given TGSI shader to collect information such as number of
- * registers used, special instructions used, etc.
- * \return info  the result of the scan
+ * Start scanning a TGSI shader token by token, for callers that parse the
+ * tokens themselves.  Each token must then be passed to tgsi_scan_token(),
+ * and the scan completed by tgsi_scan_shader_end().
  */
 void
-tgsi_scan_shader(const struct tgsi_token *tokens,
-                 struct tgsi_shader_info *info)
+tgsi_scan_shader_begin(struct tgsi_shader_info *info, unsigned processor)
 {
-   uint procType, i;
-   struct tgsi_parse_context parse;
-   unsigned current_depth = 0;
+   uint i;
 
    memset(info, 0, sizeof(*info));
    for (i = 0; i < TGSI_FILE_COUNT; i++)
@@ -847,55 +844,55 @@ tgsi_scan_shader(const struct tgsi_token *tokens,
    for (i = 0; i < ARRAY_SIZE(info->sampler_targets); i++)
       info->sampler_targets[i] = TGSI_TEXTURE_UNKNOWN;
 
-   /**
-    ** Setup to begin parsing input shader
-    **/
-   if (tgsi_parse_init( &parse, tokens ) != TGSI_PARSE_OK) {
-      debug_printf("tgsi_parse_init() failed in tgsi_scan_shader()!\n");
-      return;
-   }
-   procType = parse.FullHeader.Processor.Processor;
-   assert(procType == PIPE_SHADER_FRAGMENT ||
-          procType == PIPE_SHADER_VERTEX ||
-          procType == PIPE_SHADER_GEOMETRY ||
-          procType == PIPE_SHADER_TESS_CTRL ||
-          procType == PIPE_SHADER_TESS_EVAL ||
-          procType == PIPE_SHADER_COMPUTE);
-   info->processor = procType;
-   info->num_tokens = tgsi_num_tokens(parse.Tokens);
-
-   /**
-    ** Loop over incoming program tokens/instructions
-    */
-   while (!tgsi_parse_end_of_tokens(&parse)) {
-      tgsi_parse_token( &parse );
+   assert(processor == PIPE_SHADER_FRAGMENT ||
+          processor == PIPE_SHADER_VERTEX ||
+          processor == PIPE_SHADER_GEOMETRY ||
+          processor == PIPE_SHADER_TESS_CTRL ||
+          processor == PIPE_SHADER_TESS_EVAL ||
+          processor == PIPE_SHADER_COMPUTE);
+   info->processor = processor;
+}
 
-      switch( parse.FullToken.Token.Type ) {
-      case TGSI_TOKEN_TYPE_INSTRUCTION:
-         scan_instruction(info, &parse.FullToken.FullInstruction,
-                          &current_depth);
-         break;
-      case TGSI_TOKEN_TYPE_DECLARATION:
-         scan_declaration(info, &parse.FullToken.FullDeclaration);
-         break;
-      case TGSI_TOKEN_TYPE_IMMEDIATE:
-         scan_immediate(info);
-         break;
-      case TGSI_TOKEN_TYPE_PROPERTY:
-         scan_property(info, &parse.FullToken.FullProperty);
-         break;
-      default:
-         assert(!"Unexpected TGSI token type");
-      }
+/**
+ * Scan one token.  \p current_depth is the control flow nesting depth,
+ * which starts at 0.
+ */
+void
+tgsi_scan_token(struct tgsi_shader_info *info,
+                const union tgsi_full_token *token,
+                unsigned *current_depth)
+{
+   switch (token->Token.Type) {
+   case TGSI_TOKEN_TYPE_INSTRUCTION:
+      scan_instruction(info, &token->FullInstruction, current_depth);
+      break;
+   case TGSI_TOKEN_TYPE_DECLARATION:
+      scan_declaration(info, &token->FullDeclaration);
+      break;
+   case TGSI_TOKEN_TYPE_IMMEDIATE:
+      scan_immediate(info);
+      break;
+   case TGSI_TOKEN_TYPE_PROPERTY:
+      scan_property(info, &token->FullProperty);
+      break;
+   default:
+      assert(!"Unexpected TGSI token type");
    }
+}
 
+/**
+ * Finish a token by token scan.
+ */
+void
+tgsi_scan_shader_end(struct tgsi_shader_info *info)
+{
    info->uses_kill = (info->opcode_count[TGSI_OPCODE_KILL_IF] ||
                       info->opcode_count[TGSI_OPCODE_KILL]);
 
    /* The dimensions of the IN decleration in geometry shader have
     * to be deduced from the type of the input primitive.
     */
-   if (procType == PIPE_SHADER_GEOMETRY) {
+   if (info->processor == PIPE_SHADER_GEOMETRY) {
       unsigned input_primitive =
             info->properties[TGSI_PROPERTY_GS_INPUT_PRIM];
       int num_verts = u_vertices_per_prim(input_primitive);
@@ -907,6 +904,40 @@ tgsi_scan_shader(const struct tgsi_token *tokens,
          info->file_mask[TGSI_FILE_INPUT] |= (1 << j);
       }
    }
+}
+
+/**
+ * Scan the given TGSI shader to collect information such as number of
+ * registers used, special instructions used, etc.
+ * \return info  the result of the scan
+ */
+void
+tgsi_scan_shader(const struct tgsi_token *tokens,
+                 struct tgsi_shader_info *info)
+{
+   struct tgsi_parse_context parse;
+   unsigned current_depth = 0;
+
+   /**
+    ** Setup to begin parsing input shader
+    **/
+   if (tgsi_parse_init( &parse, tokens ) != TGSI_PARSE_OK) {
+      debug_printf("tgsi_parse_init() failed in tgsi_scan_shader()!\n");
+      memset(info, 0, sizeof(*info));
+      return;
+   }
+   tgsi_scan_shader_begin(info, parse.FullHeader.Processor.Processor);
+   info->num_tokens = tgsi_num_tokens(parse.Tokens);
+
+   /**
+    ** Loop over incoming program tokens/instructions
+    */
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token( &parse );
+      tgsi_scan_token(info, &parse.FullToken, &current_depth);
+   }
+
+   tgsi_scan_shader_end(info);
 
    tgsi_parse_free(&parse);
 }
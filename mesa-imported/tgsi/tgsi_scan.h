@@ -204,6 +204,19 @@ extern void
 tgsi_scan_shader(const struct tgsi_token *tokens,
                  struct tgsi_shader_info *info);
 
+union tgsi_full_token;
+
+void
+tgsi_scan_shader_begin(struct tgsi_shader_info *info, unsigned processor);
+
+void
+tgsi_scan_token(struct tgsi_shader_info *info,
+                const union tgsi_full_token *token,
+                unsigned *current_depth);
+
+void
+tgsi_scan_shader_end(struct tgsi_shader_info *info);
+
 void
 tgsi_scan_arrays(const struct tgsi_token *tokens,
                  unsigned file,
@@ -35,6 +35,7 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 #endif
 
 #include "ralloc.h"
+#include "u_time_report.h"
 
 #ifndef va_copy
 #ifdef __va_copy
@@ -66,6 +67,12 @@ struct
    unsigned canary;
 #endif
 
+   /* Size of the user data, for memory accounting (see u_time_report.h),
+    * truncated to 32 bits. Next to the canary, it fits in what used to be
+    * alignment padding on LP64 in both debug and release builds.
+    */
+   unsigned size;
+
    struct ralloc_header *parent;
 
    /* The first child (head of a linked list) */
@@ -133,6 +140,8 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
+   info->size = size;
+   util_time_report_mem(info->size + sizeof(ralloc_header));
 
    parent = ctx != NULL ? get_header(ctx) : NULL;
 
@@ -161,6 +170,7 @@ static void *
 resize(void *ptr, size_t size)
 {
    ralloc_header *child, *old, *info;
+   ptrdiff_t old_size;
 
    old = get_header(ptr);
    info = realloc(old, size + sizeof(ralloc_header));
@@ -168,6 +178,10 @@ resize(void *ptr, size_t size)
    if (info == NULL)
       return NULL;
 
+   old_size = info->size;
+   info->size = size;
+   util_time_report_mem((ptrdiff_t)info->size - old_size);
+
    /* Update parent and sibling's links to the reallocated node. */
    if (info != old && info->parent != NULL) {
       if (info->parent->child == old)
@@ -271,6 +285,7 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
+   util_time_report_mem(-(ptrdiff_t)(info->size + sizeof(ralloc_header)));
    free(info);
 }
 
@@ -50,8 +50,8 @@
 void
 _debug_vprintf(const char *format, va_list ap)
 {
-   static char buf[4096] = {'\0'};
 #if defined(PIPE_OS_WINDOWS) || defined(PIPE_SUBSYSTEM_EMBEDDED)
+   static char buf[4096] = {'\0'};
    /* We buffer until we find a newline. */
    size_t len = strlen(buf);
    int ret = util_vsnprintf(buf + len, sizeof(buf) - len, format, ap);
@@ -60,6 +60,8 @@ _debug_vprintf(const char *format, va_list ap)
       buf[0] = '\0';
    }
 #else
+   /* Use a local buffer, the compiler may be running on several threads. */
+   char buf[4096];
    util_vsnprintf(buf, sizeof(buf), format, ap);
    os_log_message(buf);
 #endif
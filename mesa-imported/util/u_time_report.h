@@ -0,0 +1,37 @@
+/*
+ * Hooks for the per-phase compile time profiler (uam --time-report).
+ *
+ * The implementation lives in the frontend (source/time_report.cpp). All
+ * hooks are cheap no-ops unless a report is being recorded on the calling
+ * thread.
+ */
+
+#ifndef U_TIME_REPORT_H
+#define U_TIME_REPORT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Phases nest; phases with the same name under the same parent are merged,
+ * and the number of times they ran is recorded. The name must be a string
+ * with static storage duration.
+ */
+void util_time_report_begin(const char *phase);
+void util_time_report_end(void);
+
+/* Accounts for heap memory allocated (positive) or released (negative). */
+void util_time_report_mem(ptrdiff_t delta);
+
+#ifdef __cplusplus
+}
+
+struct util_time_report_scope {
+   util_time_report_scope(const char *phase) { util_time_report_begin(phase); }
+   ~util_time_report_scope() { util_time_report_end(); }
+};
+#endif
+
+#endif /* U_TIME_REPORT_H */
@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "compiler_iface.h"
+#include "compile_server.h"
+#include "include_resolver.h"
+#include "shader_cache.h"
+
+namespace
+{
+	// Upper bound for the size of a single request, in order to reject garbage input early
+	constexpr uint32_t s_maxRequestSize = 64U << 20;
+
+	uint32_t GetU32(const uint8_t* p)
+	{
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+	}
+
+	void PutU32(std::vector<uint8_t>& buf, uint32_t value)
+	{
+		buf.push_back(value);
+		buf.push_back(value >> 8);
+		buf.push_back(value >> 16);
+		buf.push_back(value >> 24);
+	}
+
+	void PutBytes(std::vector<uint8_t>& buf, const void* data, size_t size)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		buf.insert(buf.end(), p, p+size);
+	}
+
+	bool ReadAll(int fd, void* data, size_t size)
+	{
+		uint8_t* p = static_cast<uint8_t*>(data);
+		while (size)
+		{
+			auto rc = read(fd, p, size);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				return false;
+			p += rc;
+			size -= rc;
+		}
+		return true;
+	}
+
+	bool WriteAll(int fd, bool isSocket, const void* data, size_t size)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		while (size)
+		{
+#ifndef _WIN32
+			// Avoid getting killed by SIGPIPE if a client disconnects before receiving its responses
+			auto rc = isSocket ? send(fd, p, size, MSG_NOSIGNAL) : write(fd, p, size);
+#else
+			auto rc = write(fd, p, size);
+#endif
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				return false;
+			p += rc;
+			size -= rc;
+		}
+		return true;
+	}
+
+	double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	struct Connection
+	{
+		int fdIn, fdOut;
+		bool isSocket;
+		bool broken;
+		std::mutex writeLock;
+
+		Connection(int in, int out, bool sock) : fdIn{in}, fdOut{out}, isSocket{sock}, broken{false} { }
+		~Connection()
+		{
+#ifndef _WIN32
+			if (isSocket)
+				close(fdIn);
+#endif
+		}
+
+		void Send(std::vector<uint8_t> const& msg)
+		{
+			std::lock_guard<std::mutex> lock(writeLock);
+			if (broken)
+				return;
+			uint8_t size[4] = { uint8_t(msg.size()), uint8_t(msg.size() >> 8), uint8_t(msg.size() >> 16), uint8_t(msg.size() >> 24) };
+			broken = !WriteAll(fdOut, isSocket, size, sizeof(size)) || !WriteAll(fdOut, isSocket, msg.data(), msg.size());
+		}
+	};
+
+	struct Request
+	{
+		std::shared_ptr<Connection> conn;
+		std::vector<uint8_t> msg;
+	};
+
+	struct Response
+	{
+		uint32_t status;
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> diagnostics;
+
+		static void DiagHandler(void* user, diag_severity severity, const char* message)
+		{
+			Response* self = static_cast<Response*>(user);
+			size_t len = strlen(message);
+			PutU32(self->diagnostics, severity);
+			PutU32(self->diagnostics, len);
+			PutBytes(self->diagnostics, message, len);
+		}
+	};
+
+	class Server
+	{
+		ShaderCache* m_cache;
+		std::vector<std::string> m_includeDirs;
+		unsigned m_maxGprs;
+		unsigned m_unrollBudget;
+		unsigned m_ssboAlignment;
+		const nv50_ir_timing* m_timings;
+
+		std::mutex m_queueLock;
+		std::condition_variable m_queueCond;
+		std::deque<Request> m_queue;
+		bool m_closing;
+
+		std::atomic<uint64_t> m_numRequests;
+		std::atomic<uint64_t> m_numCacheHits;
+		std::atomic<uint64_t> m_numFailed;
+		std::atomic<uint64_t> m_totalLatencyUs;
+
+		// Socket clients whose reader thread is still running
+		std::mutex m_clientLock;
+		std::condition_variable m_clientCond;
+		std::vector<Connection*> m_clients;
+
+		bool Compile(pipeline_stage stage, const char* path, const char* source, std::vector<uint8_t>& dksh);
+		void ProcessCompile(Request const& req, Response& resp, bool withPath);
+		void ProcessStats(Response& resp);
+		void Process(Request const& req);
+
+	public:
+		Server(ShaderCache* cache, std::vector<std::string> const& includeDirs, unsigned maxGprs, unsigned unrollBudget,
+			unsigned ssboAlignment, const nv50_ir_timing* timings) : m_cache{cache}, m_includeDirs{includeDirs}, m_maxGprs{maxGprs},
+			m_unrollBudget{unrollBudget}, m_ssboAlignment{ssboAlignment}, m_timings{timings}, m_closing{false},
+			m_numRequests{0}, m_numCacheHits{0}, m_numFailed{0}, m_totalLatencyUs{0} { }
+
+		void Worker();
+		void ReadRequests(std::shared_ptr<Connection> conn);
+		void AddClient(std::shared_ptr<Connection> conn);
+		void ServeClient(std::shared_ptr<Connection> conn);
+		void CloseClients();
+		void Close();
+		void PrintStats();
+	};
+}
+
+bool Server::Compile(pipeline_stage stage, const char* path, const char* source, std::vector<uint8_t>& dksh)
+{
+	DekoCompiler compiler{stage, 3, m_maxGprs, m_unrollBudget, m_ssboAlignment, m_timings};
+	IncludeResolver includes{path, m_includeDirs};
+
+	uint8_t cacheKey[20];
+	bool useCache = m_cache != nullptr;
+	if (useCache)
+	{
+		char* preprocessed = glsl_preprocess(source, stage, nullptr, &includes);
+		useCache = preprocessed != nullptr; // let the compiler report preprocessing errors
+		if (useCache)
+		{
+			compiler.ComputeCacheKey(preprocessed, cacheKey);
+			free(preprocessed);
+
+			if (m_cache->Load(cacheKey, dksh))
+			{
+				m_numCacheHits++;
+				return true;
+			}
+		}
+	}
+
+	if (!compiler.CompileGlsl(source, nullptr, &includes))
+		return false;
+
+	compiler.OutputDksh(dksh);
+	if (useCache)
+		m_cache->Store(cacheKey, dksh);
+	return true;
+}
+
+void Server::ProcessCompile(Request const& req, Response& resp, bool withPath)
+{
+	if (req.msg.size() < 12 || GetU32(&req.msg[8]) > pipeline_stage_compute)
+	{
+		resp.status = SERVER_STATUS_BAD_REQUEST;
+		return;
+	}
+
+	// Without a path, "file" includes are looked up relative to the working directory of the server
+	size_t pos = 12;
+	std::string path;
+	if (withPath)
+	{
+		if (req.msg.size() < pos+4 || req.msg.size()-pos-4 < GetU32(&req.msg[pos]))
+		{
+			resp.status = SERVER_STATUS_BAD_REQUEST;
+			return;
+		}
+		uint32_t pathSize = GetU32(&req.msg[pos]);
+		path.assign(reinterpret_cast<const char*>(&req.msg[pos+4]), pathSize);
+		pos += 4 + pathSize;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	pipeline_stage stage = pipeline_stage(GetU32(&req.msg[8]));
+	std::string source{reinterpret_cast<const char*>(&req.msg[pos]), req.msg.size()-pos};
+
+	diag_set_handler(Response::DiagHandler, &resp);
+	bool rc = Compile(stage, path.c_str(), source.c_str(), resp.data);
+	diag_set_handler(nullptr, nullptr);
+
+	resp.status = rc ? SERVER_STATUS_OK : SERVER_STATUS_FAILED;
+	if (!rc)
+	{
+		resp.data.clear();
+		m_numFailed++;
+	}
+
+	m_numRequests++;
+	m_totalLatencyUs += uint64_t(ElapsedMs(start)*1000.0);
+}
+
+void Server::ProcessStats(Response& resp)
+{
+	uint64_t numRequests = m_numRequests;
+	double meanLatency = numRequests ? m_totalLatencyUs / (1000.0*numRequests) : 0.0;
+
+	char buf[256];
+	int len = snprintf(buf, sizeof(buf),
+		"requests=%llu\ncache_hits=%llu\nfailed=%llu\nmean_latency_ms=%.3f\n",
+		(unsigned long long)numRequests, (unsigned long long)m_numCacheHits, (unsigned long long)m_numFailed, meanLatency);
+
+	resp.status = SERVER_STATUS_OK;
+	PutBytes(resp.data, buf, len);
+}
+
+void Server::Process(Request const& req)
+{
+	Response resp{SERVER_STATUS_BAD_REQUEST};
+	uint32_t id = req.msg.size() >= 4 ? GetU32(&req.msg[0]) : 0;
+
+	if (req.msg.size() >= 8)
+	{
+		switch (GetU32(&req.msg[4]))
+		{
+			case SERVER_REQ_COMPILE:      ProcessCompile(req, resp, false); break;
+			case SERVER_REQ_STATS:        ProcessStats(resp); break;
+			case SERVER_REQ_COMPILE_FILE: ProcessCompile(req, resp, true); break;
+			default: break;
+		}
+	}
+
+	std::vector<uint8_t> msg;
+	msg.reserve(12 + resp.data.size() + resp.diagnostics.size());
+	PutU32(msg, id);
+	PutU32(msg, resp.status);
+	PutU32(msg, resp.data.size());
+	PutBytes(msg, resp.data.data(), resp.data.size());
+	PutBytes(msg, resp.diagnostics.data(), resp.diagnostics.size());
+	req.conn->Send(msg);
+}
+
+void Server::Worker()
+{
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(m_queueLock);
+		m_queueCond.wait(lock, [&]{ return m_closing || !m_queue.empty(); });
+		if (m_queue.empty())
+			break;
+
+		Request req = std::move(m_queue.front());
+		m_queue.pop_front();
+		lock.unlock();
+
+		Process(req);
+	}
+}
+
+void Server::ReadRequests(std::shared_ptr<Connection> conn)
+{
+	for (;;)
+	{
+		uint8_t sizeBuf[4];
+		if (!ReadAll(conn->fdIn, sizeBuf, sizeof(sizeBuf)))
+			break;
+
+		uint32_t size = GetU32(sizeBuf);
+		if (size > s_maxRequestSize)
+		{
+			fprintf(stderr, "Rejecting oversized request (%u bytes), closing connection\n", size);
+			break;
+		}
+
+		Request req{conn};
+		req.msg.resize(size);
+		if (!ReadAll(conn->fdIn, req.msg.data(), size))
+			break;
+
+		std::lock_guard<std::mutex> lock(m_queueLock);
+		m_queue.push_back(std::move(req));
+		m_queueCond.notify_one();
+	}
+}
+
+#ifndef _WIN32
+// Reads the requests of a socket client on a thread of its own. The thread is detached,
+// and only the list of clients still being read from is kept.
+void Server::AddClient(std::shared_ptr<Connection> conn)
+{
+	std::lock_guard<std::mutex> lock(m_clientLock);
+	m_clients.push_back(conn.get());
+	std::thread(&Server::ServeClient, this, std::move(conn)).detach();
+}
+
+void Server::ServeClient(std::shared_ptr<Connection> conn)
+{
+	ReadRequests(conn);
+
+	// The socket is closed once the workers are done with the queued requests of the client
+	Connection* client = conn.get();
+	conn.reset();
+
+	std::lock_guard<std::mutex> lock(m_clientLock);
+	m_clients.erase(std::find(m_clients.begin(), m_clients.end(), client));
+	m_clientCond.notify_all();
+}
+
+// Stops reading from all clients, and waits for their reader threads to exit.
+void Server::CloseClients()
+{
+	std::unique_lock<std::mutex> lock(m_clientLock);
+	for (auto client : m_clients)
+		shutdown(client->fdIn, SHUT_RD);
+	m_clientCond.wait(lock, [&]{ return m_clients.empty(); });
+}
+#endif
+
+// Lets the workers exit once all queued requests have been processed.
+void Server::Close()
+{
+	std::lock_guard<std::mutex> lock(m_queueLock);
+	m_closing = true;
+	m_queueCond.notify_all();
+}
+
+void Server::PrintStats()
+{
+	uint64_t numRequests = m_numRequests;
+	fprintf(stderr, "Served %llu request(s) (%llu failed, %llu cached), mean latency %.3f ms\n",
+		(unsigned long long)numRequests, (unsigned long long)m_numFailed, (unsigned long long)m_numCacheHits,
+		numRequests ? m_totalLatencyUs / (1000.0*numRequests) : 0.0);
+}
+
+#ifndef _WIN32
+static int listen_socket(const char* socketPath)
+{
+	struct sockaddr_un addr = {};
+	if (strlen(socketPath) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket path too long: %s\n", socketPath);
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socketPath);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	unlink(socketPath); // remove stale socket left behind by a previous server
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+	{
+		fprintf(stderr, "Could not listen on %s: %s\n", socketPath, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+#endif
+
+int compile_server(const char* socketPath, unsigned numThreads, ShaderCache* cache, std::vector<std::string> const& includeDirs,
+	unsigned maxGprs, unsigned unrollBudget, unsigned ssboAlignment, const nv50_ir_timing* timings)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+
+#ifdef _WIN32
+	if (socketPath)
+	{
+		fprintf(stderr, "Unix domain sockets are not supported on this platform\n");
+		return EXIT_FAILURE;
+	}
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#else
+	int listenFd = -1;
+	if (socketPath)
+	{
+		listenFd = listen_socket(socketPath);
+		if (listenFd < 0)
+			return EXIT_FAILURE;
+	}
+#endif
+
+	// Keep the frontend (and the builtin function library) alive for the lifetime of the server.
+	glsl_frontend_init();
+
+	Server server{cache, includeDirs, maxGprs, unrollBudget, ssboAlignment, timings};
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < numThreads; i ++)
+		workers.emplace_back(&Server::Worker, &server);
+
+	bool ok = true;
+	if (!socketPath)
+	{
+		fflush(stdout); // responses are written directly to the file descriptor
+		server.ReadRequests(std::make_shared<Connection>(0, 1, false));
+	}
+#ifndef _WIN32
+	else
+	{
+		// Each client gets its own reader thread; requests from all clients share the worker pool.
+		// The server keeps running until accept fails (or the process is terminated).
+		for (;;)
+		{
+			int fd = accept(listenFd, nullptr, nullptr);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				perror("accept");
+				ok = false;
+				break;
+			}
+
+			server.AddClient(std::make_shared<Connection>(fd, fd, true));
+		}
+
+		server.CloseClients();
+
+		close(listenFd);
+		unlink(socketPath);
+	}
+#endif
+
+	server.Close();
+	for (auto& thread : workers)
+		thread.join();
+
+	server.PrintStats();
+	glsl_frontend_exit();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
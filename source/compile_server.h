@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ShaderCache;
+struct nv50_ir_timing;
+
+// Persistent compile server. The GLSL frontend is initialized once and kept alive, so that
+// each request only pays for the actual compilation of the shader.
+//
+// Requests are read from stdin (or from clients connected to a Unix domain socket if a path
+// is given), and responses are written back to the same channel. All integers are 32-bit
+// little endian, and every message is preceded by its size in bytes (not including the size
+// field itself):
+//
+//   Request:  u32 id, u32 type, payload
+//             type 0 (compile): payload = u32 stage (see pipeline_stage), GLSL source text
+//             type 1 (stats):   no payload
+//             type 2 (compile file): payload = u32 stage, u32 path_size, path, GLSL source text
+//                               path = file name of the source, used to resolve "file" includes
+//                               relative to it (type 0 resolves them relative to the server's
+//                               working directory); the include search paths are set with -I
+//   Response: u32 id, u32 status, u32 data_size, data, diagnostics
+//             status 0 = success, 1 = compilation failed, 2 = malformed request
+//             data = DKSH module (compile requests), or "key=value" text lines (stats requests)
+//             diagnostics = sequence of { u32 severity, u32 length, message text }
+//
+// Requests are processed concurrently by a pool of worker threads, which means that
+// responses may be sent in a different order than the requests; the id field (chosen
+// freely by the client) is used to match them.
+
+enum
+{
+	SERVER_REQ_COMPILE = 0,
+	SERVER_REQ_STATS   = 1,
+	SERVER_REQ_COMPILE_FILE = 2,
+};
+
+enum
+{
+	SERVER_STATUS_OK           = 0,
+	SERVER_STATUS_FAILED       = 1,
+	SERVER_STATUS_BAD_REQUEST  = 2,
+};
+
+int compile_server(const char* socketPath, unsigned numThreads, ShaderCache* cache, std::vector<std::string> const& includeDirs,
+	unsigned maxGprs = 0, unsigned unrollBudget = 0, unsigned ssboAlignment = 4, const nv50_ir_timing* timings = nullptr);
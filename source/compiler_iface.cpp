@@ -1,8 +1,16 @@
 #include "compiler_iface.h"
+#include <algorithm>
 
 namespace
 {
 	constexpr unsigned s_shaderStartOffset = 0x80 - sizeof(NvShaderHeader);
+	constexpr uint16_t s_targetChipset = 0x12b; // Tegra X1 (GM20B)
+
+	template <typename T>
+	constexpr T Align128(T x)
+	{
+		return (x + 0x7F) &~ 0x7F;
+	}
 
 	template <typename T>
 	constexpr T Align256(T x)
@@ -10,24 +18,24 @@ namespace
 		return (x + 0xFF) &~ 0xFF;
 	}
 
-	void FileWritePadding(FILE* f, uint32_t req, uint32_t dummy = 0)
+	void BufferWrite(std::vector<uint8_t>& buf, const void* data, size_t size)
 	{
-		while (req >= sizeof(dummy))
-		{
-			fwrite(&dummy, 1, sizeof(dummy), f);
-			req -= sizeof(dummy);
-		}
-		if (req)
-			fwrite(&dummy, 1, req, f);
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		buf.insert(buf.end(), bytes, bytes + size);
 	}
 
-	void FileAlign256(FILE* f)
+	void BufferAlign256(std::vector<uint8_t>& buf)
 	{
-		long pos = ftell(f);
-		FileWritePadding(f, Align256(pos) - pos);
+		buf.resize(Align256(buf.size()), 0);
 	}
 }
 
+constexpr unsigned DekoCompiler::MinGprBudget;
+constexpr unsigned DekoCompiler::MaxGprs;
+constexpr unsigned DekoCompiler::MaxWarpsPerSM;
+constexpr unsigned DekoCompiler::MinSsboAlignment;
+constexpr unsigned DekoCompiler::MaxSsboAlignment;
+
 /* NOTE: Using a[0x270] in FP may cause an error even if we're using less than
  * 124 scalar varying values.
  */
@@ -200,8 +208,9 @@ nvc0_program_assign_varying_slots(struct nv50_ir_prog_info *info)
 	return ret;
 }
 
-DekoCompiler::DekoCompiler(pipeline_stage stage, int optLevel) :
-	m_stage{stage}, m_glsl{}, m_tgsi{}, m_tgsiNumTokens{}, m_info{}, m_code{}, m_codeSize{},
+DekoCompiler::DekoCompiler(pipeline_stage stage, int optLevel, unsigned maxGprs, unsigned unrollBudget, unsigned ssboAlignment,
+	const nv50_ir_timing* timings) :
+	m_stage{stage}, m_unrollBudget{unrollBudget}, m_glsl{}, m_tgsi{}, m_tgsiNumTokens{}, m_info{}, m_perf{}, m_code{}, m_codeSize{},
 	m_nvsh{}, m_dkph{}
 {
 	m_nvsh.version = 3;
@@ -254,14 +263,18 @@ DekoCompiler::DekoCompiler(pipeline_stage stage, int optLevel) :
 			resbase = 0x0a0;
 			break;
 	}
-	m_info.target = 0x12b;
+	m_info.target = s_targetChipset;
 	m_info.bin.sourceRep = PIPE_SHADER_IR_TGSI;
 
 	m_info.optLevel = optLevel;
+	m_info.gprBudget = std::min(maxGprs, MaxGprs);
+	m_info.timings = timings;
+	m_info.bin.perf = &m_perf;
 
 	m_info.io.auxCBSlot      = 17;            // Driver constbuf c[0x0]. Note that codegen was modified to transform constbuf ids like such: final_id = (raw_id + 1) % 18
 	m_info.io.drawInfoBase   = 0x000;         // This is used for gl_BaseVertex, gl_BaseInstance and gl_DrawID (in that order)
 	m_info.io.bufInfoBase    = resbase+0x0a0; // This is used to load SSBO information (u64 iova / u32 size / u32 padding)
+	m_info.io.bufAlignment   = MinSsboAlignment; // SSBO addresses are aligned to ShaderStorageBufferOffsetAlignment (raised with ssboAlignment), this allows merging loads/stores into wider ones
 	m_info.io.texBindBase    = resbase+0x000; // Start of bound texture handles (32) + images (right after). 32-bit instead of 64-bit.
 	m_info.io.fbtexBindBase  = 0x00c;         // This is used for implementing TGSI_OPCODE_FBFETCH, itself used for KHR/NV_blend_equation_advanced and EXT_shader_framebuffer_fetch.
 	m_info.io.sampleInfoBase = 0x830;         // This is a LUT needed to implement gl_SamplePosition, it contains MSAA base sample positions.
@@ -276,6 +289,10 @@ DekoCompiler::DekoCompiler(pipeline_stage stage, int optLevel) :
 	//m_info.io.suInfoBase   = NVC0_CB_AUX_SU_INFO(0);        // Surface information. On Maxwell, nouveau only uses it during NVC0LoweringPass::processSurfaceCoordsGM107 bound checking (which I disabled)
 	//m_info.io.bindlessBase = NVC0_CB_AUX_BINDLESS_INFO(0);  // Like suInfoBase, but for bindless textures (pre-Kepler?).
 
+	// Largest power of two not above the requested alignment
+	while (m_info.io.bufAlignment < MaxSsboAlignment && m_info.io.bufAlignment*2 <= ssboAlignment)
+		m_info.io.bufAlignment *= 2;
+
 	m_info.assignSlots = nvc0_program_assign_varying_slots;
 
 	glsl_frontend_init();
@@ -285,30 +302,49 @@ DekoCompiler::~DekoCompiler()
 {
 	if (m_glsl)
 		glsl_program_free(m_glsl);
+	if (m_perf.blocks)
+		free(m_perf.blocks);
 
 	glsl_frontend_exit();
 }
 
-bool DekoCompiler::CompileGlsl(const char* glsl)
+bool DekoCompiler::CompileGlsl(const char* glsl, const char* const* defines, IncludeResolver* includes)
 {
-	m_glsl = glsl_program_create(glsl, m_stage);
+	m_glsl = glsl_program_create(glsl, m_stage, m_unrollBudget, defines, includes);
 	if (!m_glsl) return false;
 
 	m_tgsi = glsl_program_get_tokens(m_glsl, m_tgsiNumTokens);
 	m_info.bin.source = m_tgsi;
 	m_info.bin.smemSize = glsl_program_compute_get_shared_size(m_glsl); // Total size of glsl shared variables. (translation process doesn't actually need this, but for the sake of consistency with nouveau, we keep this value here too)
 	m_info.driverPriv = m_glsl;
+
+	// A budget set in the shader itself takes precedence over the one given by the user
+	if (unsigned pragmaGprs = glsl_program_get_max_gprs(m_glsl))
+		m_info.gprBudget = std::min(pragmaGprs, MaxGprs);
+	if (m_info.gprBudget && m_info.gprBudget < MinGprBudget)
+	{
+		diag_printf(diag_severity_warning, "warning: register budget of %u GPRs is too small, using %u instead", m_info.gprBudget, MinGprBudget);
+		m_info.gprBudget = MinGprBudget;
+	}
+
 	int ret = nv50_ir_generate_code(&m_info);
 	if (ret < 0)
 	{
-		fprintf(stderr, "Error compiling program: %d\n", ret);
+		if (ret == -4 && m_info.gprBudget)
+			diag_printf(diag_severity_error, "Error compiling program: could not allocate registers within the budget of %u GPRs", m_info.gprBudget);
+		else
+			diag_printf(diag_severity_error, "Error compiling program: %d", ret);
 		return false;
 	}
 
+	if (m_info.gprBudget && (m_info.bin.spillStores || m_info.bin.spillLoads))
+		diag_printf(diag_severity_warning, "warning: register budget of %u GPRs could not be met without spilling (%u values spilled, %u rematerialized, %u stores, %u loads, %u bytes of local memory per thread)",
+			m_info.gprBudget, m_info.bin.spillValues, m_info.bin.rematValues, m_info.bin.spillStores, m_info.bin.spillLoads, m_info.bin.tlsSpace);
+
 	if (m_info.io.fp64_rcprsq)
-		fprintf(stderr, "warning: program uses 64-bit floating point reciprocal/square root, for which only a rough approximation with 20 bits of mantissa is supported by hardware\n");
+		diag_message(diag_severity_warning, "warning: program uses 64-bit floating point reciprocal/square root, for which only a rough approximation with 20 bits of mantissa is supported by hardware");
 	if (m_info.io.int_divmod)
-		fprintf(stderr, "warning: program uses non-constant integer division/modulo, which is unsupported by hardware; floating point emulation with resulting loss of precision has been applied\n");
+		diag_message(diag_severity_warning, "warning: program uses non-constant integer division/modulo, which is unsupported by hardware; floating point emulation with resulting loss of precision has been applied");
 
 	m_data = glsl_program_get_constant_buffer(m_glsl, m_dataSize);
 	RetrieveAndPadCode();
@@ -352,15 +388,12 @@ void DekoCompiler::RetrieveAndPadCode()
 
 void DekoCompiler::GenerateHeaders()
 {
-	m_dkph.entrypoint = m_stage != pipeline_stage_compute ? s_shaderStartOffset : 0;
+	// entrypoint and constbuf1_off depend on the final layout of the module, see OutputDksh
 	m_dkph.num_gprs = m_info.bin.maxGPR + 1;
 	if (m_dkph.num_gprs < 4) m_dkph.num_gprs = 4;
 
 	if (m_dataSize)
-	{
-		m_dkph.constbuf1_off = Align256((m_stage != pipeline_stage_compute ? 0x80 : 0x00) + m_codeSize);
-		m_dkph.constbuf1_sz  = m_dataSize;
-	}
+		m_dkph.constbuf1_sz = m_dataSize;
 
 	unsigned local_pos_sz = (m_info.bin.tlsSpace + 0xF) &~ 0xF; // 16-byte aligned
 	unsigned local_neg_sz = 0;
@@ -622,39 +655,201 @@ void DekoCompiler::GenerateHeaders()
 	}
 }
 
-void DekoCompiler::OutputDksh(const char* dkshFile)
+void DekoCompiler::ComputeCacheKey(const char* preprocessedGlsl, uint8_t key[20])
+{
+	struct mesa_sha1 ctx;
+	_mesa_sha1_init(&ctx);
+
+	// Compiler version
+	static const char s_version[] = PACKAGE_STRING;
+	_mesa_sha1_update(&ctx, s_version, sizeof(s_version));
+
+	// Pipeline stage and codegen settings
+	uint32_t settings[] =
+	{
+		uint32_t(m_stage),
+		uint32_t(m_info.type),
+		uint32_t(m_info.target),
+		uint32_t(m_info.optLevel),
+		uint32_t(m_info.gprBudget),
+		uint32_t(m_unrollBudget),
+		uint32_t(m_info.io.auxCBSlot),
+		uint32_t(m_info.io.drawInfoBase),
+		uint32_t(m_info.io.bufInfoBase),
+		uint32_t(m_info.io.bufAlignment),
+		uint32_t(m_info.io.texBindBase),
+		uint32_t(m_info.io.fbtexBindBase),
+		uint32_t(m_info.io.sampleInfoBase),
+		uint32_t(m_info.io.uboInfoBase),
+		uint32_t(m_info.prop.cp.gridInfoBase),
+	};
+	_mesa_sha1_update(&ctx, settings, sizeof(settings));
+
+	// Timing model, if not the built-in one
+	if (m_info.timings)
+	{
+		for (unsigned i = 0; i < NV50_IR_TIMING_COUNT; i ++)
+		{
+			const nv50_ir_timing& t = m_info.timings[i];
+			uint32_t timing[] = { t.latency, t.resultLatency, t.throughput };
+			_mesa_sha1_update(&ctx, timing, sizeof(timing));
+		}
+	}
+
+	// Preprocessed source code
+	_mesa_sha1_update(&ctx, preprocessedGlsl, strlen(preprocessedGlsl));
+
+	_mesa_sha1_final(&ctx, key);
+}
+
+void DekoCompiler::OutputDksh(std::vector<uint8_t>& dksh)
+{
+	DekoCompiler* self = this;
+	OutputDksh(dksh, &self, 1);
+}
+
+void DekoCompiler::OutputDksh(std::vector<uint8_t>& dksh, DekoCompiler* const* programs, unsigned numPrograms, const char* const* names,
+	unsigned numNames, const unsigned* nameProgramIds)
 {
+	std::vector<DkshProgramHeader> progHdrs(numPrograms);
+
+	// Lay out the programs in the code section. Each program is packed right after the previous one,
+	// only respecting the hardware requirement of having the first instruction aligned to 128 bytes.
+	// (For graphics programs, the shader program header is located right before the first instruction)
+	uint32_t codePos = 0;
+	for (unsigned i = 0; i < numPrograms; i ++)
+	{
+		DekoCompiler& prog = *programs[i];
+		uint32_t sphSize = prog.m_stage != pipeline_stage_compute ? sizeof(NvShaderHeader) : 0;
+		progHdrs[i] = prog.m_dkph;
+		progHdrs[i].entrypoint = Align128(codePos + sphSize) - sphSize;
+		codePos = progHdrs[i].entrypoint + sphSize + prog.m_codeSize;
+	}
+
+	// Lay out the constbufs after the code, deduplicating identical ones
+	uint32_t dataPos = Align256(codePos);
+	std::vector<unsigned> dataOwners;
+	for (unsigned i = 0; i < numPrograms; i ++)
+	{
+		DekoCompiler& prog = *programs[i];
+		if (!prog.m_dataSize)
+			continue;
+
+		bool found = false;
+		for (unsigned j : dataOwners)
+		{
+			DekoCompiler& other = *programs[j];
+			if (other.m_dataSize == prog.m_dataSize && memcmp(other.m_data, prog.m_data, prog.m_dataSize) == 0)
+			{
+				progHdrs[i].constbuf1_off = progHdrs[j].constbuf1_off;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			progHdrs[i].constbuf1_off = dataPos;
+			dataPos += Align256(prog.m_dataSize);
+			dataOwners.push_back(i);
+		}
+	}
+
+	// Build the program name index, sorted by name
+	std::vector<DkshNameIndexEntry> nameEntries;
+	std::vector<char> nameStrings;
+	if (names)
+	{
+		if (!nameProgramIds)
+			numNames = numPrograms;
+
+		std::vector<unsigned> order(numNames);
+		for (unsigned i = 0; i < numNames; i ++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return strcmp(names[a], names[b]) < 0; });
+
+		for (unsigned i : order)
+		{
+			DkshNameIndexEntry entry;
+			entry.name_off = nameStrings.size();
+			entry.program_id = nameProgramIds ? nameProgramIds[i] : i;
+			nameEntries.push_back(entry);
+			nameStrings.insert(nameStrings.end(), names[i], names[i] + strlen(names[i]) + 1);
+		}
+		nameStrings.resize((nameStrings.size() + 3) &~ 3, 0);
+	}
+
+	uint32_t indexOffset = sizeof(DkshHeader) + numPrograms*sizeof(DkshProgramHeader);
+	uint32_t indexSize = 0;
+	if (names)
+		indexSize = sizeof(DkshNameIndexHeader) + nameEntries.size()*sizeof(DkshNameIndexEntry) + nameStrings.size();
+
 	DkshHeader hdr = {};
 	hdr.magic        = DKSH_MAGIC;
 	hdr.header_sz    = sizeof(DkshHeader);
-	hdr.control_sz   = Align256(sizeof(DkshHeader) + sizeof(DkshProgramHeader));
-	hdr.code_sz      = Align256((m_stage != pipeline_stage_compute ? 0x80 : 0x00) + m_codeSize) + Align256(m_dataSize);
+	hdr.control_sz   = Align256(indexOffset + indexSize);
+	hdr.code_sz      = dataPos;
 	hdr.programs_off = sizeof(DkshHeader);
-	hdr.num_programs = 1;
+	hdr.num_programs = numPrograms;
 
-	FILE* f = fopen(dkshFile, "wb");
-	if (f)
+	dksh.clear();
+	dksh.reserve(hdr.control_sz + hdr.code_sz);
+
+	// Control section
+	BufferWrite(dksh, &hdr, sizeof(hdr));
+	BufferWrite(dksh, progHdrs.data(), numPrograms*sizeof(DkshProgramHeader));
+	if (names)
 	{
-		fwrite(&hdr, 1, sizeof(hdr), f);
-		fwrite(&m_dkph, 1, sizeof(m_dkph), f);
-		FileAlign256(f);
+		DkshNameIndexHeader indexHdr = {};
+		indexHdr.magic       = DKSH_NAME_INDEX_MAGIC;
+		indexHdr.num_entries = nameEntries.size();
+		indexHdr.strings_off = sizeof(DkshNameIndexHeader) + nameEntries.size()*sizeof(DkshNameIndexEntry);
+		indexHdr.strings_sz  = nameStrings.size();
+		BufferWrite(dksh, &indexHdr, sizeof(indexHdr));
+		BufferWrite(dksh, nameEntries.data(), nameEntries.size()*sizeof(DkshNameIndexEntry));
+		BufferWrite(dksh, nameStrings.data(), nameStrings.size());
+	}
+	BufferAlign256(dksh);
 
-		if (m_stage != pipeline_stage_compute)
+	// Code section: programs
+	size_t codeBase = dksh.size();
+	for (unsigned i = 0; i < numPrograms; i ++)
+	{
+		DekoCompiler& prog = *programs[i];
+		if (prog.m_stage != pipeline_stage_compute)
 		{
+			size_t gap = codeBase + progHdrs[i].entrypoint - dksh.size();
 			static const char s_padding[s_shaderStartOffset] = "lol nvidia why did you make us waste space here";
-			fwrite(s_padding, 1, sizeof(s_padding), f);
-			fwrite(&m_nvsh, 1, sizeof(m_nvsh), f);
+			if (gap == sizeof(s_padding))
+				BufferWrite(dksh, s_padding, sizeof(s_padding));
+			else
+				dksh.resize(dksh.size() + gap, 0);
+			BufferWrite(dksh, &prog.m_nvsh, sizeof(prog.m_nvsh));
 		}
+		else
+			dksh.resize(codeBase + progHdrs[i].entrypoint, 0);
 
-		fwrite(m_code, 1, m_codeSize, f);
-		FileAlign256(f);
+		BufferWrite(dksh, prog.m_code, prog.m_codeSize);
+	}
+	BufferAlign256(dksh);
 
-		if (m_dataSize)
-		{
-			fwrite(m_data, 1, m_dataSize, f);
-			FileAlign256(f);
-		}
+	// Code section: constbufs
+	for (unsigned i : dataOwners)
+	{
+		BufferWrite(dksh, programs[i]->m_data, programs[i]->m_dataSize);
+		BufferAlign256(dksh);
+	}
+}
 
+void DekoCompiler::OutputDksh(const char* dkshFile)
+{
+	std::vector<uint8_t> dksh;
+	OutputDksh(dksh);
+
+	FILE* f = fopen(dkshFile, "wb");
+	if (f)
+	{
+		fwrite(dksh.data(), 1, dksh.size(), f);
 		fclose(f);
 	}
 }
@@ -669,6 +864,181 @@ void DekoCompiler::OutputRawCode(const char* rawFile)
 	}
 }
 
+unsigned DekoCompiler::CalcOccupancy() const
+{
+	// Each of the 4 SM partitions has its own 16K-entry register file and can hold up to 16 warps.
+	// Registers are allocated per warp in units of 256 (i.e. 8 registers per thread).
+	constexpr unsigned numPartitions = 4;
+	constexpr unsigned regsPerPartition = 0x4000;
+	constexpr unsigned maxBlocksPerSM = 32;
+	constexpr unsigned sharedMemPerSM = 0x10000;
+
+	unsigned regsPerWarp = 32 * ((m_dkph.num_gprs + 7) &~ 7);
+	unsigned warps = numPartitions * std::min(MaxWarpsPerSM / numPartitions, regsPerPartition / regsPerWarp);
+
+	if (m_stage == pipeline_stage_compute)
+	{
+		unsigned numThreads = m_info.prop.cp.numThreads[0] * m_info.prop.cp.numThreads[1] * m_info.prop.cp.numThreads[2];
+		unsigned warpsPerBlock = std::max(1U, (numThreads + 31) / 32);
+		unsigned blocks = std::min(maxBlocksPerSM, warps / warpsPerBlock);
+		if (m_dkph.comp.shared_mem_sz)
+			blocks = std::min(blocks, sharedMemPerSM / m_dkph.comp.shared_mem_sz);
+		warps = blocks * warpsPerBlock;
+	}
+
+	return warps;
+}
+
+unsigned DekoCompiler::CalcGprBudget(unsigned targetWarps)
+{
+	// Inverse of the register limit in CalcOccupancy
+	constexpr unsigned numPartitions = 4;
+	constexpr unsigned regsPerPartition = 0x4000;
+
+	unsigned warpsPerPartition = std::max(1U, (std::min(targetWarps, MaxWarpsPerSM) + numPartitions - 1) / numPartitions);
+	unsigned gprs = (regsPerPartition / (32 * warpsPerPartition)) &~ 7;
+	return std::min(gprs, MaxGprs);
+}
+
+// Timing file syntax (see examples/timings.txt), one instruction class per line:
+//
+//   <class> <latency> <result latency> <throughput>   # comment
+//
+// - <class> is one of the names printed by --dump-timings (nv50_ir_get_timing_class_name).
+// - <latency> is the stall count, 1 to 15, that dependent instructions wait for.
+// - <result latency> is the average number of cycles until a scoreboarded result is available, 1 to 65535.
+// - <throughput> is the number of cycles between two instructions of the class on one SM sub-partition, 1 to 255.
+// Any field may be '-' to keep the built-in value. '#' starts a comment, and blank lines are ignored. Classes that
+// aren't listed keep their built-in values; when a class is listed more than once, the last line wins.
+bool DekoCompiler::LoadTimings(const char* timingFile, nv50_ir_timing timings[NV50_IR_TIMING_COUNT])
+{
+	FILE* f = fopen(timingFile, "r");
+	if (!f)
+	{
+		diag_printf(diag_severity_error, "Could not open timing file: %s", timingFile);
+		return false;
+	}
+
+	nv50_ir_get_timings(s_targetChipset, timings);
+
+	// Each field may be '-' to keep the built-in value
+	auto parseField = [](const char* str, unsigned max, unsigned& value)
+	{
+		if (strcmp(str, "-") == 0)
+			return true;
+		char* end;
+		unsigned long x = strtoul(str, &end, 10);
+		if (*end || x < 1 || x > max)
+			return false;
+		value = x;
+		return true;
+	};
+
+	char line[256];
+	unsigned lineNum = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), f))
+	{
+		lineNum++;
+		char* comment = strchr(line, '#');
+		if (comment)
+			*comment = 0;
+
+		char name[32], fields[3][16], extra[2];
+		int numTokens = sscanf(line, "%31s %15s %15s %15s %1s", name, fields[0], fields[1], fields[2], extra);
+		if (numTokens <= 0)
+			continue;
+
+		unsigned cls;
+		for (cls = 0; cls < NV50_IR_TIMING_COUNT; cls ++)
+			if (strcmp(name, nv50_ir_get_timing_class_name(cls)) == 0)
+				break;
+		if (cls == NV50_IR_TIMING_COUNT)
+		{
+			diag_printf(diag_severity_error, "%s:%u: unknown instruction class `%s'", timingFile, lineNum, name);
+			ok = false;
+			break;
+		}
+
+		nv50_ir_timing& t = timings[cls];
+		unsigned latency = t.latency, resultLatency = t.resultLatency, throughput = t.throughput;
+		if (numTokens != 4 || !parseField(fields[0], 15, latency) || !parseField(fields[1], 0xffff, resultLatency)
+			|| !parseField(fields[2], 0xff, throughput))
+		{
+			diag_printf(diag_severity_error, "%s:%u: expected <class> <latency (1-15)> <result latency> <throughput>", timingFile, lineNum);
+			ok = false;
+			break;
+		}
+
+		t.latency = latency;
+		t.resultLatency = resultLatency;
+		t.throughput = throughput;
+	}
+
+	fclose(f);
+	return ok;
+}
+
+void DekoCompiler::OutputTimings(std::string& text)
+{
+	nv50_ir_timing timings[NV50_IR_TIMING_COUNT];
+	nv50_ir_get_timings(s_targetChipset, timings);
+
+	char buf[128];
+	text += "# Built-in estimates, not measured on hardware\n";
+	text += "# class      latency  result  throughput\n";
+	for (unsigned i = 0; i < NV50_IR_TIMING_COUNT; i ++)
+	{
+		snprintf(buf, sizeof(buf), "%-12s %7u %7u %11u\n", nv50_ir_get_timing_class_name(i),
+			unsigned(timings[i].latency), unsigned(timings[i].resultLatency), unsigned(timings[i].throughput));
+		text += buf;
+	}
+}
+
+void DekoCompiler::OutputPerfReport(std::string& json, unsigned indent) const
+{
+	const std::string pad(indent, '\t');
+	nv50_ir_perf_block total = {};
+	std::string blocks;
+	char buf[512];
+
+	for (uint32_t i = 0; i < m_perf.numBlocks; i ++)
+	{
+		const nv50_ir_perf_block& bb = m_perf.blocks[i];
+		total.instructions += bb.instructions;
+		total.stallCycles  += bb.stallCycles;
+		total.dualIssued   += bb.dualIssued;
+		total.barrierWaits += bb.barrierWaits;
+		total.texOps       += bb.texOps;
+		total.memOps       += bb.memOps;
+
+		snprintf(buf, sizeof(buf),
+			"%s\n%s\t{ \"id\": %u, \"instructions\": %u, \"stall_cycles\": %u, \"dual_issued\": %u, \"barrier_waits\": %u, \"tex_ops\": %u, \"mem_ops\": %u }",
+			i ? "," : "", pad.c_str(), bb.id, bb.instructions, bb.stallCycles, bb.dualIssued, bb.barrierWaits, bb.texOps, bb.memOps);
+		blocks += buf;
+	}
+
+	unsigned warps = CalcOccupancy();
+	snprintf(buf, sizeof(buf),
+		"%s\"gprs\": %u,\n%s\"gpr_budget\": %u,\n%s\"tls_bytes\": %u,\n%s\"spill_stores\": %u,\n%s\"spill_loads\": %u,\n"
+		"%s\"spilled_values\": %u,\n%s\"rematerialized_values\": %u,\n%s\"code_bytes\": %u,\n%s\"occupancy\": { \"warps\": %u, \"max_warps\": %u, \"ratio\": %.3f },\n"
+		"%s\"codegen_ir_bytes\": %u,\n",
+		pad.c_str(), m_dkph.num_gprs, pad.c_str(), m_info.gprBudget, pad.c_str(), m_info.bin.tlsSpace,
+		pad.c_str(), m_info.bin.spillStores, pad.c_str(), m_info.bin.spillLoads,
+		pad.c_str(), m_info.bin.spillValues, pad.c_str(), m_info.bin.rematValues, pad.c_str(), m_codeSize,
+		pad.c_str(), warps, MaxWarpsPerSM, double(warps) / MaxWarpsPerSM, pad.c_str(), m_info.bin.irMemSize);
+	json += buf;
+
+	// share of the instructions issued as half of a pair
+	double dualRatio = total.instructions ? 2.0 * total.dualIssued / total.instructions : 0.0;
+	snprintf(buf, sizeof(buf),
+		"%s\"totals\": { \"instructions\": %u, \"stall_cycles\": %u, \"dual_issued\": %u, \"dual_issue_ratio\": %.3f, \"barrier_waits\": %u, \"tex_ops\": %u, \"mem_ops\": %u },\n",
+		pad.c_str(), total.instructions, total.stallCycles, total.dualIssued, dualRatio, total.barrierWaits, total.texOps, total.memOps);
+	json += buf;
+
+	json += pad + "\"blocks\": [" + blocks + "\n" + pad + "]";
+}
+
 void DekoCompiler::OutputTgsi(const char* tgsiFile)
 {
 	FILE* f = fopen(tgsiFile, "w");
@@ -3,13 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 #include "tgsi/tgsi_text.h"
 #include "tgsi/tgsi_dump.h"
 
 #include "codegen/nv50_ir_driver.h"
+#include "util/mesa-sha1.h"
 
 #include "glsl_frontend.h"
+#include "diagnostics.h"
 
 #include "nv_attributes.h"
 #include "nv_shader_header.h"
@@ -18,10 +22,12 @@
 class DekoCompiler
 {
 	pipeline_stage m_stage;
+	unsigned m_unrollBudget;
 	glsl_program m_glsl;
 	const struct tgsi_token* m_tgsi;
 	unsigned int m_tgsiNumTokens;
 	nv50_ir_prog_info m_info;
+	nv50_ir_perf_info m_perf;
 	void* m_code;
 	uint32_t m_codeSize;
 	void* m_data;
@@ -34,11 +40,40 @@ class DekoCompiler
 	void GenerateHeaders();
 
 public:
-	DekoCompiler(pipeline_stage stage, int optLevel = 3);
+	// Registers the allocator may use (budgets below MinGprBudget are raised to it)
+	static constexpr unsigned MinGprBudget = 16;
+	static constexpr unsigned MaxGprs = 255;
+	// Alignment of SSBO addresses in bytes, unless the application guarantees more (see ssboAlignment)
+	static constexpr unsigned MinSsboAlignment = 4;
+	static constexpr unsigned MaxSsboAlignment = 16;
+
+	// maxGprs: register budget (0 = hardware limit), can be overridden by '#pragma max_gprs(N)'
+	// unrollBudget: size limit in IR nodes for unrolled loops (0 = default)
+	// ssboAlignment: alignment in bytes of the addresses SSBOs are bound at (power of two, 4 to 16), higher values allow
+	//   merging SSBO accesses into wider ones
+	// timings: NV50_IR_TIMING_COUNT entries replacing the built-in timing model (see LoadTimings), must outlive the compiler
+	DekoCompiler(pipeline_stage stage, int optLevel = 3, unsigned maxGprs = 0, unsigned unrollBudget = 0,
+		unsigned ssboAlignment = MinSsboAlignment, const nv50_ir_timing* timings = nullptr);
 	~DekoCompiler();
 
-	bool CompileGlsl(const char* glsl);
+	void ComputeCacheKey(const char* preprocessedGlsl, uint8_t key[20]);
+	bool CompileGlsl(const char* glsl, const char* const* defines = nullptr, IncludeResolver* includes = nullptr);
+	void OutputDksh(std::vector<uint8_t>& dksh);
+	// names: one per program, or numNames names mapped to programs by nameProgramIds (several names may share a program)
+	static void OutputDksh(std::vector<uint8_t>& dksh, DekoCompiler* const* programs, unsigned numPrograms, const char* const* names = nullptr,
+		unsigned numNames = 0, const unsigned* nameProgramIds = nullptr);
 	void OutputDksh(const char* dkshFile);
 	void OutputRawCode(const char* rawFile);
 	void OutputTgsi(const char* tgsiFile);
+
+	// Static performance estimates for the Tegra X1 (GM20B) SM
+	static constexpr unsigned MaxWarpsPerSM = 64;
+	unsigned CalcOccupancy() const; // resident warps per SM
+	static unsigned CalcGprBudget(unsigned targetWarps); // max registers that still allow targetWarps per SM
+
+	// Instruction timing model used for scheduling, as a text file with one "<class> <latency> <result latency> <throughput>"
+	// line per instruction class. LoadTimings starts from the built-in model, so a file only needs the classes it changes.
+	static bool LoadTimings(const char* timingFile, nv50_ir_timing timings[NV50_IR_TIMING_COUNT]);
+	static void OutputTimings(std::string& text);
+	void OutputPerfReport(std::string& json, unsigned indent) const;
 };
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+
+#include "diagnostics.h"
+
+namespace
+{
+	struct DiagState
+	{
+		diag_handler handler;
+		void* user;
+		std::string pendingText;
+	};
+
+	thread_local DiagState s_state;
+
+	diag_severity ClassifyLine(const char* line)
+	{
+		// nv50_ir messages (ERROR/WARN macros)
+		if (strncmp(line, "ERROR: ", 7) == 0)
+			return diag_severity_error;
+		if (strncmp(line, "WARNING: ", 9) == 0)
+			return diag_severity_warning;
+
+		// GLSL compiler info log lines ("0:12(3): error: ...")
+		if (strncmp(line, "error: ", 7) == 0 || strstr(line, ": error: "))
+			return diag_severity_error;
+		if (strncmp(line, "warning: ", 9) == 0 || strstr(line, ": warning: "))
+			return diag_severity_warning;
+
+		return diag_severity_info;
+	}
+
+	void FlushPendingText(bool all)
+	{
+		std::string& text = s_state.pendingText;
+		size_t pos = 0, nl;
+		while ((nl = text.find('\n', pos)) != std::string::npos)
+		{
+			std::string line = text.substr(pos, nl - pos);
+			s_state.handler(s_state.user, ClassifyLine(line.c_str()), line.c_str());
+			pos = nl + 1;
+		}
+		if (all && pos < text.size())
+		{
+			std::string line = text.substr(pos);
+			s_state.handler(s_state.user, ClassifyLine(line.c_str()), line.c_str());
+			pos = text.size();
+		}
+		text.erase(0, pos);
+	}
+}
+
+void diag_set_handler(diag_handler handler, void* user)
+{
+	if (s_state.handler)
+		FlushPendingText(true);
+	s_state.pendingText.clear();
+	s_state.handler = handler;
+	s_state.user = user;
+}
+
+void diag_message(diag_severity severity, const char* message)
+{
+	if (s_state.handler)
+		s_state.handler(s_state.user, severity, message);
+	else
+		fprintf(stderr, "%s\n", message);
+}
+
+void diag_printf(diag_severity severity, const char* fmt, ...)
+{
+	char buf[1024];
+	va_list va;
+	va_start(va, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	diag_message(severity, buf);
+}
+
+// Reports the contents of a GLSL compiler/linker info log, one diagnostic per line.
+void diag_info_log(const char* log)
+{
+	if (!log || !log[0])
+		return;
+
+	if (!s_state.handler)
+	{
+		fprintf(stderr, "%s\n", log);
+		return;
+	}
+
+	for (const char* line = log; *line; )
+	{
+		const char* end = strchr(line, '\n');
+		std::string msg = end ? std::string(line, end) : std::string(line);
+		if (!msg.empty())
+			s_state.handler(s_state.user, ClassifyLine(msg.c_str()), msg.c_str());
+		if (!end)
+			break;
+		line = end + 1;
+	}
+}
+
+// Reports free-form text that may contain partial lines (used for mesa/nouveau debug output).
+void diag_log_text(const char* text)
+{
+	if (!s_state.handler)
+	{
+		fputs(text, stderr);
+		return;
+	}
+
+	s_state.pendingText += text;
+	FlushPendingText(false);
+}
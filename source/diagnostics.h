@@ -0,0 +1,30 @@
+#pragma once
+
+// Diagnostic messages emitted by the compiler (errors, warnings and other
+// informational output). By default they are printed to stderr, however a
+// handler can be installed on a per-thread basis in order to capture them
+// (e.g. when compiling several shaders in parallel, or when using libuam).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	diag_severity_info,
+	diag_severity_warning,
+	diag_severity_error,
+} diag_severity;
+
+// message is a single line of text, without the trailing newline.
+typedef void (*diag_handler)(void* user, diag_severity severity, const char* message);
+
+void diag_set_handler(diag_handler handler, void* user);
+void diag_message(diag_severity severity, const char* message);
+void diag_printf(diag_severity severity, const char* fmt, ...);
+void diag_info_log(const char* log);
+void diag_log_text(const char* text);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,7 @@
 // Layout of the control section:
 // - DkshHeader
 // - DkshProgramHeader[]
+// - DkshNameIndexHeader (optional, see below)
 
 #define DKSH_MAGIC UINT32_C(0x48534B44) // DKSH
 
@@ -83,3 +84,27 @@ struct DkshProgramHeader
 };
 
 static_assert(sizeof(DkshProgramHeader)==64, "Wrong size for DkshProgramHeader");
+
+// Optional program name index, located right after the DkshProgramHeader array.
+// It is emitted when packing several programs into a single module, and lets
+// the loader find a program by name. Several names may refer to the same program. Layout:
+// - DkshNameIndexHeader
+// - DkshNameIndexEntry[num_entries], sorted by name
+// - NUL-terminated names (strings_off is relative to the index header,
+//   and name_off is relative to the start of the names)
+
+#define DKSH_NAME_INDEX_MAGIC UINT32_C(0x584E4B44) // DKNX
+
+struct DkshNameIndexHeader
+{
+	uint32_t magic; // DKSH_NAME_INDEX_MAGIC
+	uint32_t num_entries;
+	uint32_t strings_off;
+	uint32_t strings_sz;
+};
+
+struct DkshNameIndexEntry
+{
+	uint32_t name_off;
+	uint32_t program_id;
+};
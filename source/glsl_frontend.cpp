@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <set>
+#include <tuple>
 
 #include "glsl/ast.h"
 #include "glsl/glsl_parser_extras.h"
@@ -21,12 +23,17 @@
 #include "glsl/ir_uniform.h"
 #include "pipe/p_state.h"
 
+#include "c11/threads.h"
+#include "util/u_time_report.h"
+
 extern "C"
 {
 #include "tgsi/tgsi_parse.h"
 }
 
 #include "glsl_frontend.h"
+#include "include_resolver.h"
+#include "diagnostics.h"
 
 class dead_variable_visitor : public ir_hierarchical_visitor {
 public:
@@ -82,6 +89,30 @@ private:
 	set *variables;
 };
 
+// The loop unroller leaves an unroll(N) factor on a loop when it can't honor it
+// (unknown or too large trip count, trip count not a multiple of N, or a loop that
+// has other exits), whereas an honored factor is consumed. Report each such loop
+// once, as function inlining may have cloned it.
+class ignored_unroll_hint_visitor : public ir_hierarchical_visitor {
+public:
+	virtual ir_visitor_status visit_enter(ir_loop *ir)
+	{
+		if (ir->unroll_hint <= 0)
+			return visit_continue;
+
+		const auto& loc = ir->unroll_hint_location;
+		if (reported.insert(std::make_tuple(loc.source, loc.line, loc.column)).second)
+			diag_printf(diag_severity_warning,
+				"%u:%u(%u): warning: #pragma unroll(%d) has no effect: the loop's trip count is unknown, too large or not a multiple of %d, or the loop has more than one exit",
+				loc.source, loc.line, loc.column, ir->unroll_hint, ir->unroll_hint);
+
+		return visit_continue;
+	}
+
+private:
+	std::set<std::tuple<unsigned, unsigned, unsigned>> reported;
+};
+
 struct gl_program_with_tgsi : public gl_program
 {
 	struct glsl_to_tgsi_visitor *glsl_to_tgsi;
@@ -143,7 +174,7 @@ new_program(UNUSED struct gl_context *ctx, GLenum target,
 		return prog;
 	}
 	default:
-		printf("bad target in new_program\n");
+		diag_message(diag_severity_error, "bad target in new_program");
 		return NULL;
 	}
 }
@@ -266,6 +297,7 @@ initialize_context(struct gl_context *ctx, gl_api api)
 		options->MaxIfDepth = 16;
 		options->EmitNoIndirectOutput = sh == PIPE_SHADER_FRAGMENT ? GL_TRUE : GL_FALSE;
 		options->MaxUnrollIterations = 16384;
+		options->MaxUnrollSize = 4096;
 		options->LowerCombinedClipCullDistance = GL_TRUE;
 		options->LowerBufferInterfaceBlocks = GL_TRUE;
 	}
@@ -327,17 +359,39 @@ initialize_context(struct gl_context *ctx, gl_api api)
 	ctx->Driver.NewProgram = new_program;
 }
 
+// Template context, copied into a private context for each compilation job so that
+// multiple programs can be created concurrently from different threads.
 static struct gl_context gl_ctx;
+static unsigned gl_ctx_refcount;
+static mtx_t gl_ctx_lock = _MTX_INITIALIZER_NP;
 
+// The frontend is reference counted so that a caller compiling many shaders in a row
+// (e.g. batch mode) can keep the builtin function, builtin variable and glsl_type tables,
+// as well as the preprocessed #include files, alive across compilations instead of
+// regenerating them for every shader.
 void glsl_frontend_init()
 {
-	initialize_context(&gl_ctx, API_OPENGL_CORE);
+	mtx_lock(&gl_ctx_lock);
+	if (gl_ctx_refcount++ == 0)
+	{
+		initialize_context(&gl_ctx, API_OPENGL_CORE);
+		glcpp_include_cache_init();
+	}
+	mtx_unlock(&gl_ctx_lock);
 }
 
 void glsl_frontend_exit()
 {
-	_mesa_glsl_release_types();
-	_mesa_glsl_release_builtin_functions();
+	mtx_lock(&gl_ctx_lock);
+	assert(gl_ctx_refcount > 0);
+	if (--gl_ctx_refcount == 0)
+	{
+		_mesa_glsl_release_builtin_variables();
+		_mesa_glsl_release_types();
+		_mesa_glsl_release_builtin_functions();
+		glcpp_include_cache_release();
+	}
+	mtx_unlock(&gl_ctx_lock);
 }
 
 // Prototypes for translation functions
@@ -348,9 +402,25 @@ bool tgsi_translate_geometry(struct gl_context *ctx, struct gl_program *prog);
 bool tgsi_translate_fragment(struct gl_context *ctx, struct gl_program *prog);
 bool tgsi_translate_compute(struct gl_context *ctx, struct gl_program *prog);
 
-glsl_program glsl_program_create(const char* source, pipeline_stage stage)
+static const char* const s_tgsiTranslatePhase[] =
+{
+	"tgsi_translate_vertex",
+	"tgsi_translate_tessctrl",
+	"tgsi_translate_tesseval",
+	"tgsi_translate_geometry",
+	"tgsi_translate_fragment",
+	"tgsi_translate_compute",
+};
+
+glsl_program glsl_program_create(const char* source, pipeline_stage stage, unsigned unroll_budget, const char* const* defines,
+	IncludeResolver* includes)
 {
 	struct gl_shader_program *prg;
+	struct gl_context *ctx;
+
+	ctx = (struct gl_context *)malloc(sizeof(struct gl_context));
+	assert(ctx != NULL);
+	memcpy(ctx, &gl_ctx, sizeof(struct gl_context));
 
 	prg = rzalloc (NULL, struct gl_shader_program);
 	assert(prg != NULL);
@@ -398,31 +468,49 @@ glsl_program glsl_program_create(const char* source, pipeline_stage stage)
 	}
 	shader->Stage = _mesa_shader_enum_to_shader_stage(shader->Type);
 	shader->Source = source;
+	shader->Defines = defines;
+	if (includes)
+	{
+		shader->IncludeFunc = IncludeResolver::Callback;
+		shader->IncludeData = includes;
+	}
+
+	// Override the loop unrolling budget in this program's copy of the context
+	if (unroll_budget)
+		ctx->Const.ShaderCompilerOptions[shader->Stage].MaxUnrollSize = unroll_budget;
 
 	// "Compile" the shader
-	_mesa_glsl_compile_shader(&gl_ctx, shader, false, false, true);
+	util_time_report_begin("glsl_compile");
+	_mesa_glsl_compile_shader(ctx, shader, false, false, true);
+	util_time_report_end();
 	if (shader->CompileStatus != COMPILE_SUCCESS)
 	{
-		fprintf(stderr, "Shader failed to compile.\n");
-		if (shader->InfoLog && shader->InfoLog[0])
-			fprintf(stderr, "%s\n", shader->InfoLog);
+		diag_message(diag_severity_error, "Shader failed to compile.");
+		diag_info_log(shader->InfoLog);
 		goto _fail;
 	}
-	_mesa_clear_shader_program_data(&gl_ctx, prg);
+	_mesa_clear_shader_program_data(ctx, prg);
 
 	// Link the shader
-	link_shaders(&gl_ctx, prg);
+	util_time_report_begin("link_shaders");
+	link_shaders(ctx, prg);
+	util_time_report_end();
 	if (prg->data->LinkStatus != LINKING_SUCCESS)
 	{
-		fprintf(stderr, "Shader failed to link.\n");
-		if (prg->data->InfoLog && prg->data->InfoLog[0])
-			fprintf(stderr, "%s\n", prg->data->InfoLog);
+		diag_message(diag_severity_error, "Shader failed to link.");
+		diag_info_log(prg->data->InfoLog);
 		goto _fail;
 	}
 	else
 	{
 		struct gl_linked_shader *linked_shader = prg->_LinkedShaders[shader->Stage];
 
+		// The linker made its own copy of the IR, so the compiled one (along with its
+		// symbol table) can be freed now rather than in glsl_program_free
+		ralloc_free(shader->ir);
+		shader->ir = NULL;
+		shader->symbols = NULL;
+
 		// Do more optimizations
 		add_neg_to_sub_visitor v;
 		visit_list_elements(&v, linked_shader->ir);
@@ -431,58 +519,67 @@ glsl_program glsl_program_create(const char* source, pipeline_stage stage)
 		visit_list_elements(&dv, linked_shader->ir);
 		dv.remove_dead_variables();
 
+		ignored_unroll_hint_visitor uv;
+		visit_list_elements(&uv, linked_shader->ir);
+
 		// Print IR
 		//_mesa_print_ir(stdout, linked_shader->ir, NULL);
 
 		// Do the TGSI conversion
-		if (!st_link_shader(&gl_ctx, prg))
+		util_time_report_begin("st_link_shader");
+		bool linked = st_link_shader(ctx, prg);
+		util_time_report_end();
+		if (!linked)
 		{
-			fprintf(stderr, "st_link_shader failed\n");
+			diag_message(diag_severity_error, "st_link_shader failed");
 			goto _fail;
 		}
 
 		// Force OriginUpperLeft
 		if (linked_shader->Program->OriginUpperLeft)
-			fprintf(stderr, "warning: origin_upper_left has no effect\n");
+			diag_message(diag_severity_warning, "warning: origin_upper_left has no effect");
 		linked_shader->Program->OriginUpperLeft = GL_TRUE;
 
 		// Check for PixelCenterInteger (unsupported)
 		if (linked_shader->Program->PixelCenterInteger == GL_TRUE) {
-			fprintf(stderr, "error: pixel_center_integer is not supported\n");
+			diag_message(diag_severity_error, "error: pixel_center_integer is not supported");
 			goto _fail;
 		}
 
 		// TGSI generation
 		bool rc = false;
+		util_time_report_begin(s_tgsiTranslatePhase[stage]);
 		switch (stage)
 		{
 			case pipeline_stage_vertex:
-				rc = tgsi_translate_vertex(&gl_ctx, linked_shader->Program,
+				rc = tgsi_translate_vertex(ctx, linked_shader->Program,
 					gl_program_with_tgsi::from_ptr(linked_shader->Program)->vtx_in_locations);
 				break;
 			case pipeline_stage_tess_ctrl:
-				rc = tgsi_translate_tessctrl(&gl_ctx, linked_shader->Program);
+				rc = tgsi_translate_tessctrl(ctx, linked_shader->Program);
 				break;
 			case pipeline_stage_tess_eval:
-				rc = tgsi_translate_tesseval(&gl_ctx, linked_shader->Program);
+				rc = tgsi_translate_tesseval(ctx, linked_shader->Program);
 				break;
 			case pipeline_stage_geometry:
-				rc = tgsi_translate_geometry(&gl_ctx, linked_shader->Program);
+				rc = tgsi_translate_geometry(ctx, linked_shader->Program);
 				break;
 			case pipeline_stage_fragment:
-				rc = tgsi_translate_fragment(&gl_ctx, linked_shader->Program);
+				rc = tgsi_translate_fragment(ctx, linked_shader->Program);
 				break;
 			case pipeline_stage_compute:
-				rc = tgsi_translate_compute(&gl_ctx, linked_shader->Program);
+				rc = tgsi_translate_compute(ctx, linked_shader->Program);
 				break;
 			default:
-				fprintf(stderr, "Unsupported stage\n");
+				util_time_report_end();
+				diag_message(diag_severity_error, "Unsupported stage");
 				goto _fail;
 		}
+		util_time_report_end();
 
 		if (!rc)
 		{
-			fprintf(stderr, "Translation failed\n");
+			diag_message(diag_severity_error, "Translation failed");
 			goto _fail;
 		}
 
@@ -501,7 +598,7 @@ glsl_program glsl_program_create(const char* source, pipeline_stage stage)
 			if (location != last_location)
 			{
 				last_location = location;
-				fprintf(stderr, "error: uniform '%s' in driver constbuf (c[0x1][0x%03x]) not supported\n",
+				diag_printf(diag_severity_error, "error: uniform '%s' in driver constbuf (c[0x1][0x%03x]) not supported",
 					p->Name,
 					// "(type=%d dim=%ux%u size=%u)"
 					//storage->type->base_type,
@@ -515,13 +612,43 @@ glsl_program glsl_program_create(const char* source, pipeline_stage stage)
 			goto _fail;
 	}
 
+	free(ctx);
 	return prg;
 
 _fail:
+	free(ctx);
 	glsl_program_free(prg);
 	return NULL;
 }
 
+char* glsl_preprocess(const char* source, pipeline_stage stage, const char* const* defines, IncludeResolver* includes)
+{
+	gl_shader_stage mesa_stage;
+	switch (stage)
+	{
+		case pipeline_stage_vertex:    mesa_stage = MESA_SHADER_VERTEX; break;
+		case pipeline_stage_tess_ctrl: mesa_stage = MESA_SHADER_TESS_CTRL; break;
+		case pipeline_stage_tess_eval: mesa_stage = MESA_SHADER_TESS_EVAL; break;
+		case pipeline_stage_geometry:  mesa_stage = MESA_SHADER_GEOMETRY; break;
+		case pipeline_stage_fragment:  mesa_stage = MESA_SHADER_FRAGMENT; break;
+		case pipeline_stage_compute:   mesa_stage = MESA_SHADER_COMPUTE; break;
+		default: return NULL;
+	}
+
+	struct gl_context *ctx = (struct gl_context *)malloc(sizeof(struct gl_context));
+	assert(ctx != NULL);
+	memcpy(ctx, &gl_ctx, sizeof(struct gl_context));
+
+	void *mem_ctx = ralloc_context(NULL);
+	char *preprocessed = _mesa_glsl_preprocess_shader(ctx, mesa_stage, source, mem_ctx, NULL, defines,
+		includes ? IncludeResolver::Callback : NULL, includes);
+	char *ret = preprocessed ? strdup(preprocessed) : NULL;
+
+	ralloc_free(mem_ctx);
+	free(ctx);
+	return ret;
+}
+
 static struct gl_linked_shader *_glsl_program_get_linked_shader(glsl_program prg)
 {
 	struct gl_linked_shader *linked_shader = NULL;
@@ -576,6 +703,11 @@ unsigned glsl_program_compute_get_shared_size(glsl_program prg)
 	return linked_shader->Program->info.cs.shared_size;
 }
 
+unsigned glsl_program_get_max_gprs(glsl_program prg)
+{
+	return prg->NumShaders ? prg->Shaders[0]->MaxGPRs : 0;
+}
+
 void glsl_program_free(glsl_program prg)
 {
 	for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
@@ -3,6 +3,7 @@
 
 struct gl_shader_program;
 struct tgsi_token;
+class IncludeResolver;
 
 typedef struct gl_shader_program* glsl_program;
 
@@ -19,9 +20,14 @@ enum pipeline_stage
 void glsl_frontend_init();
 void glsl_frontend_exit();
 
-glsl_program glsl_program_create(const char* source, pipeline_stage stage);
+// defines: optional NULL-terminated list of "NAME[=VALUE]" macros defined before the source is preprocessed
+// includes: resolves #include directives (if NULL, they are reported as errors)
+char* glsl_preprocess(const char* source, pipeline_stage stage, const char* const* defines = nullptr, IncludeResolver* includes = nullptr);
+glsl_program glsl_program_create(const char* source, pipeline_stage stage, unsigned unroll_budget = 0, const char* const* defines = nullptr,
+	IncludeResolver* includes = nullptr);
 const tgsi_token* glsl_program_get_tokens(glsl_program prg, unsigned int& num_tokens);
 void* glsl_program_get_constant_buffer(glsl_program prg, unsigned int& out_size);
 int8_t const* glsl_program_vertex_get_in_locations(glsl_program prg);
 unsigned glsl_program_compute_get_shared_size(glsl_program prg);
+unsigned glsl_program_get_max_gprs(glsl_program prg);
 void glsl_program_free(glsl_program prg);
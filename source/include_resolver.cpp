@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "include_resolver.h"
+#include "diagnostics.h"
+
+namespace
+{
+	bool IsPathSeparator(char c)
+	{
+		return c == '/' || c == '\\';
+	}
+
+	// Directory part of a path, including the trailing separator (empty for the current directory)
+	std::string GetDirectory(std::string const& path)
+	{
+		size_t pos = path.size();
+		while (pos && !IsPathSeparator(path[pos-1]))
+			pos--;
+		return path.substr(0, pos);
+	}
+
+	std::string JoinPath(std::string const& dir, const char* path)
+	{
+		if (dir.empty() || IsPathSeparator(dir.back()))
+			return dir + path;
+		return dir + "/" + path;
+	}
+
+	bool ReadFile(std::string const& path, std::string& contents)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f)
+			return false;
+
+		char buf[4096];
+		size_t size;
+		contents.clear();
+		while ((size = fread(buf, 1, sizeof(buf), f)) > 0)
+			contents.append(buf, size);
+		fclose(f);
+		return true;
+	}
+
+	// Escapes the characters that Make and Ninja treat specially in dependency lists
+	void AppendDepPath(std::string& out, std::string const& path)
+	{
+		for (char c : path)
+		{
+			if (c == ' ' || c == '#')
+				out += '\\';
+			else if (c == '$')
+				out += '$';
+			out += c;
+		}
+	}
+}
+
+IncludeResolver::IncludeResolver(const char* mainFile, std::vector<std::string> const& searchPaths) :
+	m_searchPaths{searchPaths}
+{
+	m_files.emplace_back(new File{mainFile, {}});
+}
+
+const char* IncludeResolver::Resolve(const char* path, bool systemPath, unsigned includer, unsigned& sourceNumber)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// '#line' directives may set arbitrary source string numbers, treat unknown ones as the main file
+	if (includer >= m_files.size())
+		includer = 0;
+
+	std::vector<std::string> candidates;
+	if (IsPathSeparator(path[0]))
+		candidates.push_back(path);
+	else
+	{
+		if (!systemPath)
+			candidates.push_back(JoinPath(GetDirectory(m_files[includer]->path), path));
+		for (auto& dir : m_searchPaths)
+			candidates.push_back(JoinPath(dir, path));
+	}
+
+	for (auto& candidate : candidates)
+	{
+		for (unsigned i = 1; i < m_files.size(); i ++)
+			if (m_files[i]->path == candidate)
+			{
+				sourceNumber = i;
+				return m_files[i]->contents.c_str();
+			}
+
+		std::unique_ptr<File> file{new File{candidate, {}}};
+		if (ReadFile(candidate, file->contents))
+		{
+			sourceNumber = m_files.size();
+			m_files.push_back(std::move(file));
+			return m_files.back()->contents.c_str();
+		}
+	}
+
+	return nullptr;
+}
+
+const char* IncludeResolver::Callback(void* data, const char* path, bool systemPath, unsigned includer, unsigned* sourceNumber)
+{
+	return static_cast<IncludeResolver*>(data)->Resolve(path, systemPath, includer, *sourceNumber);
+}
+
+bool IncludeResolver::WriteDepfile(const char* depFile, const char* target)
+{
+	std::string rule;
+	AppendDepPath(rule, target);
+	rule += ':';
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& file : m_files)
+		{
+			rule += " \\\n  ";
+			AppendDepPath(rule, file->path);
+		}
+	}
+	rule += '\n';
+
+	FILE* f = fopen(depFile, "w");
+	if (!f)
+	{
+		diag_printf(diag_severity_error, "Could not open dependency file: %s", depFile);
+		return false;
+	}
+
+	fwrite(rule.data(), 1, rule.size(), f);
+	fclose(f);
+	return true;
+}
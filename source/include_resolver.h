@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Resolves the #include directives of a shader: "file" is looked up relative to the directory of
+// the including file and then in the search paths, while <file> is only looked up in the search paths.
+// Each file is read once and gets a GLSL source string number (the main file being 0), which is
+// what diagnostics refer to. A resolver may be shared by several compilations of the same shader.
+class IncludeResolver
+{
+	struct File
+	{
+		std::string path;
+		std::string contents;
+	};
+
+	std::vector<std::string> m_searchPaths;
+	std::vector<std::unique_ptr<File>> m_files; // indexed by source string number
+	std::mutex m_mutex;
+
+	const char* Resolve(const char* path, bool systemPath, unsigned includer, unsigned& sourceNumber);
+
+public:
+	IncludeResolver(const char* mainFile, std::vector<std::string> const& searchPaths);
+
+	// glcpp_include_func callback, with the resolver as user data
+	static const char* Callback(void* data, const char* path, bool systemPath, unsigned includer, unsigned* sourceNumber);
+
+	// Writes a Makefile rule listing the main file and all the included files read so far
+	bool WriteDepfile(const char* depFile, const char* target);
+};
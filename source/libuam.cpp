@@ -0,0 +1,105 @@
+#include <new>
+#include <string>
+#include "compiler_iface.h"
+#include "uam.h"
+
+static_assert(int(uam_stage_vertex)    == int(pipeline_stage_vertex),    "uam_stage mismatch");
+static_assert(int(uam_stage_tess_ctrl) == int(pipeline_stage_tess_ctrl), "uam_stage mismatch");
+static_assert(int(uam_stage_tess_eval) == int(pipeline_stage_tess_eval), "uam_stage mismatch");
+static_assert(int(uam_stage_geometry)  == int(pipeline_stage_geometry),  "uam_stage mismatch");
+static_assert(int(uam_stage_fragment)  == int(pipeline_stage_fragment),  "uam_stage mismatch");
+static_assert(int(uam_stage_compute)   == int(pipeline_stage_compute),   "uam_stage mismatch");
+
+static_assert(int(uam_severity_info)    == int(diag_severity_info),    "uam_severity mismatch");
+static_assert(int(uam_severity_warning) == int(diag_severity_warning), "uam_severity mismatch");
+static_assert(int(uam_severity_error)   == int(diag_severity_error),   "uam_severity mismatch");
+
+struct uam_result
+{
+	bool succeeded;
+	std::vector<uint8_t> dksh;
+	std::vector<std::string> messages;
+	std::vector<uam_diagnostic> diagnostics;
+
+	static void DiagHandler(void* user, diag_severity severity, const char* message)
+	{
+		uam_result* self = static_cast<uam_result*>(user);
+		self->messages.emplace_back(message);
+		self->diagnostics.push_back(uam_diagnostic{ uam_severity(severity), nullptr });
+	}
+};
+
+void uam_init(void)
+{
+	glsl_frontend_init();
+}
+
+void uam_exit(void)
+{
+	glsl_frontend_exit();
+}
+
+void uam_options_init(uam_options* options)
+{
+	options->opt_level = 3;
+	options->max_gprs = 0;
+	options->unroll_budget = 0;
+	options->ssbo_alignment = 4;
+}
+
+uam_result* uam_compile(const char* source, uam_stage stage, const uam_options* options)
+{
+	uam_options defaultOptions;
+	if (!options)
+	{
+		uam_options_init(&defaultOptions);
+		options = &defaultOptions;
+	}
+
+	uam_result* result = new (std::nothrow) uam_result{};
+	if (!result)
+		return nullptr;
+
+	diag_set_handler(uam_result::DiagHandler, result);
+	{
+		DekoCompiler compiler{pipeline_stage(stage), options->opt_level, options->max_gprs, options->unroll_budget,
+			options->ssbo_alignment};
+		result->succeeded = compiler.CompileGlsl(source);
+		if (result->succeeded)
+			compiler.OutputDksh(result->dksh);
+	}
+	diag_set_handler(nullptr, nullptr);
+
+	// The message strings no longer move around, so the diagnostic array can now point to them
+	for (size_t i = 0; i < result->diagnostics.size(); i ++)
+		result->diagnostics[i].message = result->messages[i].c_str();
+
+	return result;
+}
+
+bool uam_result_succeeded(const uam_result* result)
+{
+	return result->succeeded;
+}
+
+const void* uam_result_get_dksh(const uam_result* result, size_t* size)
+{
+	if (size)
+		*size = result->dksh.size();
+	return result->dksh.empty() ? nullptr : result->dksh.data();
+}
+
+size_t uam_result_get_num_diagnostics(const uam_result* result)
+{
+	return result->diagnostics.size();
+}
+
+const uam_diagnostic* uam_result_get_diagnostic(const uam_result* result, size_t index)
+{
+	return index < result->diagnostics.size() ? &result->diagnostics[index] : nullptr;
+}
+
+void uam_result_free(uam_result* result)
+{
+	delete result;
+}
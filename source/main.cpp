@@ -1,24 +1,859 @@
 #include "compiler_iface.h"
+#include "shader_cache.h"
+#include "compile_server.h"
+#include "time_report.h"
+#include "include_resolver.h"
 #include <getopt.h>
+#include <ctype.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum
+{
+	OPT_CACHE_SIZE = 0x100,
+	OPT_SERVER,
+	OPT_TIME_REPORT,
+	OPT_PERF_REPORT,
+	OPT_MAX_GPRS,
+	OPT_TARGET_OCCUPANCY,
+	OPT_UNROLL_BUDGET,
+	OPT_SSBO_ALIGNMENT,
+	OPT_PERMUTE,
+	OPT_TIMINGS,
+	OPT_DUMP_TIMINGS,
+};
+
+// Register budget passed to every compiled program (0 = hardware limit)
+static unsigned s_maxGprs;
+
+// Size limit in IR nodes for unrolled loops (0 = default)
+static unsigned s_unrollBudget;
+
+// Guaranteed alignment in bytes of the addresses SSBOs are bound at
+static unsigned s_ssboAlignment = DekoCompiler::MinSsboAlignment;
+
+// Instruction timing model loaded with --timings (nullptr = built-in model)
+static nv50_ir_timing s_timingTable[NV50_IR_TIMING_COUNT];
+static const nv50_ir_timing* s_timings;
+
+// Directories searched by #include directives
+static std::vector<std::string> s_includeDirs;
 
 static int usage(const char* prog)
 {
 	fprintf(stderr,
 		"Usage: %s [options] file\n"
+		"       %s [options] --batch=<manifest>\n"
+		"       %s [options] --permute=<spec> -s <stage> -o <file> file\n"
+		"       %s [options] --server[=<socket>]\n"
 		"Options:\n"
 		"  -o, --out=<file>   Specifies the output deko3d shader module file (.dksh)\n"
 		"  -r, --raw=<file>   Specifies the file to which output raw Maxwell bytecode\n"
 		"  -t, --tgsi=<file>  Specifies the file to which output intermediary TGSI code\n"
 		"  -s, --stage=<name> Specifies the pipeline stage of the shader\n"
 		"                     (vert, tess_ctrl, tess_eval, geom, frag, comp)\n"
+		"  -b, --batch=<file> Compiles all shaders listed in a manifest file, one per line:\n"
+		"                     <stage> <input file> <output file (.dksh)>\n"
+		"  -p, --pack=<file>  Packs all programs of a batch into a single module (.dksh),\n"
+		"                     using the output column of the manifest as the program name\n"
+		"  -j, --jobs=<num>   Number of compiler threads (0 = one per core); defaults to 1 in\n"
+		"                     batch and permutation modes, and to one per core in server mode\n"
+		"  --permute=<file>   Compiles every combination of the macro values listed in a\n"
+		"                     permutation spec, packing the variants into a single module\n"
+		"  -I, --include-dir=<dir>\n"
+		"                     Adds a directory to the search paths of #include directives\n"
+		"  -MD                Writes a dependency file listing the shader and the files it\n"
+		"                     includes, named after the output file with a .d extension\n"
+		"  -MF <file>         Writes the dependency file to the given path (implies -MD)\n"
+		"  -c, --cache-dir=<dir>\n"
+		"                     Specifies a directory used to cache compiled shader modules\n"
+		"  --cache-size=<MiB> Maximum size of the cache directory (default: 1024, 0 = unlimited)\n"
+		"  --max-gprs=<num>   Limits the number of registers each shader may use, spilling\n"
+		"                     if needed (can be overridden with #pragma max_gprs(num))\n"
+		"  --target-occupancy=<warps>\n"
+		"                     Limits register usage so that the given number of warps can\n"
+		"                     be resident on each SM (max 64)\n"
+		"  --unroll-budget=<nodes>\n"
+		"                     Maximum size of an unrolled loop, in IR nodes (default: 4096);\n"
+		"                     loops that don't fit are partially unrolled when possible\n"
+		"  --ssbo-alignment=<bytes>\n"
+		"                     Alignment that all SSBO bindings are guaranteed to have\n"
+		"                     (4, 8 or 16, default: 4); higher values let accesses to\n"
+		"                     consecutive SSBO members be merged into wider ones\n"
+		"  --timings=<file>   Loads the instruction latencies and throughputs used for\n"
+		"                     scheduling from a file, overriding the built-in values\n"
+		"  --dump-timings     Prints the built-in timing model in the --timings format\n"
+		"  --time-report=<file>\n"
+		"                     Writes the time and memory spent in each compilation phase\n"
+		"                     to a JSON file (single file and batch modes)\n"
+		"  --perf-report=<file>\n"
+		"                     Writes static performance estimates of the generated code\n"
+		"                     (stalls, dual issue, occupancy...) to a JSON file\n"
+		"  --server[=<socket>]\n"
+		"                     Runs a persistent compile server, which accepts requests from\n"
+		"                     stdin (or the given Unix domain socket) until closed\n"
 		"  -v, --version      Displays version information\n"
-		, prog);
+		, prog, prog, prog, prog);
 	return EXIT_FAILURE;
 }
 
+static bool parse_stage(const char* stageName, pipeline_stage& stage)
+{
+	if (0) ((void)0);
+#define TEST_STAGE(_str,_val) else if (strcmp(stageName,(_str))==0) stage = (_val)
+	TEST_STAGE("vert", pipeline_stage_vertex);
+	TEST_STAGE("tess_ctrl", pipeline_stage_tess_ctrl);
+	TEST_STAGE("tess_eval", pipeline_stage_tess_eval);
+	TEST_STAGE("geom", pipeline_stage_geometry);
+	TEST_STAGE("frag", pipeline_stage_fragment);
+	TEST_STAGE("comp", pipeline_stage_compute);
+#undef TEST_STAGE
+	else
+	{
+		fprintf(stderr, "Unrecognized pipeline stage: `%s'\n", stageName);
+		return false;
+	}
+	return true;
+}
+
+static char* read_file(const char* inFile)
+{
+	FILE* fin = fopen(inFile, "rb");
+	if (!fin)
+	{
+		diag_printf(diag_severity_error, "Could not open input file: %s", inFile);
+		return nullptr;
+	}
+
+	fseek(fin, 0, SEEK_END);
+	long fsize = ftell(fin);
+	rewind(fin);
+
+	char* data = new char[fsize+1];
+	fread(data, 1, fsize, fin);
+	fclose(fin);
+	data[fsize] = 0;
+	return data;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool write_file(const char* outFile, std::vector<uint8_t> const& data)
+{
+	FILE* f = fopen(outFile, "wb");
+	if (!f)
+	{
+		diag_printf(diag_severity_error, "Could not open output file: %s", outFile);
+		return false;
+	}
+
+	fwrite(data.data(), 1, data.size(), f);
+	fclose(f);
+	return true;
+}
+
+// Dependency file written by -MD: the output file with its extension replaced by ".d"
+static std::string default_depfile(const char* outFile)
+{
+	std::string path = outFile;
+	size_t ext = path.find_last_of("./\\");
+	if (ext != std::string::npos && path[ext] == '.')
+		path.resize(ext);
+	return path + ".d";
+}
+
+static bool compile_file(pipeline_stage stage, const char* inFile, const char* outFile, const char* rawFile, const char* tgsiFile,
+	ShaderCache* cache = nullptr, bool* cacheHit = nullptr, std::string* perfReport = nullptr, const char* depFile = nullptr)
+{
+	char* glsl_source = read_file(inFile);
+	if (!glsl_source)
+		return false;
+
+	DekoCompiler compiler{stage, 3, s_maxGprs, s_unrollBudget, s_ssboAlignment, s_timings};
+	IncludeResolver includes{inFile, s_includeDirs};
+	const char* depTarget = outFile ? outFile : rawFile ? rawFile : tgsiFile;
+
+	// The cache only contains DKSH modules, so it is bypassed if any other output is requested
+	// (including performance reports, which need the code generator to run).
+	// The key is derived from the preprocessed source, which means that edits that don't affect
+	// the preprocessor output (comments, unused macros, etc) still result in cache hits.
+	uint8_t cacheKey[20];
+	bool useCache = cache && outFile && !rawFile && !tgsiFile && !perfReport;
+	if (useCache)
+	{
+		char* preprocessed = glsl_preprocess(glsl_source, stage, nullptr, &includes);
+		useCache = preprocessed != nullptr; // let the compiler report preprocessing errors
+		if (useCache)
+		{
+			compiler.ComputeCacheKey(preprocessed, cacheKey);
+			free(preprocessed);
+
+			std::vector<uint8_t> dksh;
+			if (cache->Load(cacheKey, dksh))
+			{
+				delete[] glsl_source;
+				if (cacheHit)
+					*cacheHit = true;
+				return write_file(outFile, dksh) && (!depFile || includes.WriteDepfile(depFile, depTarget));
+			}
+		}
+	}
+
+	bool rc = compiler.CompileGlsl(glsl_source, nullptr, &includes);
+	delete[] glsl_source;
+
+	if (!rc)
+		return false;
+
+	if (depFile && !includes.WriteDepfile(depFile, depTarget))
+		return false;
+
+	if (outFile)
+	{
+		std::vector<uint8_t> dksh;
+		compiler.OutputDksh(dksh);
+		if (useCache)
+			cache->Store(cacheKey, dksh);
+		if (!write_file(outFile, dksh))
+			return false;
+	}
+
+	if (rawFile)
+		compiler.OutputRawCode(rawFile);
+
+	if (tgsiFile)
+		compiler.OutputTgsi(tgsiFile);
+
+	if (perfReport)
+		compiler.OutputPerfReport(*perfReport, 3);
+
+	return true;
+}
+
+static std::unique_ptr<DekoCompiler> compile_program(pipeline_stage stage, const char* inFile)
+{
+	char* glsl_source = read_file(inFile);
+	if (!glsl_source)
+		return nullptr;
+
+	std::unique_ptr<DekoCompiler> compiler{new DekoCompiler{stage, 3, s_maxGprs, s_unrollBudget, s_ssboAlignment, s_timings}};
+	IncludeResolver includes{inFile, s_includeDirs};
+	bool rc = compiler->CompileGlsl(glsl_source, nullptr, &includes);
+	delete[] glsl_source;
+
+	if (!rc)
+		compiler.reset();
+	return compiler;
+}
+
+struct BatchJob
+{
+	pipeline_stage stage;
+	std::string stageName;
+	std::string inFile;
+	std::string output; // output file, or program name when packing
+	std::unique_ptr<DekoCompiler> program;
+	bool done;
+	bool rc;
+	bool cacheHit;
+	double time;
+	std::string log; // diagnostics captured while compiling in parallel
+	TimeReport timeReport;
+	std::string perfReport;
+
+	static void DiagHandler(void* user, diag_severity severity, const char* message)
+	{
+		BatchJob* self = static_cast<BatchJob*>(user);
+		self->log += message;
+		self->log += '\n';
+	}
+};
+
+// Manifest lines have the form "<stage> <input> <output>", separated by whitespace.
+// When packing, the output column instead contains the name of the program in the module.
+// Empty lines and lines starting with '#' are ignored.
+static bool parse_manifest(const char* manifestFile, std::vector<BatchJob>& jobs)
+{
+	char* manifest = read_file(manifestFile);
+	if (!manifest)
+		return false;
+
+	unsigned lineNum = 0;
+	bool ok = true;
+
+	for (char *line = manifest, *next; line; line = next)
+	{
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+
+		lineNum++;
+		while (isspace((unsigned char)*line)) line++;
+		if (!*line || *line == '#')
+			continue;
+
+		char stageName[32], inFile[1024], output[1024];
+		if (sscanf(line, "%31s %1023s %1023s", stageName, inFile, output) != 3)
+		{
+			fprintf(stderr, "%s:%u: malformed manifest entry\n", manifestFile, lineNum);
+			ok = false;
+			break;
+		}
+
+		BatchJob job{};
+		if (!parse_stage(stageName, job.stage))
+		{
+			ok = false;
+			break;
+		}
+
+		job.stageName = stageName;
+		job.inFile = inFile;
+		job.output = output;
+		jobs.push_back(std::move(job));
+	}
+
+	delete[] manifest;
+	return ok;
+}
+
+static void run_batch_job(BatchJob& job, ShaderCache* cache, bool packing, bool captureDiagnostics, bool recordTimes, bool recordPerf,
+	bool writeDeps)
+{
+	if (captureDiagnostics)
+		diag_set_handler(BatchJob::DiagHandler, &job);
+	if (recordTimes)
+		TimeReport::MakeCurrent(&job.timeReport);
+
+	auto start = std::chrono::steady_clock::now();
+	if (packing)
+	{
+		job.program = compile_program(job.stage, job.inFile.c_str());
+		job.rc = job.program != nullptr;
+		if (job.rc && recordPerf)
+			job.program->OutputPerfReport(job.perfReport, 3);
+	}
+	else
+		job.rc = compile_file(job.stage, job.inFile.c_str(), job.output.c_str(), nullptr, nullptr,
+			cache, &job.cacheHit, recordPerf ? &job.perfReport : nullptr,
+			writeDeps ? default_depfile(job.output.c_str()).c_str() : nullptr);
+	job.time = elapsed_ms(start);
+
+	if (recordTimes)
+		TimeReport::MakeCurrent(nullptr);
+	if (captureDiagnostics)
+		diag_set_handler(nullptr, nullptr);
+}
+
+// Packs all programs compiled by the batch into a single module, in manifest order.
+static bool pack_batch(const char* packFile, std::vector<BatchJob> const& jobs)
+{
+	std::vector<DekoCompiler*> programs;
+	std::vector<const char*> names;
+	for (auto& job : jobs)
+	{
+		programs.push_back(job.program.get());
+		names.push_back(job.output.c_str());
+	}
+
+	for (size_t i = 1; i < names.size(); i ++)
+		for (size_t j = 0; j < i; j ++)
+			if (strcmp(names[i], names[j]) == 0)
+			{
+				fprintf(stderr, "Duplicate program name in manifest: %s\n", names[i]);
+				return false;
+			}
+
+	std::vector<uint8_t> dksh;
+	DekoCompiler::OutputDksh(dksh, programs.data(), programs.size(), names.data());
+	if (!write_file(packFile, dksh))
+		return false;
+
+	printf("Packed %u program(s) into %s (%u bytes)\n", unsigned(programs.size()), packFile, unsigned(dksh.size()));
+	return true;
+}
+
+// Time and performance reports are JSON files with one entry per shader: { "shaders": [ { ... }, ... ] }
+static void begin_report_entry(std::string& json, const char* inFile, const char* stageName, bool rc)
+{
+	json += json.empty() ? "{\n\t\"shaders\": [\n" : ",\n";
+	json += "\t\t{\n\t\t\t\"file\": ";
+	TimeReport::JsonString(json, inFile);
+	json += ",\n\t\t\t\"stage\": ";
+	TimeReport::JsonString(json, stageName);
+	json += rc ? ",\n\t\t\t\"succeeded\": true" : ",\n\t\t\t\"succeeded\": false";
+}
+
+static void append_time_report(std::string& json, const char* inFile, const char* stageName,
+	bool rc, bool cacheHit, double time, TimeReport const& report)
+{
+	char buf[128];
+	begin_report_entry(json, inFile, stageName, rc);
+	snprintf(buf, sizeof(buf), ",\n\t\t\t\"cached\": %s,\n\t\t\t\"time_ms\": %.3f,\n\t\t\t\"peak_bytes\": %lld,\n",
+		cacheHit ? "true" : "false", time, (long long)report.GetPeakMemory());
+	json += buf;
+	json += "\t\t\t\"phases\": [";
+	report.WriteJson(json, 4);
+	json += "\n\t\t\t]\n\t\t}";
+}
+
+static void append_perf_report(std::string& json, const char* inFile, const char* stageName,
+	bool rc, std::string const& perfReport)
+{
+	begin_report_entry(json, inFile, stageName, rc);
+	if (!perfReport.empty())
+		json += ",\n" + perfReport;
+	json += "\n\t\t}";
+}
+
+static bool write_report(const char* reportFile, std::string json)
+{
+	json += json.empty() ? "{\n\t\"shaders\": [\n\t]\n}\n" : "\n\t]\n}\n";
+	return write_file(reportFile, std::vector<uint8_t>{json.begin(), json.end()});
+}
+
+static void report_batch_job(BatchJob const& job)
+{
+	if (!job.log.empty())
+	{
+		fflush(stdout);
+		fputs(job.log.c_str(), stderr);
+	}
+	printf("%s %s: %.3f ms%s\n", job.stageName.c_str(), job.inFile.c_str(), job.time,
+		!job.rc ? " (FAILED)" : job.cacheHit ? " (cached)" : "");
+}
+
+static int compile_batch(const char* manifestFile, unsigned numThreads, ShaderCache* cache, const char* packFile,
+	const char* timeReportFile, const char* perfReportFile, bool writeDeps)
+{
+	std::vector<BatchJob> jobs;
+	if (!parse_manifest(manifestFile, jobs))
+		return EXIT_FAILURE;
+
+	if (numThreads == 0)
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+	if (numThreads > jobs.size())
+		numThreads = std::max<size_t>(1, jobs.size());
+
+	// Keep a single frontend instance alive for the whole batch.
+	glsl_frontend_init();
+
+	auto batchStart = std::chrono::steady_clock::now();
+
+	if (numThreads == 1)
+	{
+		for (auto& job : jobs)
+		{
+			run_batch_job(job, cache, packFile != nullptr, false, timeReportFile != nullptr, perfReportFile != nullptr, writeDeps);
+			report_batch_job(job);
+		}
+	}
+	else
+	{
+		// Worker threads grab the next pending job from a shared counter, so that threads which
+		// finish early keep pulling work until the manifest is exhausted. Results are reported
+		// by the main thread in manifest order, regardless of the order in which jobs complete.
+		std::atomic<size_t> nextJob{0};
+		std::mutex doneLock;
+		std::condition_variable doneCond;
+
+		auto worker = [&]()
+		{
+			for (;;)
+			{
+				size_t i = nextJob++;
+				if (i >= jobs.size())
+					break;
+
+				run_batch_job(jobs[i], cache, packFile != nullptr, true, timeReportFile != nullptr, perfReportFile != nullptr, writeDeps);
+
+				std::lock_guard<std::mutex> lock(doneLock);
+				jobs[i].done = true;
+				doneCond.notify_all();
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < numThreads; i ++)
+			threads.emplace_back(worker);
+
+		for (auto& job : jobs)
+		{
+			std::unique_lock<std::mutex> lock(doneLock);
+			doneCond.wait(lock, [&]{ return job.done; });
+			lock.unlock();
+			report_batch_job(job);
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	unsigned numFailed = 0, numCached = 0;
+	for (auto& job : jobs)
+	{
+		if (!job.rc)
+			numFailed++;
+		else if (job.cacheHit)
+			numCached++;
+	}
+
+	printf("Compiled %u shader(s) (%u failed, %u cached) in %.3f ms using %u thread(s)\n",
+		unsigned(jobs.size()), numFailed, numCached, elapsed_ms(batchStart), numThreads);
+
+	bool ok = !numFailed;
+	if (ok && packFile)
+		ok = pack_batch(packFile, jobs);
+
+	if (timeReportFile)
+	{
+		std::string json;
+		for (auto& job : jobs)
+			append_time_report(json, job.inFile.c_str(), job.stageName.c_str(), job.rc, job.cacheHit, job.time, job.timeReport);
+		if (!write_report(timeReportFile, std::move(json)))
+			ok = false;
+	}
+
+	if (perfReportFile)
+	{
+		std::string json;
+		for (auto& job : jobs)
+			append_perf_report(json, job.inFile.c_str(), job.stageName.c_str(), job.rc, job.perfReport);
+		if (!write_report(perfReportFile, std::move(json)))
+			ok = false;
+	}
+
+	jobs.clear();
+	glsl_frontend_exit();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs fn(i) for every i in [0, count), spreading the calls across the given number of threads.
+template <typename Fn>
+static void parallel_for(size_t count, unsigned numThreads, Fn fn)
+{
+	if (numThreads <= 1 || count <= 1)
+	{
+		for (size_t i = 0; i < count; i ++)
+			fn(i);
+		return;
+	}
+
+	std::atomic<size_t> next{0};
+	auto worker = [&]()
+	{
+		for (size_t i; (i = next++) < count;)
+			fn(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < numThreads && i < count; i ++)
+		threads.emplace_back(worker);
+	for (auto& thread : threads)
+		thread.join();
+}
+
+struct PermutationAxis
+{
+	std::string name;
+	std::vector<std::string> values; // "-" = undefined, "+" = defined without a value
+};
+
+struct PermutationVariant
+{
+	std::string name; // program name in the module, e.g. "FOG,LIGHTS=2"
+	std::vector<std::string> defines;
+	char* preprocessed;
+	unsigned program; // index of the unique program this variant was compiled into
+};
+
+struct PermutationProgram
+{
+	unsigned variant; // first variant that produced this program
+	std::unique_ptr<DekoCompiler> program;
+	std::string log;
+
+	static void DiagHandler(void* user, diag_severity severity, const char* message)
+	{
+		PermutationProgram* self = static_cast<PermutationProgram*>(user);
+		self->log += message;
+		self->log += '\n';
+	}
+};
+
+static std::vector<std::string> split_words(const char* line)
+{
+	std::vector<std::string> words;
+	while (*line)
+	{
+		while (isspace((unsigned char)*line)) line++;
+		const char* start = line;
+		while (*line && !isspace((unsigned char)*line)) line++;
+		if (line != start)
+			words.emplace_back(start, line);
+	}
+	return words;
+}
+
+// Permutation specs have one directive per line:
+//   axis <NAME> <value>...       values a macro takes ('-' leaves it undefined, '+' defines it without a value)
+//   exclude <NAME>=<value>...    skips the combinations in which all the given macros have the given values
+// Every combination of axis values that isn't excluded is a variant.
+// Empty lines and lines starting with '#' are ignored.
+static bool parse_permutation_spec(const char* specFile, std::vector<PermutationVariant>& variants)
+{
+	static constexpr size_t MaxVariants = 65536;
+
+	char* spec = read_file(specFile);
+	if (!spec)
+		return false;
+
+	std::vector<PermutationAxis> axes;
+	std::vector<std::vector<std::pair<unsigned, unsigned>>> excludes; // (axis, value) pairs
+	unsigned lineNum = 0;
+	bool ok = true;
+
+	for (char *line = spec, *next; ok && line; line = next)
+	{
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+
+		lineNum++;
+		while (isspace((unsigned char)*line)) line++;
+		if (!*line || *line == '#')
+			continue;
+
+		std::vector<std::string> words = split_words(line);
+		if (words[0] == "axis" && words.size() >= 3)
+		{
+			for (auto& axis : axes)
+				if (axis.name == words[1])
+				{
+					fprintf(stderr, "%s:%u: duplicate axis: %s\n", specFile, lineNum, words[1].c_str());
+					ok = false;
+				}
+
+			PermutationAxis axis;
+			axis.name = words[1];
+			axis.values.assign(words.begin()+2, words.end());
+			axes.push_back(std::move(axis));
+		}
+		else if (words[0] == "exclude" && words.size() >= 2)
+		{
+			std::vector<std::pair<unsigned, unsigned>> rule;
+			for (size_t i = 1; ok && i < words.size(); i ++)
+			{
+				size_t eq = words[i].find('=');
+				std::string name = words[i].substr(0, eq);
+				std::string value = eq != std::string::npos ? words[i].substr(eq+1) : "+";
+
+				ok = false;
+				for (unsigned a = 0; !ok && a < axes.size(); a ++)
+					if (axes[a].name == name)
+						for (unsigned v = 0; !ok && v < axes[a].values.size(); v ++)
+							if (axes[a].values[v] == value)
+							{
+								rule.emplace_back(a, v);
+								ok = true;
+							}
+
+				if (!ok)
+					fprintf(stderr, "%s:%u: unknown axis value: %s\n", specFile, lineNum, words[i].c_str());
+			}
+			excludes.push_back(std::move(rule));
+		}
+		else
+		{
+			fprintf(stderr, "%s:%u: malformed permutation spec entry\n", specFile, lineNum);
+			ok = false;
+		}
+	}
+
+	delete[] spec;
+	if (!ok)
+		return false;
+
+	size_t numCombinations = 1;
+	for (auto& axis : axes)
+	{
+		numCombinations *= axis.values.size();
+		if (numCombinations > MaxVariants)
+		{
+			fprintf(stderr, "%s: too many permutations (max %u)\n", specFile, unsigned(MaxVariants));
+			return false;
+		}
+	}
+
+	// Enumerate the combinations with the first axis varying the slowest
+	std::vector<unsigned> choice(axes.size());
+	for (size_t n = 0; n < numCombinations; n ++)
+	{
+		size_t rem = n;
+		for (size_t a = axes.size(); a --;)
+		{
+			choice[a] = rem % axes[a].values.size();
+			rem /= axes[a].values.size();
+		}
+
+		bool excluded = false;
+		for (auto& rule : excludes)
+		{
+			excluded = true;
+			for (auto& cond : rule)
+				excluded = excluded && choice[cond.first] == cond.second;
+			if (excluded)
+				break;
+		}
+		if (excluded)
+			continue;
+
+		PermutationVariant variant{};
+		for (size_t a = 0; a < axes.size(); a ++)
+		{
+			std::string const& value = axes[a].values[choice[a]];
+			if (value == "-")
+				continue;
+
+			std::string define = axes[a].name;
+			if (value != "+")
+				define += "=" + value;
+			if (!variant.name.empty())
+				variant.name += ',';
+			variant.name += define;
+			variant.defines.push_back(std::move(define));
+		}
+		variants.push_back(std::move(variant));
+	}
+
+	return true;
+}
+
+// Compiles every variant of a shader described by a permutation spec, and packs them into a single
+// module with one name per variant. Variants are preprocessed first, and those that preprocess to
+// the same text (e.g. because some macros aren't used by this stage) share a single compiled program.
+static int compile_permutations(pipeline_stage stage, const char* inFile, const char* specFile, const char* outFile, unsigned numThreads,
+	const char* depFile)
+{
+	std::vector<PermutationVariant> variants;
+	if (!parse_permutation_spec(specFile, variants))
+		return EXIT_FAILURE;
+
+	char* glsl_source = read_file(inFile);
+	if (!glsl_source)
+		return EXIT_FAILURE;
+
+	if (numThreads == 0)
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+
+	glsl_frontend_init();
+	auto start = std::chrono::steady_clock::now();
+	IncludeResolver includes{inFile, s_includeDirs};
+
+	auto getDefines = [&](PermutationVariant const& variant)
+	{
+		std::vector<const char*> defines;
+		for (auto& define : variant.defines)
+			defines.push_back(define.c_str());
+		defines.push_back(nullptr);
+		return defines;
+	};
+
+	parallel_for(variants.size(), numThreads, [&](size_t i)
+	{
+		variants[i].preprocessed = glsl_preprocess(glsl_source, stage, getDefines(variants[i]).data(), &includes);
+	});
+
+	// Variants that fail to preprocess are compiled on their own, so that the errors get reported
+	std::vector<PermutationProgram> programs;
+	std::unordered_map<std::string, unsigned> uniqueSources;
+	for (unsigned i = 0; i < variants.size(); i ++)
+	{
+		PermutationVariant& variant = variants[i];
+		if (variant.preprocessed)
+		{
+			auto ins = uniqueSources.emplace(variant.preprocessed, programs.size());
+			free(variant.preprocessed);
+			variant.preprocessed = nullptr;
+			if (!ins.second)
+			{
+				variant.program = ins.first->second;
+				continue;
+			}
+		}
+
+		variant.program = programs.size();
+		programs.emplace_back();
+		programs.back().variant = i;
+	}
+	uniqueSources.clear();
+
+	parallel_for(programs.size(), numThreads, [&](size_t i)
+	{
+		PermutationProgram& prog = programs[i];
+		diag_set_handler(PermutationProgram::DiagHandler, &prog);
+		prog.program.reset(new DekoCompiler{stage, 3, s_maxGprs, s_unrollBudget, s_ssboAlignment, s_timings});
+		if (!prog.program->CompileGlsl(glsl_source, getDefines(variants[prog.variant]).data(), &includes))
+			prog.program.reset();
+		diag_set_handler(nullptr, nullptr);
+	});
+	delete[] glsl_source;
+
+	unsigned numFailed = 0;
+	for (auto& prog : programs)
+	{
+		if (!prog.program)
+			numFailed++;
+		if (!prog.log.empty())
+			fprintf(stderr, "%s (%s):\n%s", inFile, variants[prog.variant].name.c_str(), prog.log.c_str());
+	}
+
+	printf("Compiled %u variant(s) into %u program(s) (%u failed) in %.3f ms using %u thread(s)\n",
+		unsigned(variants.size()), unsigned(programs.size()), numFailed, elapsed_ms(start), numThreads);
+
+	bool ok = !numFailed;
+	if (ok)
+	{
+		std::vector<DekoCompiler*> progPtrs;
+		std::vector<const char*> names;
+		std::vector<unsigned> nameProgramIds;
+		for (auto& prog : programs)
+			progPtrs.push_back(prog.program.get());
+		for (auto& variant : variants)
+		{
+			names.push_back(variant.name.c_str());
+			nameProgramIds.push_back(variant.program);
+		}
+
+		std::vector<uint8_t> dksh;
+		DekoCompiler::OutputDksh(dksh, progPtrs.data(), progPtrs.size(), names.data(), names.size(), nameProgramIds.data());
+		ok = write_file(outFile, dksh) && (!depFile || includes.WriteDepfile(depFile, outFile));
+	}
+
+	programs.clear();
+	glsl_frontend_exit();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char* argv[])
 {
-	const char *inFile = nullptr, *outFile = nullptr, *rawFile = nullptr, *tgsiFile = nullptr, *stageName = nullptr;
+	const char *inFile = nullptr, *outFile = nullptr, *rawFile = nullptr, *tgsiFile = nullptr, *stageName = nullptr, *batchFile = nullptr;
+	const char *cacheDir = nullptr, *packFile = nullptr, *permuteFile = nullptr, *depFile = nullptr;
+	const char *socketPath = nullptr, *timeReportFile = nullptr, *perfReportFile = nullptr;
+	bool server = false, numThreadsSet = false, writeDeps = false;
+	unsigned numThreads = 1;
+	unsigned long cacheSizeMiB = 1024;
 
 	static struct option long_options[] =
 	{
@@ -26,13 +861,52 @@ int main(int argc, char* argv[])
 		{ "raw",     required_argument, NULL, 'r' },
 		{ "tgsi",    required_argument, NULL, 't' },
 		{ "stage",   required_argument, NULL, 's' },
+		{ "batch",   required_argument, NULL, 'b' },
+		{ "pack",    required_argument, NULL, 'p' },
+		{ "jobs",    required_argument, NULL, 'j' },
+		{ "include-dir", required_argument, NULL, 'I' },
+		{ "cache-dir",  required_argument, NULL, 'c' },
+		{ "cache-size", required_argument, NULL, OPT_CACHE_SIZE },
+		{ "server",  optional_argument, NULL, OPT_SERVER },
+		{ "time-report", required_argument, NULL, OPT_TIME_REPORT },
+		{ "perf-report", required_argument, NULL, OPT_PERF_REPORT },
+		{ "max-gprs", required_argument, NULL, OPT_MAX_GPRS },
+		{ "target-occupancy", required_argument, NULL, OPT_TARGET_OCCUPANCY },
+		{ "unroll-budget", required_argument, NULL, OPT_UNROLL_BUDGET },
+		{ "ssbo-alignment", required_argument, NULL, OPT_SSBO_ALIGNMENT },
+		{ "permute", required_argument, NULL, OPT_PERMUTE },
+		{ "timings", required_argument, NULL, OPT_TIMINGS },
+		{ "dump-timings", no_argument, NULL, OPT_DUMP_TIMINGS },
 		{ "help",    no_argument,       NULL, '?' },
 		{ "version", no_argument,       NULL, 'v' },
 		{ NULL, 0, NULL, 0 }
 	};
 
+	// getopt only knows -M with an attached argument, so "-MF <file>" is joined into "-MF<file>"
+	std::vector<std::string> joinedArgs;
+	std::vector<char*> args;
+	joinedArgs.reserve(argc);
+	for (int i = 0; i < argc; i ++)
+	{
+		if (strcmp(argv[i], "--") == 0)
+		{
+			args.insert(args.end(), argv + i, argv + argc);
+			break;
+		}
+		if (i > 0 && strcmp(argv[i], "-MF") == 0 && i + 1 < argc)
+		{
+			joinedArgs.push_back(std::string{"-MF"} + argv[++i]);
+			args.push_back(&joinedArgs.back()[0]);
+		}
+		else
+			args.push_back(argv[i]);
+	}
+	argc = args.size();
+	args.push_back(nullptr);
+	argv = args.data();
+
 	int opt, optidx = 0;
-	while ((opt = getopt_long(argc, argv, "o:r:t:s:?v", long_options, &optidx)) != -1)
+	while ((opt = getopt_long(argc, argv, "o:r:t:s:b:p:j:I:M:c:?v", long_options, &optidx)) != -1)
 	{
 		switch (opt)
 		{
@@ -40,13 +914,78 @@ int main(int argc, char* argv[])
 			case 'r': rawFile = optarg; break;
 			case 't': tgsiFile = optarg; break;
 			case 's': stageName = optarg; break;
+			case 'b': batchFile = optarg; break;
+			case 'p': packFile = optarg; break;
+			case 'j': numThreads = strtoul(optarg, NULL, 0); numThreadsSet = true; break;
+			case 'I': s_includeDirs.push_back(optarg); break;
+			case 'M':
+				// -MD, or -MF<file> (see above for -MF <file>)
+				if (strcmp(optarg, "D") == 0)
+					writeDeps = true;
+				else if (optarg[0] == 'F' && optarg[1])
+				{
+					writeDeps = true;
+					depFile = optarg + 1;
+				}
+				else
+					return usage(argv[0]);
+				break;
+			case 'c': cacheDir = optarg; break;
+			case OPT_CACHE_SIZE: cacheSizeMiB = strtoul(optarg, NULL, 0); break;
+			case OPT_SERVER: server = true; socketPath = optarg; break;
+			case OPT_TIME_REPORT: timeReportFile = optarg; break;
+			case OPT_PERF_REPORT: perfReportFile = optarg; break;
+			case OPT_MAX_GPRS: s_maxGprs = strtoul(optarg, NULL, 0); break;
+			case OPT_TARGET_OCCUPANCY: s_maxGprs = DekoCompiler::CalcGprBudget(strtoul(optarg, NULL, 0)); break;
+			case OPT_UNROLL_BUDGET: s_unrollBudget = strtoul(optarg, NULL, 0); break;
+			case OPT_SSBO_ALIGNMENT:
+				s_ssboAlignment = strtoul(optarg, NULL, 0);
+				if (s_ssboAlignment != 4 && s_ssboAlignment != 8 && s_ssboAlignment != 16)
+				{
+					fprintf(stderr, "Invalid SSBO alignment: `%s'\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case OPT_PERMUTE: permuteFile = optarg; break;
+			case OPT_TIMINGS:
+				if (!DekoCompiler::LoadTimings(optarg, s_timingTable))
+					return EXIT_FAILURE;
+				s_timings = s_timingTable;
+				break;
+			case OPT_DUMP_TIMINGS:
+			{
+				std::string timings;
+				DekoCompiler::OutputTimings(timings);
+				fputs(timings.c_str(), stdout);
+				return EXIT_SUCCESS;
+			}
 			case '?': usage(argv[0]); return EXIT_SUCCESS;
 			case 'v': printf("%s - Built on %s %s\n", PACKAGE_STRING, __DATE__, __TIME__); return EXIT_SUCCESS;
 			default:  return usage(argv[0]);
 		}
 	}
 
-	if ((argc-optind) != 1)
+	std::unique_ptr<ShaderCache> cache;
+	if (cacheDir)
+		cache.reset(new ShaderCache{cacheDir, uint64_t(cacheSizeMiB) << 20});
+
+	if (server)
+	{
+		if (optind != argc || batchFile || packFile || permuteFile || outFile || rawFile || tgsiFile || stageName || timeReportFile || perfReportFile
+			|| writeDeps)
+			return usage(argv[0]);
+		return compile_server(socketPath, numThreadsSet ? numThreads : 0, cache.get(), s_includeDirs, s_maxGprs, s_unrollBudget, s_ssboAlignment, s_timings);
+	}
+
+	if (batchFile)
+	{
+		// Dependency files are written next to each output, which doesn't work when packing
+		if (optind != argc || permuteFile || outFile || rawFile || tgsiFile || stageName || depFile || (writeDeps && packFile))
+			return usage(argv[0]);
+		return compile_batch(batchFile, numThreads, cache.get(), packFile, timeReportFile, perfReportFile, writeDeps);
+	}
+
+	if ((argc-optind) != 1 || packFile)
 		return usage(argv[0]);
 	inFile = argv[optind];
 
@@ -63,52 +1002,49 @@ int main(int argc, char* argv[])
 	}
 
 	pipeline_stage stage;
-	if (0) ((void)0);
-#define TEST_STAGE(_str,_val) else if (strcmp(stageName,(_str))==0) stage = (_val)
-	TEST_STAGE("vert", pipeline_stage_vertex);
-	TEST_STAGE("tess_ctrl", pipeline_stage_tess_ctrl);
-	TEST_STAGE("tess_eval", pipeline_stage_tess_eval);
-	TEST_STAGE("geom", pipeline_stage_geometry);
-	TEST_STAGE("frag", pipeline_stage_fragment);
-	TEST_STAGE("comp", pipeline_stage_compute);
-#undef TEST_STAGE
-	else
-	{
-		fprintf(stderr, "Unrecognized pipeline stage: `%s'\n", stageName);
+	if (!parse_stage(stageName, stage))
 		return EXIT_FAILURE;
-	}
 
-	FILE* fin = fopen(inFile, "rb");
-	if (!fin)
+	std::string defaultDepFile;
+	if (writeDeps && !depFile)
 	{
-		fprintf(stderr, "Could not open input file: %s\n", inFile);
-		return EXIT_FAILURE;
+		defaultDepFile = default_depfile(outFile ? outFile : rawFile ? rawFile : tgsiFile);
+		depFile = defaultDepFile.c_str();
 	}
 
-	fseek(fin, 0, SEEK_END);
-	long fsize = ftell(fin);
-	rewind(fin);
-
-	char* glsl_source = new char[fsize+1];
-	fread(glsl_source, 1, fsize, fin);
-	fclose(fin);
-	glsl_source[fsize] = 0;
+	if (permuteFile)
+	{
+		if (!outFile || rawFile || tgsiFile || cacheDir || timeReportFile || perfReportFile)
+			return usage(argv[0]);
+		return compile_permutations(stage, inFile, permuteFile, outFile, numThreads, depFile);
+	}
 
-	DekoCompiler compiler{stage};
-	bool rc = compiler.CompileGlsl(glsl_source);
-	delete[] glsl_source;
+	TimeReport timeReport;
+	std::string perfReport;
+	if (timeReportFile)
+		TimeReport::MakeCurrent(&timeReport);
 
-	if (!rc)
-		return EXIT_FAILURE;
+	auto start = std::chrono::steady_clock::now();
+	bool cacheHit = false;
+	bool rc = compile_file(stage, inFile, outFile, rawFile, tgsiFile, cache.get(), &cacheHit, perfReportFile ? &perfReport : nullptr, depFile);
+	double time = elapsed_ms(start);
+	TimeReport::MakeCurrent(nullptr);
 
-	if (outFile)
-		compiler.OutputDksh(outFile);
-
-	if (rawFile)
-		compiler.OutputRawCode(rawFile);
+	if (timeReportFile)
+	{
+		std::string json;
+		append_time_report(json, inFile, stageName, rc, cacheHit, time, timeReport);
+		if (!write_report(timeReportFile, std::move(json)))
+			rc = false;
+	}
 
-	if (tgsiFile)
-		compiler.OutputTgsi(tgsiFile);
+	if (perfReportFile)
+	{
+		std::string json;
+		append_perf_report(json, inFile, stageName, rc, perfReport);
+		if (!write_report(perfReportFile, std::move(json)))
+			rc = false;
+	}
 
-	return EXIT_SUCCESS;
+	return rc ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,10 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "util/os_misc.h"
+#include "diagnostics.h"
 
 void os_log_message(const char *message)
 {
-	fputs(message, stderr);
+	diag_log_text(message);
 }
 
 const char* os_get_option(const char *name)
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "util/mesa-sha1.h"
+#include "shader_cache.h"
+#include "dksh.h"
+
+namespace
+{
+	constexpr char s_entryExt[] = ".dksh";
+	constexpr size_t s_entryExtLen = sizeof(s_entryExt)-1;
+
+	constexpr char s_tempExt[] = ".tmp";
+	constexpr size_t s_tempExtLen = sizeof(s_tempExt)-1;
+
+	// Temporary files older than this were left behind by a writer that crashed or was
+	// interrupted (a store takes well under a second), and are removed during eviction.
+	constexpr time_t s_staleTempAge = 60*60;
+
+	bool IsCacheEntry(const char* name)
+	{
+		size_t len = strlen(name);
+		return len == 40+s_entryExtLen && strcmp(name+40, s_entryExt) == 0;
+	}
+
+	// Temporary files are named after the entry they are written for (see ShaderCache::Store).
+	bool IsTempFile(const char* name)
+	{
+		size_t len = strlen(name);
+		return len > 40+s_entryExtLen+s_tempExtLen && strncmp(name+40, s_entryExt, s_entryExtLen) == 0 &&
+			name[40+s_entryExtLen] == '.' && strcmp(name+len-s_tempExtLen, s_tempExt) == 0;
+	}
+
+	void MakeDirectory(const char* path)
+	{
+#ifdef _WIN32
+		_mkdir(path);
+#else
+		mkdir(path, 0755);
+#endif
+	}
+}
+
+ShaderCache::ShaderCache(const char* dir, uint64_t maxSize) :
+	m_dir{dir}, m_maxSize{maxSize}, m_curSize{}, m_curSizeKnown{}
+{
+	while (m_dir.size() > 1 && (m_dir.back() == '/' || m_dir.back() == '\\'))
+		m_dir.pop_back();
+	MakeDirectory(m_dir.c_str());
+}
+
+std::string ShaderCache::GetEntryPath(const uint8_t key[20]) const
+{
+	char name[41];
+	_mesa_sha1_format(name, key);
+	return m_dir + "/" + name + s_entryExt;
+}
+
+bool ShaderCache::Load(const uint8_t key[20], std::vector<uint8_t>& data)
+{
+	std::string path = GetEntryPath(key);
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	rewind(f);
+
+	bool ok = fsize >= long(sizeof(DkshHeader));
+	if (ok)
+	{
+		data.resize(fsize);
+		ok = fread(data.data(), 1, fsize, f) == size_t(fsize);
+	}
+	fclose(f);
+
+	// Reject anything that does not look like a DKSH module
+	if (ok)
+	{
+		DkshHeader hdr;
+		memcpy(&hdr, data.data(), sizeof(hdr));
+		ok = hdr.magic == DKSH_MAGIC && uint64_t(hdr.control_sz) + hdr.code_sz == uint64_t(fsize);
+	}
+
+	if (!ok)
+	{
+		data.clear();
+		return false;
+	}
+
+	// Refresh the modification time, which is used as the LRU timestamp during eviction
+	utime(path.c_str(), nullptr);
+	return true;
+}
+
+void ShaderCache::Store(const uint8_t key[20], const std::vector<uint8_t>& data)
+{
+	static std::atomic<unsigned> s_tempCounter{0};
+
+	std::string path = GetEntryPath(key);
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%d-%u.tmp", int(getpid()), s_tempCounter++);
+	std::string tempPath = path + suffix;
+
+	FILE* f = fopen(tempPath.c_str(), "wb");
+	if (!f)
+		return;
+
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = fclose(f) == 0 && ok;
+
+	// rename() atomically replaces the entry on POSIX systems. Elsewhere it fails if the entry
+	// already exists, in which case another worker has already stored the very same data.
+	if (!ok || rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		remove(tempPath.c_str());
+		return;
+	}
+
+	if (!m_maxSize)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_curSizeKnown)
+	{
+		m_curSize = Evict(UINT64_MAX, path);
+		m_curSizeKnown = true;
+	}
+	else
+		m_curSize += data.size();
+
+	// The running total is only an estimate when other processes share the cache,
+	// so eviction rescans the directory to get the real size.
+	if (m_curSize > m_maxSize)
+		m_curSize = Evict(m_maxSize - m_maxSize/8, path);
+}
+
+// Removes the least recently used entries (other than keepPath, the entry that was just stored)
+// until the size of the cache is at most targetSize. Returns the resulting size of the cache.
+// Stale temporary files are always removed; those still being written count towards the size.
+uint64_t ShaderCache::Evict(uint64_t targetSize, std::string const& keepPath)
+{
+	struct Entry
+	{
+		std::string path;
+		time_t mtime;
+		uint64_t size;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t totalSize = 0;
+
+	DIR* dir = opendir(m_dir.c_str());
+	if (!dir)
+		return 0;
+
+	time_t now = time(nullptr);
+	while (struct dirent* ent = readdir(dir))
+	{
+		bool isTemp = IsTempFile(ent->d_name);
+		if (!isTemp && !IsCacheEntry(ent->d_name))
+			continue;
+
+		Entry entry;
+		entry.path = m_dir + "/" + ent->d_name;
+
+		struct stat st;
+		if (stat(entry.path.c_str(), &st) != 0)
+			continue;
+
+		if (isTemp)
+		{
+			if (now - st.st_mtime > s_staleTempAge && remove(entry.path.c_str()) == 0)
+				continue;
+			totalSize += st.st_size;
+			continue;
+		}
+
+		entry.mtime = st.st_mtime;
+		entry.size = st.st_size;
+		totalSize += entry.size;
+		entries.push_back(std::move(entry));
+	}
+	closedir(dir);
+
+	if (totalSize <= targetSize)
+		return totalSize;
+
+	std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) { return a.mtime < b.mtime; });
+	for (auto& entry : entries)
+	{
+		if (totalSize <= targetSize)
+			break;
+		if (entry.path != keepPath && remove(entry.path.c_str()) == 0)
+			totalSize -= entry.size;
+	}
+
+	return totalSize;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// On-disk cache of compiled DKSH modules, indexed by a SHA-1 key (see DekoCompiler::ComputeCacheKey).
+// Entries are written atomically (temporary file + rename), which allows several compiler
+// processes or threads to share the same cache directory. Once the total size of the cache
+// exceeds the configured limit, the least recently used entries are evicted.
+class ShaderCache
+{
+	std::string m_dir;
+	uint64_t m_maxSize;
+	uint64_t m_curSize;
+	bool m_curSizeKnown;
+	std::mutex m_mutex;
+
+	std::string GetEntryPath(const uint8_t key[20]) const;
+	uint64_t Evict(uint64_t targetSize, std::string const& keepPath);
+
+public:
+	ShaderCache(const char* dir, uint64_t maxSize);
+
+	bool Load(const uint8_t key[20], std::vector<uint8_t>& data);
+	void Store(const uint8_t key[20], const std::vector<uint8_t>& data);
+};
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "util/u_time_report.h"
+#include "time_report.h"
+
+namespace
+{
+	thread_local TimeReport* s_current;
+
+	void Indent(std::string& out, unsigned indent)
+	{
+		out += '\n';
+		out.append(indent, '\t');
+	}
+}
+
+TimeReport::TimeReport() : m_root{}, m_curMem{}, m_runPeak{}
+{
+}
+
+void TimeReport::Begin(const char* name)
+{
+	Phase* parent = m_stack.empty() ? &m_root : m_stack.back().phase;
+
+	// Phases are merged by name, so that passes which run several times show up once
+	Phase* phase = nullptr;
+	for (auto& child : parent->children)
+	{
+		if (strcmp(child->name, name) == 0)
+		{
+			phase = child.get();
+			break;
+		}
+	}
+
+	if (!phase)
+	{
+		parent->children.emplace_back(new Phase{name});
+		phase = parent->children.back().get();
+	}
+
+	m_stack.push_back(Frame{phase, Clock::now(), m_runPeak});
+	m_runPeak = m_curMem;
+}
+
+void TimeReport::End()
+{
+	if (m_stack.empty())
+		return;
+
+	Frame& frame = m_stack.back();
+	Phase* phase = frame.phase;
+	phase->count++;
+	phase->timeMs += std::chrono::duration<double, std::milli>(Clock::now() - frame.start).count();
+	phase->peakMem = std::max(phase->peakMem, m_runPeak);
+
+	m_runPeak = std::max(frame.savedPeak, m_runPeak);
+	m_stack.pop_back();
+}
+
+void TimeReport::TrackMemory(ptrdiff_t delta)
+{
+	m_curMem += delta;
+	if (m_curMem > m_runPeak)
+		m_runPeak = m_curMem;
+}
+
+void TimeReport::WritePhases(std::string& out, Phase const& parent, unsigned indent)
+{
+	char buf[128];
+	bool first = true;
+	for (auto& phase : parent.children)
+	{
+		if (!first)
+			out += ',';
+		first = false;
+
+		Indent(out, indent);
+		out += "{ \"name\": ";
+		JsonString(out, phase->name);
+		snprintf(buf, sizeof(buf), ", \"count\": %u, \"time_ms\": %.3f, \"peak_bytes\": %lld",
+			phase->count, phase->timeMs, (long long)phase->peakMem);
+		out += buf;
+
+		if (!phase->children.empty())
+		{
+			out += ", \"phases\": [";
+			WritePhases(out, *phase, indent+1);
+			Indent(out, indent);
+			out += ']';
+		}
+		out += " }";
+	}
+}
+
+void TimeReport::MakeCurrent(TimeReport* report)
+{
+	s_current = report;
+}
+
+void TimeReport::JsonString(std::string& out, const char* str)
+{
+	out += '"';
+	for (; *str; str ++)
+	{
+		unsigned char c = *str;
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c < 0x20)
+		{
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else
+			out += c;
+	}
+	out += '"';
+}
+
+void util_time_report_begin(const char *phase)
+{
+	if (s_current)
+		s_current->Begin(phase);
+}
+
+void util_time_report_end(void)
+{
+	if (s_current)
+		s_current->End();
+}
+
+void util_time_report_mem(ptrdiff_t delta)
+{
+	if (s_current)
+		s_current->TrackMemory(delta);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Records the wall time and peak tracked heap memory (ralloc blocks and nv50_ir memory pools)
+// of each compilation phase, as reported through the hooks in util/u_time_report.h.
+// A report only records the phases that run on the thread it is made current on.
+class TimeReport
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Phase
+	{
+		const char* name;
+		unsigned count;
+		double timeMs;
+		int64_t peakMem;
+		std::vector<std::unique_ptr<Phase>> children;
+	};
+
+	struct Frame
+	{
+		Phase* phase;
+		Clock::time_point start;
+		int64_t savedPeak;
+	};
+
+	Phase m_root;
+	std::vector<Frame> m_stack;
+	int64_t m_curMem;
+	int64_t m_runPeak;
+
+	static void WritePhases(std::string& out, Phase const& parent, unsigned indent);
+
+public:
+	TimeReport();
+
+	void Begin(const char* name);
+	void End();
+	void TrackMemory(ptrdiff_t delta);
+
+	int64_t GetPeakMemory() const { return m_runPeak; }
+
+	// Appends the recorded phases as the contents of a JSON array (without the brackets).
+	void WriteJson(std::string& out, unsigned indent) const { WritePhases(out, m_root, indent); }
+
+	static void MakeCurrent(TimeReport* report);
+	static void JsonString(std::string& out, const char* str);
+};
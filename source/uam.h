@@ -0,0 +1,72 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// libuam - in-memory interface to the UAM shader compiler.
+//
+// Usage:
+//   uam_init();
+//   uam_result* res = uam_compile(source, uam_stage_fragment, NULL);
+//   if (uam_result_succeeded(res)) { size_t size; const void* dksh = uam_result_get_dksh(res, &size); ... }
+//   for (size_t i = 0; i < uam_result_get_num_diagnostics(res); i ++) { ... }
+//   uam_result_free(res);
+//   uam_exit();
+//
+// uam_compile may be called concurrently from multiple threads.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	uam_stage_vertex,
+	uam_stage_tess_ctrl,
+	uam_stage_tess_eval,
+	uam_stage_geometry,
+	uam_stage_fragment,
+	uam_stage_compute,
+} uam_stage;
+
+typedef enum
+{
+	uam_severity_info,
+	uam_severity_warning,
+	uam_severity_error,
+} uam_severity;
+
+typedef struct
+{
+	uam_severity severity;
+	const char* message;
+} uam_diagnostic;
+
+typedef struct
+{
+	int opt_level; // 0..3 (see nv50_ir_prog_info::optLevel)
+	unsigned max_gprs; // register budget, 0 = hardware limit (see --max-gprs)
+	unsigned unroll_budget; // unrolled loop size limit in IR nodes, 0 = default (see --unroll-budget)
+	unsigned ssbo_alignment; // alignment in bytes of SSBO addresses, 4 (default) to 16 (see --ssbo-alignment)
+} uam_options;
+
+typedef struct uam_result uam_result;
+
+// Keeps the GLSL frontend (builtin functions, type tables) initialized until the matching uam_exit.
+void uam_init(void);
+void uam_exit(void);
+
+void uam_options_init(uam_options* options);
+
+// Compiles a NUL-terminated GLSL source string. options may be NULL, in which case defaults are used.
+// Always returns a result object (which must be freed with uam_result_free), or NULL on out-of-memory.
+uam_result* uam_compile(const char* source, uam_stage stage, const uam_options* options);
+
+bool uam_result_succeeded(const uam_result* result);
+const void* uam_result_get_dksh(const uam_result* result, size_t* size);
+size_t uam_result_get_num_diagnostics(const uam_result* result);
+const uam_diagnostic* uam_result_get_diagnostic(const uam_result* result, size_t index);
+void uam_result_free(uam_result* result);
+
+#ifdef __cplusplus
+}
+#endif